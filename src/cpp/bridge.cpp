@@ -0,0 +1,247 @@
+#include "bridge.h"
+
+#include <limits>
+
+#include <boost/bind.hpp>
+#include <ros/serialization.h>
+
+#include "util.h"
+
+// TopicBridge
+
+bool TopicBridge::matches(const MediaType& media_type) {
+    return (
+        media_type.type == "application" &&
+        media_type.tree == "vnd" &&
+        (media_type.sub_type == "ros-webrtc.topic.v1" || is_mux(media_type))
+    );
+}
+
+bool TopicBridge::is_mux(const MediaType& media_type) {
+    return media_type.sub_type == "ros-webrtc.mux.v1";
+}
+
+TopicBridge::TopicBridge(
+    bool mux,
+    ros::NodeHandle& nh,
+    const std::string& ns,
+    const std::string& label,
+    const Send& send,
+    uint32_t queue_size) :
+    _mux(mux),
+    _nh(nh),
+    _ns(ns),
+    _label(label),
+    _send(send),
+    _queue_size(queue_size),
+    _next_id(0) {
+}
+
+TopicBridge::~TopicBridge() {
+    std::map<std::string, OutboundPtr> outbound;
+    {
+        rtc::CritScope cs(&_outbound_cs);
+        outbound.swap(_outbound);
+    }
+    // waits for in-flight callbacks, which take the lock
+    for (auto i = outbound.begin(); i != outbound.end(); i++) {
+        (*i).second->sub.shutdown();
+    }
+    rtc::CritScope cs(&_inbound_cs);
+    _inbound_ids.clear();
+    _inbound.clear();
+}
+
+bool TopicBridge::forward(const std::string& topic, uint32_t queue_size) {
+    rtc::CritScope cs(&_outbound_cs);
+    if (_outbound.find(topic) != _outbound.end()) {
+        ROS_INFO_STREAM(
+            "bridge '" << _label << "' already forwarding '" << topic << "'"
+        );
+        return true;
+    }
+    if (_mux && _next_id > std::numeric_limits<uint16_t>::max()) {
+        ROS_WARN_STREAM(
+            "bridge '" << _label << "' cannot forward '" << topic << "' - " <<
+            "out of topic ids"
+        );
+        return false;
+    }
+    OutboundPtr outbound(new Outbound());
+    outbound->id = _next_id;
+    outbound->definition_sent = false;
+    try {
+        outbound->sub = _nh.subscribe<topic_tools::ShapeShifter>(
+            topic,
+            queue_size,
+            boost::bind(&TopicBridge::_on_message, this, topic, _1),
+            ros::VoidConstPtr(),
+            ros::TransportHints().tcpNoDelay()
+        );
+    } catch (const ros::InvalidNameException& ex) {
+        ROS_WARN_STREAM(
+            "bridge '" << _label << "' cannot forward '" << topic << "' - " <<
+            ex.what()
+        );
+        return false;
+    }
+    _next_id += 1;
+    _outbound[topic] = outbound;
+    ROS_INFO_STREAM(
+        "bridge '" << _label << "' forwarding '" << outbound->sub.getTopic() << "'"
+    );
+    return true;
+}
+
+void TopicBridge::_on_message(
+        const std::string& topic,
+        const topic_tools::ShapeShifter::ConstPtr& msg) {
+    OutboundPtr outbound;
+    {
+        rtc::CritScope cs(&_outbound_cs);
+        auto i = _outbound.find(topic);
+        if (i == _outbound.end())
+            return;
+        outbound = (*i).second;
+    }
+
+    BridgeFrame frame;
+    if (_mux) {
+        if (!outbound->definition_sent) {
+            if (!_announce(topic, *outbound, *msg))
+                return;
+            outbound->definition_sent = true;
+        }
+        frame.version = BridgeFrame::MUX_VERSION;
+        frame.kind = BridgeFrame::Message;
+        frame.id = outbound->id;
+    } else {
+        frame.topic = topic;
+        frame.datatype = msg->getDataType();
+        frame.md5sum = msg->getMD5Sum();
+        if (!outbound->definition_sent) {
+            frame.flags |= BridgeFrame::HasDefinition;
+            frame.definition = msg->getMessageDefinition();
+        }
+    }
+
+    // serialize header and message straight into the outbound buffer
+    size_t header_size = frame.header_size();
+    rtc::CopyOnWriteBuffer buffer(header_size + msg->size());
+    frame.encode_header(buffer.data());
+    ros::serialization::OStream stream(buffer.data() + header_size, msg->size());
+    msg->write(stream);
+
+    // never conflate away the frame defining the topic
+    webrtc::DataBuffer data_buffer(buffer, true);
+    if (!_send(data_buffer, frame.has_definition() ? std::string() : topic)) {
+        ROS_DEBUG_STREAM(
+            "bridge '" << _label << "' dropped message on '" << topic << "'"
+        );
+        return;
+    }
+    if (frame.has_definition())
+        outbound->definition_sent = true;
+}
+
+bool TopicBridge::_announce(
+        const std::string& topic,
+        const Outbound& outbound,
+        const topic_tools::ShapeShifter& msg) {
+    BridgeFrame frame;
+    frame.version = BridgeFrame::MUX_VERSION;
+    frame.kind = BridgeFrame::Announce;
+    frame.id = outbound.id;
+    frame.topic = topic;
+    frame.datatype = msg.getDataType();
+    frame.md5sum = msg.getMD5Sum();
+    frame.definition = msg.getMessageDefinition();
+    rtc::CopyOnWriteBuffer buffer(frame.header_size());
+    frame.encode_header(buffer.data());
+    webrtc::DataBuffer data_buffer(buffer, true);
+    if (!_send(data_buffer, std::string())) {
+        ROS_WARN_STREAM(
+            "bridge '" << _label << "' failed to announce '" << topic << "' " <<
+            "w/ id " << outbound.id
+        );
+        return false;
+    }
+    ROS_INFO_STREAM(
+        "bridge '" << _label << "' announced '" << topic << "' " <<
+        "w/ id " << outbound.id
+    );
+    return true;
+}
+
+bool TopicBridge::receive(const uint8_t* data, size_t size) {
+    BridgeFrame frame;
+    if (!frame.decode(data, size)) {
+        ROS_WARN_STREAM(
+            "bridge '" << _label << "' received malformed frame w/ size " << size
+        );
+        return false;
+    }
+
+    rtc::CritScope cs(&_inbound_cs);
+    InboundPtr inbound;
+    if (frame.is_mux()) {
+        if (frame.kind == BridgeFrame::Announce) {
+            inbound = _advertise(frame);
+            if (inbound)
+                _inbound_ids[frame.id] = inbound;
+            return inbound != NULL;
+        }
+        auto i = _inbound_ids.find(frame.id);
+        if (i == _inbound_ids.end()) {
+            ROS_WARN_STREAM(
+                "bridge '" << _label << "' has no topic w/ id " << frame.id << ", " <<
+                "dropping"
+            );
+            return false;
+        }
+        inbound = (*i).second;
+    } else {
+        inbound = _advertise(frame);
+        if (!inbound)
+            return false;
+    }
+
+    ros::serialization::IStream stream(
+        const_cast<uint8_t *>(frame.payload),
+        frame.payload_size
+    );
+    inbound->msg.read(stream);
+    inbound->pub.publish(inbound->msg);
+    return true;
+}
+
+TopicBridge::InboundPtr TopicBridge::_advertise(const BridgeFrame& frame) {
+    auto i = _inbound.find(frame.topic);
+    if (i != _inbound.end() && (*i).second->msg.getMD5Sum() == frame.md5sum)
+        return (*i).second;
+    if (!frame.has_definition()) {
+        ROS_WARN_STREAM(
+            "bridge '" << _label << "' has no definition for '" <<
+            frame.topic << "' w/ type " << frame.datatype << ", dropping"
+        );
+        return InboundPtr();
+    }
+    InboundPtr inbound(new Inbound());
+    inbound->msg.morph(frame.md5sum, frame.datatype, frame.definition, "");
+    std::string topic = ros::names::append(_ns, normalize_name(frame.topic));
+    try {
+        inbound->pub = inbound->msg.advertise(_nh, topic, _queue_size);
+    } catch (const ros::InvalidNameException& ex) {
+        ROS_WARN_STREAM(
+            "bridge '" << _label << "' cannot advertise '" << topic << "' - " <<
+            ex.what()
+        );
+        return InboundPtr();
+    }
+    ROS_INFO_STREAM(
+        "bridge '" << _label << "' advertised '" << topic << "' " <<
+        "w/ type " << frame.datatype
+    );
+    _inbound[frame.topic] = inbound;
+    return inbound;
+}
@@ -0,0 +1,146 @@
+#ifndef ROS_WEBRTC_BRIDGE_H_
+#define ROS_WEBRTC_BRIDGE_H_
+
+#include <map>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <ros/ros.h>
+#include <topic_tools/shape_shifter.h>
+#include <webrtc/api/datachannelinterface.h>
+#include <webrtc/base/criticalsection.h>
+
+#include "bridge_frame.h"
+#include "media_type.h"
+
+/**
+ * \brief Bridges ROS topics over a data channel without (de)serializing messages.
+ *
+ * Local topics are subscribed to as topic_tools::ShapeShifter and their
+ * serialized bytes sent as BridgeFrame(s). Frames received from the remote
+ * peer are republished, again as serialized bytes, under a namespace for the
+ * data channel. The first frame sent for a topic carries its message
+ * definition, which the remote peer needs to advertise it, so bridge
+ * channels should be reliable and ordered.
+ *
+ * Protocols:
+ *
+ *  application/vnd.ros-webrtc.topic.v1 - every frame names its topic and type
+ *  application/vnd.ros-webrtc.mux.v1 - topics are announced once w/ a 16 bit
+ *      id, which is all later frames carry, so many topics can share a
+ *      channel cheaply
+ */
+class TopicBridge {
+
+public:
+
+    typedef boost::function<bool (webrtc::DataBuffer&, const std::string&)> Send;
+
+    /**
+     * \brief Whether a data channel protocol is for bridging topics.
+     */
+    static bool matches(const MediaType& media_type);
+
+    /**
+     * \brief Whether a data channel protocol is for multiplexing topics.
+     */
+    static bool is_mux(const MediaType& media_type);
+
+    /**
+     * \param mux Whether to send multiplexed frames.
+     * \param nh Node handle used to subscribe to local and advertise remote topics.
+     * \param ns Namespace under which topics received from the remote peer are advertised.
+     * \param label Label of the data channel, for logging.
+     * \param send Sends a frame to the remote peer, keyed by topic, or by nothing for frames that must not be conflated.
+     * \param queue_size Size of publisher queues for remote topics.
+     */
+    TopicBridge(
+        bool mux,
+        ros::NodeHandle& nh,
+        const std::string& ns,
+        const std::string& label,
+        const Send& send,
+        uint32_t queue_size);
+
+    ~TopicBridge();
+
+    /**
+     * \brief Subscribes to a local topic and forwards its messages to the remote peer.
+     * \param topic The topic.
+     * \param queue_size Size of the subscriber queue.
+     * \return Whether the topic is now being forwarded.
+     */
+    bool forward(const std::string& topic, uint32_t queue_size);
+
+    /**
+     * \brief Republishes a frame received from the remote peer.
+     * \param data Frame bytes.
+     * \param size Number of frame bytes.
+     * \return Whether the frame was republished.
+     */
+    bool receive(const uint8_t* data, size_t size);
+
+private:
+
+    struct Outbound {
+
+        ros::Subscriber sub;
+
+        uint16_t id;
+
+        bool definition_sent;
+
+    };
+
+    typedef boost::shared_ptr<Outbound> OutboundPtr;
+
+    struct Inbound {
+
+        topic_tools::ShapeShifter msg;
+
+        ros::Publisher pub;
+
+    };
+
+    typedef boost::shared_ptr<Inbound> InboundPtr;
+
+    void _on_message(
+        const std::string& topic,
+        const topic_tools::ShapeShifter::ConstPtr& msg);
+
+    bool _announce(
+        const std::string& topic,
+        const Outbound& outbound,
+        const topic_tools::ShapeShifter& msg);
+
+    InboundPtr _advertise(const BridgeFrame& frame);
+
+    bool _mux;
+
+    ros::NodeHandle _nh;
+
+    std::string _ns;
+
+    std::string _label;
+
+    Send _send;
+
+    uint32_t _queue_size;
+
+    rtc::CriticalSection _outbound_cs; /*! Never held while sending. */
+
+    std::map<std::string, OutboundPtr> _outbound;
+
+    uint32_t _next_id;
+
+    rtc::CriticalSection _inbound_cs;
+
+    std::map<std::string, InboundPtr> _inbound;
+
+    std::map<uint16_t, InboundPtr> _inbound_ids;
+
+};
+
+typedef boost::shared_ptr<TopicBridge> TopicBridgePtr;
+
+#endif /* ROS_WEBRTC_BRIDGE_H_ */
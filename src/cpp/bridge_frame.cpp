@@ -0,0 +1,120 @@
+#include "bridge_frame.h"
+
+#include <cstring>
+
+static uint8_t* put_uint(uint8_t* dst, uint32_t value, size_t width) {
+    for (size_t i = 0; i != width; i++) {
+        dst[i] = static_cast<uint8_t>(value >> (8 * i));
+    }
+    return dst + width;
+}
+
+static uint8_t* put_string(uint8_t* dst, const std::string& value, size_t width) {
+    dst = put_uint(dst, value.size(), width);
+    std::memcpy(dst, value.data(), value.size());
+    return dst + value.size();
+}
+
+static bool get_uint(const uint8_t*& src, const uint8_t* end, uint32_t& value, size_t width) {
+    if (static_cast<size_t>(end - src) < width)
+        return false;
+    value = 0;
+    for (size_t i = 0; i != width; i++) {
+        value |= static_cast<uint32_t>(src[i]) << (8 * i);
+    }
+    src += width;
+    return true;
+}
+
+static bool get_string(const uint8_t*& src, const uint8_t* end, std::string& value, size_t width) {
+    uint32_t size;
+    if (!get_uint(src, end, size, width) || static_cast<size_t>(end - src) < size)
+        return false;
+    value.assign(reinterpret_cast<const char *>(src), size);
+    src += size;
+    return true;
+}
+
+BridgeFrame::BridgeFrame() :
+    version(VERSION),
+    flags(0),
+    kind(Message),
+    id(0),
+    payload(NULL),
+    payload_size(0) {
+}
+
+bool BridgeFrame::is_mux() const {
+    return version == MUX_VERSION;
+}
+
+size_t BridgeFrame::header_size() const {
+    if (is_mux() && kind == Message)
+        return 4;
+    size_t size = (is_mux() ? 4 : 2) + 2 + topic.size() + 2 + datatype.size() + 2 + md5sum.size();
+    if (has_definition())
+        size += 4 + definition.size();
+    return size;
+}
+
+size_t BridgeFrame::encode_header(uint8_t* dst) const {
+    uint8_t* begin = dst;
+    *dst++ = version;
+    if (is_mux()) {
+        *dst++ = kind;
+        dst = put_uint(dst, id, 2);
+        if (kind == Message)
+            return dst - begin;
+    } else {
+        *dst++ = flags;
+    }
+    dst = put_string(dst, topic, 2);
+    dst = put_string(dst, datatype, 2);
+    dst = put_string(dst, md5sum, 2);
+    if (has_definition())
+        dst = put_string(dst, definition, 4);
+    return dst - begin;
+}
+
+bool BridgeFrame::decode(const uint8_t* src, size_t size) {
+    const uint8_t* end = src + size;
+    if (size < 2 || (src[0] != VERSION && src[0] != MUX_VERSION))
+        return false;
+    version = src[0];
+    if (is_mux()) {
+        uint32_t value;
+        if (src[1] != Message && src[1] != Announce)
+            return false;
+        kind = static_cast<Kind>(src[1]);
+        src += 2;
+        if (!get_uint(src, end, value, 2))
+            return false;
+        id = value;
+        if (kind == Message) {
+            payload = src;
+            payload_size = end - src;
+            return true;
+        }
+        flags = HasDefinition;
+    } else {
+        flags = src[1];
+        src += 2;
+    }
+    if (!get_string(src, end, topic, 2) ||
+        !get_string(src, end, datatype, 2) ||
+        !get_string(src, end, md5sum, 2)) {
+        return false;
+    }
+    definition.clear();
+    if (has_definition() && !get_string(src, end, definition, 4))
+        return false;
+    payload = src;
+    payload_size = end - src;
+    return !topic.empty() && !datatype.empty() && !md5sum.empty();
+}
+
+bool BridgeFrame::has_definition() const {
+    if (is_mux())
+        return kind == Announce;
+    return (flags & HasDefinition) != 0;
+}
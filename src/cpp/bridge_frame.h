@@ -0,0 +1,99 @@
+#ifndef ROS_WEBRTC_BRIDGE_FRAME_H_
+#define ROS_WEBRTC_BRIDGE_FRAME_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+/**
+ * \brief A serialized ROS message bridged over a data channel.
+ *
+ * Frames are a small header followed by the message exactly as ROS
+ * serialized it, so neither side has to deserialize the message itself:
+ *
+ *  uint8  version
+ *  uint8  flags
+ *  uint16 topic length, topic
+ *  uint16 datatype length, datatype
+ *  uint16 md5sum length, md5sum
+ *  uint32 definition length, definition (only if HasDefinition)
+ *  payload (rest of frame)
+ *
+ * Multiplexed frames instead identify their topic by a 16 bit id, which is
+ * bound to the topic by an announce frame sent before its first message:
+ *
+ *  uint8  version (MUX_VERSION)
+ *  uint8  kind
+ *  uint16 id
+ *  topic, datatype, md5sum and definition as above (only if Announce)
+ *  payload (rest of frame, only if Message)
+ *
+ * Integers are little-endian.
+ */
+struct BridgeFrame {
+
+    static const uint8_t VERSION = 1;
+
+    static const uint8_t MUX_VERSION = 2;
+
+    enum Flags {
+        HasDefinition = 1 << 0,
+    };
+
+    enum Kind {
+        Message = 0,
+        Announce = 1,
+    };
+
+    BridgeFrame();
+
+    /**
+     * \brief Whether this is a multiplexed frame.
+     */
+    bool is_mux() const;
+
+    /**
+     * \brief Number of header bytes encode_header will write.
+     */
+    size_t header_size() const;
+
+    /**
+     * \brief Writes header to dst, which must hold at least header_size() bytes.
+     * \return Number of bytes written.
+     */
+    size_t encode_header(uint8_t* dst) const;
+
+    /**
+     * \brief Parses a frame, pointing payload into src rather than copying it.
+     * \param src Frame bytes, which must outlive the decoded payload.
+     * \param size Number of frame bytes.
+     * \return Whether the frame was well formed.
+     */
+    bool decode(const uint8_t* src, size_t size);
+
+    bool has_definition() const;
+
+    uint8_t version;
+
+    uint8_t flags; /*! Only for VERSION. */
+
+    Kind kind; /*! Only for MUX_VERSION. */
+
+    uint16_t id; /*! Only for MUX_VERSION. */
+
+    std::string topic;
+
+    std::string datatype;
+
+    std::string md5sum;
+
+    std::string definition;
+
+    const uint8_t* payload;
+
+    size_t payload_size;
+
+};
+
+#endif /* ROS_WEBRTC_BRIDGE_FRAME_H_ */
@@ -0,0 +1,119 @@
+#include "callback_dispatcher.h"
+
+#include <algorithm>
+
+#include <ros_webrtc/CallbackLatency.h>
+
+// CallbackDispatcher::Strand
+
+CallbackDispatcher::Strand::Strand() : busy(false) {
+}
+
+// CallbackDispatcher
+
+CallbackDispatcher::CallbackDispatcher(ros::NodeHandle& nh, size_t threads, double timeout) :
+    _timeout(timeout),
+    _stopping(false),
+    _latency(Histogram::latency_bounds()),
+    _delivered(0),
+    _failed(0),
+    _expired(0),
+    _pub(nh.advertise<ros_webrtc::CallbackLatency>("callback_latency", 1, true)) {
+    for (size_t i = 0; i != std::max<size_t>(1, threads); i++)
+        _threads.push_back(std::thread(&CallbackDispatcher::_run, this));
+}
+
+CallbackDispatcher::~CallbackDispatcher() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _ready_cond.notify_all();
+    for (auto i = _threads.begin(); i != _threads.end(); i++)
+        (*i).join();
+}
+
+void CallbackDispatcher::dispatch(const std::string& key, const std::string& name, const Callback& callback) {
+    Item item;
+    item.name = name;
+    item.callback = callback;
+    item.queued_at = ros::WallTime::now();
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_stopping)
+            return;
+        Strand& strand = _strands[key];
+        strand.items.push_back(item);
+        if (strand.busy || strand.items.size() != 1)
+            return;  // already ready, or will be once delivered
+        _ready.push_back(key);
+    }
+    _ready_cond.notify_one();
+}
+
+void CallbackDispatcher::publish() {
+    ros_webrtc::CallbackLatency msg;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        msg.bounds = _latency.bounds();
+        msg.counts = _latency.counts();
+        msg.p50 = _latency.quantile(0.5);
+        msg.p99 = _latency.quantile(0.99);
+        msg.max = _latency.max();
+        msg.delivered = _delivered;
+        msg.failed = _failed;
+        msg.expired = _expired;
+        msg.pending = 0;
+        for (auto i = _strands.begin(); i != _strands.end(); i++)
+            msg.pending += (*i).second.items.size();
+    }
+    _pub.publish(msg);
+}
+
+void CallbackDispatcher::_run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _ready_cond.wait(lock, [this]() { return _stopping || !_ready.empty(); });
+        if (_stopping)
+            return;
+        std::string key = _ready.front();
+        _ready.pop_front();
+        Strand& strand = _strands[key];
+        Item item = strand.items.front();
+        strand.items.pop_front();
+        strand.busy = true;
+        lock.unlock();
+
+        // stale state changes and candidates are of no use, the event topics still have them
+        double waited = (ros::WallTime::now() - item.queued_at).toSec();
+        bool expired = _timeout != 0 && waited > _timeout;
+        bool delivered = false;
+        if (expired) {
+            ROS_WARN_STREAM(
+                "callback " << item.name << " dropped after being queued " <<
+                waited << " sec(s)"
+            );
+        } else {
+            delivered = item.callback();
+            if (!delivered)
+                ROS_WARN_STREAM("callback " << item.name << " failed");
+        }
+        double latency = (ros::WallTime::now() - item.queued_at).toSec();
+
+        lock.lock();
+        if (expired) {
+            _expired++;
+        } else if (delivered) {
+            _delivered++;
+            _latency.add(latency);
+        } else {
+            _failed++;
+        }
+        Strand& next = _strands[key];
+        next.busy = false;
+        if (next.items.empty())
+            _strands.erase(key);
+        else
+            _ready.push_back(key);
+    }
+}
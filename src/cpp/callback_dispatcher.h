@@ -0,0 +1,110 @@
+#ifndef ROS_WEBRTC_CALLBACK_DISPATCHER_H_
+#define ROS_WEBRTC_CALLBACK_DISPATCHER_H_
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <ros/ros.h>
+
+#include "histogram.h"
+
+/**
+ * \brief Delivers peer connection callbacks to the application off WebRTC threads.
+ *
+ * Callbacks are ROS service calls, which block until the application
+ * answers. They are queued per peer connection and delivered by a pool of
+ * threads, so callbacks for a peer connection arrive in order while a slow
+ * or dead application node only holds up its own.
+ */
+class CallbackDispatcher {
+
+public:
+
+    /**
+     * \brief Makes the call.
+     * \return Whether it was delivered.
+     */
+    typedef boost::function<bool ()> Callback;
+
+    /**
+     * \param nh Node handle used to advertise the callback_latency topic.
+     * \param threads Number of delivery threads.
+     * \param timeout Callbacks still queued after this many seconds are dropped, or 0 to never drop.
+     */
+    CallbackDispatcher(ros::NodeHandle& nh, size_t threads, double timeout);
+
+    ~CallbackDispatcher();
+
+    /**
+     * \brief Queues a callback.
+     * \param key Identifies the peer connection, callbacks w/ the same key are delivered in order.
+     * \param name Name of the callback, for logging.
+     * \param callback Makes the call.
+     */
+    void dispatch(const std::string& key, const std::string& name, const Callback& callback);
+
+    /**
+     * \brief Publishes delivery latency and counts.
+     */
+    void publish();
+
+private:
+
+    struct Item {
+
+        std::string name;
+
+        Callback callback;
+
+        ros::WallTime queued_at;
+
+    };
+
+    struct Strand {
+
+        Strand();
+
+        std::deque<Item> items;
+
+        bool busy; /*! Whether a thread is delivering one of its items. */
+
+    };
+
+    void _run();
+
+    double _timeout;
+
+    std::mutex _mutex;
+
+    std::condition_variable _ready_cond;
+
+    std::map<std::string, Strand> _strands;
+
+    std::deque<std::string> _ready; /*! Keys of strands w/ items and no thread delivering them. */
+
+    bool _stopping;
+
+    std::vector<std::thread> _threads;
+
+    Histogram _latency; /*! Seconds from queued to delivered. */
+
+    uint64_t _delivered;
+
+    uint64_t _failed;
+
+    uint64_t _expired;
+
+    ros::Publisher _pub;
+
+};
+
+typedef boost::shared_ptr<CallbackDispatcher> CallbackDispatcherPtr;
+
+#endif /* ROS_WEBRTC_CALLBACK_DISPATCHER_H_ */
@@ -0,0 +1,201 @@
+#include "certificate_store.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+
+#include <ros/ros.h>
+#include <webrtc/base/sslidentity.h>
+
+namespace {
+
+const char CERTIFICATE_BEGIN[] = "-----BEGIN CERTIFICATE-----";
+
+// RTCCertificate::Expires() is in ms since the epoch
+uint64_t now_ms() {
+    return static_cast<uint64_t>(time(NULL)) * 1000;
+}
+
+bool read_file(const std::string& path, std::string& contents) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    contents.clear();
+    char buffer[4096];
+    ssize_t n;
+    while ((n = read(fd, buffer, sizeof(buffer))) > 0)
+        contents.append(buffer, n);
+    close(fd);
+    return n == 0;
+}
+
+bool write_file(const std::string& path, const std::string& contents) {
+    // write aside then rename so a crash never leaves a torn key behind
+    std::string tmp_path = path + ".tmp";
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return false;
+    size_t done = 0;
+    while (done != contents.size()) {
+        ssize_t n = write(fd, contents.data() + done, contents.size() - done);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        done += n;
+    }
+    bool ok = close(fd) == 0 && done == contents.size();
+    if (ok)
+        ok = rename(tmp_path.c_str(), path.c_str()) == 0;
+    if (!ok)
+        unlink(tmp_path.c_str());
+    return ok;
+}
+
+}
+
+// CertificateSettings
+
+CertificateSettings::CertificateSettings() :
+    count(4),
+    lifetime(30 * 24 * 60 * 60),
+    rotation(24 * 60 * 60) {
+}
+
+// CertificateStore
+
+CertificateStore::CertificateStore(const CertificateSettings& settings) :
+    _settings(settings),
+    _next(0) {
+}
+
+bool CertificateStore::open() {
+    Certificates certificates;
+    uint64_t now = now_ms();
+    for (size_t i = 0; i != _settings.count; i++) {
+        rtc::scoped_refptr<rtc::RTCCertificate> certificate = _load(i);
+        if (certificate != NULL && !_is_current(certificate, now))
+            certificate = NULL;
+        if (certificate == NULL) {
+            certificate = _generate();
+            if (certificate == NULL)
+                continue;
+            _save(i, certificate);
+        }
+        certificates.push_back(certificate);
+    }
+    ROS_INFO_STREAM("dtls certificates - " << certificates.size() << " of " << _settings.count);
+    std::lock_guard<std::mutex> lock(_mutex);
+    _certificates.swap(certificates);
+    return !_certificates.empty();
+}
+
+CertificateStore::Certificates CertificateStore::next() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Certificates certificates;
+    if (!_certificates.empty()) {
+        // webrtc only uses the first
+        certificates.push_back(_certificates[_next % _certificates.size()]);
+        _next++;
+    }
+    return certificates;
+}
+
+size_t CertificateStore::rotate() {
+    uint64_t now = now_ms();
+    std::vector<size_t> stale;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (size_t i = 0; i != _certificates.size(); i++) {
+            if (!_is_current(_certificates[i], now))
+                stale.push_back(i);
+        }
+    }
+
+    // generated outside the lock, peer connections being set up keep using the old ones meanwhile
+    size_t rotated = 0;
+    for (auto i = stale.begin(); i != stale.end(); i++) {
+        rtc::scoped_refptr<rtc::RTCCertificate> certificate = _generate();
+        if (certificate == NULL)
+            continue;
+        _save(*i, certificate);
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (*i < _certificates.size()) {
+            _certificates[*i] = certificate;
+            rotated++;
+        }
+    }
+    if (rotated != 0)
+        ROS_INFO_STREAM("dtls certificates - rotated " << rotated);
+    return rotated;
+}
+
+size_t CertificateStore::size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _certificates.size();
+}
+
+rtc::scoped_refptr<rtc::RTCCertificate> CertificateStore::_generate() const {
+    std::unique_ptr<rtc::SSLIdentity> identity(rtc::SSLIdentity::GenerateWithExpiration(
+        "ros_webrtc",
+        rtc::KeyParams::ECDSA(rtc::EC_NIST_P256),
+        static_cast<time_t>(_settings.lifetime)
+    ));
+    if (identity == NULL) {
+        ROS_WARN_STREAM("dtls certificate generation failed");
+        return NULL;
+    }
+    return rtc::RTCCertificate::Create(std::move(identity));
+}
+
+bool CertificateStore::_is_current(const rtc::scoped_refptr<rtc::RTCCertificate>& certificate, uint64_t now) const {
+    // age assumes it was made w/ the current lifetime
+    uint64_t expires = certificate->Expires();
+    if (expires <= now)
+        return false;
+    double age = _settings.lifetime - (expires - now) / 1000.0;
+    return age < _settings.rotation;
+}
+
+std::string CertificateStore::_path(size_t index) const {
+    return _settings.directory + "/dtls-" + std::to_string(index) + ".pem";
+}
+
+rtc::scoped_refptr<rtc::RTCCertificate> CertificateStore::_load(size_t index) const {
+    if (_settings.directory.empty())
+        return NULL;
+    std::string pem;
+    if (!read_file(_path(index), pem))
+        return NULL;
+    // private key followed by certificate, see _save
+    size_t split = pem.find(CERTIFICATE_BEGIN);
+    if (split == std::string::npos) {
+        ROS_WARN_STREAM("dtls certificate '" << _path(index) << "' has no certificate");
+        return NULL;
+    }
+    rtc::scoped_refptr<rtc::RTCCertificate> certificate = rtc::RTCCertificate::FromPEM(
+        rtc::RTCCertificatePEM(pem.substr(0, split), pem.substr(split))
+    );
+    if (certificate == NULL)
+        ROS_WARN_STREAM("dtls certificate '" << _path(index) << "' invalid");
+    return certificate;
+}
+
+bool CertificateStore::_save(size_t index, const rtc::scoped_refptr<rtc::RTCCertificate>& certificate) const {
+    if (_settings.directory.empty())
+        return true;
+    rtc::RTCCertificatePEM pem = certificate->ToPEM();
+    if (!write_file(_path(index), pem.private_key() + pem.certificate())) {
+        ROS_WARN_STREAM(
+            "dtls certificate '" << _path(index) << "' save failed - " << strerror(errno)
+        );
+        return false;
+    }
+    return true;
+}
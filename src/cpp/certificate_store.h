@@ -0,0 +1,86 @@
+#ifndef ROS_WEBRTC_CERTIFICATE_STORE_H_
+#define ROS_WEBRTC_CERTIFICATE_STORE_H_
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <webrtc/base/rtccertificate.h>
+#include <webrtc/base/scoped_ref_ptr.h>
+
+/**
+ * \brief Settings for the DTLS certificates shared by peer connections.
+ */
+struct CertificateSettings {
+
+    CertificateSettings();
+
+    size_t count; /*! Certificates to keep, or 0 to have each peer connection generate its own. */
+
+    double lifetime; /*! Seconds each is valid for. */
+
+    double rotation; /*! Seconds after which each is replaced, should be well short of lifetime. */
+
+    std::string directory; /*! Persist them here so restarts reuse them, or empty to not persist. */
+
+};
+
+/**
+ * \brief ECDSA DTLS certificates generated (or loaded) once and shared across peer connections.
+ *
+ * Otherwise every peer connection generates its own identity while it's
+ * being set up, which is noticeable on slower (e.g. ARM) hosts.
+ */
+class CertificateStore {
+
+public:
+
+    typedef std::vector<rtc::scoped_refptr<rtc::RTCCertificate>> Certificates;
+
+    CertificateStore(const CertificateSettings& settings);
+
+    /**
+     * \brief Loads persisted certificates that are still current, and generates the rest.
+     * \return Whether there are any.
+     */
+    bool open();
+
+    /**
+     * \brief Certificates for the next peer connection, which are handed out in turn.
+     */
+    Certificates next();
+
+    /**
+     * \brief Replaces certificates older than the rotation period.
+     * \return Number replaced.
+     */
+    size_t rotate();
+
+    size_t size() const;
+
+private:
+
+    rtc::scoped_refptr<rtc::RTCCertificate> _generate() const;
+
+    bool _is_current(const rtc::scoped_refptr<rtc::RTCCertificate>& certificate, uint64_t now) const;
+
+    std::string _path(size_t index) const;
+
+    rtc::scoped_refptr<rtc::RTCCertificate> _load(size_t index) const;
+
+    bool _save(size_t index, const rtc::scoped_refptr<rtc::RTCCertificate>& certificate) const;
+
+    CertificateSettings _settings;
+
+    mutable std::mutex _mutex;
+
+    Certificates _certificates;
+
+    size_t _next;
+
+};
+
+typedef boost::shared_ptr<CertificateStore> CertificateStorePtr;
+
+#endif /* ROS_WEBRTC_CERTIFICATE_STORE_H_ */
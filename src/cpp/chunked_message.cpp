@@ -0,0 +1,195 @@
+#include "chunked_message.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+
+ChunkedMessage::ChunkedMessage(
+    const std::string& id,
+    size_t total,
+    size_t chunk_size,
+    const std::string& path) :
+    _id(id),
+    _total(total),
+    _chunk_size(chunk_size),
+    _count(0),
+    _length(total * chunk_size),
+    _received(total, false),
+    _buffer(path.empty() ? total * chunk_size : 0),
+    _spilled(!path.empty()),
+    _fd(-1) {
+    if (!_spilled)
+        return;
+    _fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (_fd < 0)
+        return;
+    _path = path;
+    // sparse, so only what is received takes up disk
+    if (ftruncate(_fd, _length) != 0) {
+        close(_fd);
+        _fd = -1;
+        unlink(_path.c_str());
+        _path.clear();
+    }
+}
+
+ChunkedMessage::~ChunkedMessage() {
+    if (_fd >= 0)
+        close(_fd);
+    if (!_path.empty())
+        unlink(_path.c_str());
+}
+
+ChunkedMessage::Result ChunkedMessage::add_chunk(
+        size_t index,
+        const uint8_t* data,
+        size_t size) {
+    if (index >= _total) {
+        return OutOfRange;
+    }
+    if (_received[index]) {
+        return Duplicate;
+    }
+    bool is_last = index == _total - 1;
+    if (size > _chunk_size || (!is_last && size != _chunk_size)) {
+        return Malformed;
+    }
+    if (_spilled) {
+        if (_fd < 0)
+            return WriteFailed;
+        size_t done = 0;
+        while (done != size) {
+            ssize_t n = pwrite(_fd, data + done, size - done, index * _chunk_size + done);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return WriteFailed;
+            done += n;
+        }
+    } else if (size != 0) {
+        std::memcpy(&_buffer[index * _chunk_size], data, size);
+    }
+    if (is_last) {
+        _length = index * _chunk_size + size;
+    }
+    _received[index] = true;
+    _count += 1;
+    if (!is_complete())
+        return Added;
+    if (_spilled) {
+        bool ok = ftruncate(_fd, _length) == 0;
+        ok = close(_fd) == 0 && ok;
+        _fd = -1;
+        if (!ok) {
+            unlink(_path.c_str());
+            _path.clear();
+            return WriteFailed;
+        }
+    }
+    return Completed;
+}
+
+bool ChunkedMessage::is_complete() const {
+    return _count == _total;
+}
+
+bool ChunkedMessage::has_chunk(size_t index) const {
+    return index < _total && _received[index];
+}
+
+void ChunkedMessage::received(Ranges& ranges) const {
+    ranges.clear();
+    for (size_t i = 0; i != _total; i++) {
+        if (!_received[i])
+            continue;
+        if (!ranges.empty() && ranges.back().second == i)
+            ranges.back().second = i + 1;
+        else
+            ranges.push_back(std::make_pair(i, i + 1));
+    }
+}
+
+const std::string& ChunkedMessage::id() const {
+    return _id;
+}
+
+size_t ChunkedMessage::total() const {
+    return _total;
+}
+
+size_t ChunkedMessage::count() const {
+    return _count;
+}
+
+size_t ChunkedMessage::capacity() const {
+    return _spilled ? _total * _chunk_size : _buffer.size();
+}
+
+size_t ChunkedMessage::memory(size_t total, size_t chunk_size, bool spilled) {
+    return (total + 7) / 8 + (spilled ? 0 : total * chunk_size);
+}
+
+size_t ChunkedMessage::memory() const {
+    return memory(_total, _chunk_size, _spilled);
+}
+
+size_t ChunkedMessage::size() const {
+    return _length;
+}
+
+bool ChunkedMessage::is_spilled() const {
+    return _spilled;
+}
+
+bool ChunkedMessage::is_open() const {
+    return !_spilled || !_path.empty();
+}
+
+const std::string& ChunkedMessage::path() const {
+    return _path;
+}
+
+void ChunkedMessage::release(std::vector<uint8_t>& dst) {
+    _buffer.resize(_length);  // only ever shrinks, so no reallocation
+    dst.swap(_buffer);
+    _buffer.clear();
+}
+
+bool ChunkedMessage::release(std::string& path) {
+    if (!_spilled || !is_complete() || _path.empty())
+        return false;
+    path.swap(_path);
+    _path.clear();
+    return true;
+}
+
+// ChunkedMessageBudget
+
+ChunkedMessageBudget::ChunkedMessageBudget(size_t limit) :
+    _limit(limit),
+    _used(0) {
+}
+
+bool ChunkedMessageBudget::reserve(size_t bytes) {
+    size_t used = _used.load();
+    do {
+        if (_limit != 0 && (bytes > _limit || used > _limit - bytes)) {
+            return false;
+        }
+    } while (!_used.compare_exchange_weak(used, used + bytes));
+    return true;
+}
+
+void ChunkedMessageBudget::release(size_t bytes) {
+    _used -= bytes;
+}
+
+size_t ChunkedMessageBudget::used() const {
+    return _used.load();
+}
+
+size_t ChunkedMessageBudget::limit() const {
+    return _limit;
+}
@@ -0,0 +1,192 @@
+#ifndef ROS_WEBRTC_CHUNKED_MESSAGE_H_
+#define ROS_WEBRTC_CHUNKED_MESSAGE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+/**
+ * \brief Reassembles a message from fixed size chunks received in any order.
+ *
+ * The message buffer is allocated up front as total * chunk_size and each
+ * chunk is copied straight to its offset, so adding a chunk is O(1) and the
+ * completed buffer can be released without another copy.
+ *
+ * Large messages can instead be spilled to a file, which is created sparse
+ * and written at the same offsets, so they never have to fit in memory.
+ */
+class ChunkedMessage {
+
+public:
+
+    /**
+     * \brief Half-open [first, last) ranges of chunk indices.
+     */
+    typedef std::vector<std::pair<size_t, size_t> > Ranges;
+
+    enum Result {
+        Added = 0,
+        Completed,
+        Duplicate,
+        OutOfRange,
+        Malformed,
+        WriteFailed,
+    };
+
+    /**
+     * \brief Allocates a message.
+     * \param id String identifying the message.
+     * \param total Number of chunks in the message.
+     * \param chunk_size Size of every chunk but the last, which may be shorter.
+     * \param path If not empty, file to spill chunks to instead of memory.
+     */
+    ChunkedMessage(
+        const std::string& id,
+        size_t total,
+        size_t chunk_size,
+        const std::string& path=std::string());
+
+    /**
+     * \brief Removes the spill file, unless released.
+     */
+    ~ChunkedMessage();
+
+    /**
+     * \brief Copies a chunk into the message.
+     * \param index Index of the chunk.
+     * \param data Chunk bytes.
+     * \param size Number of chunk bytes.
+     * \return Completed if this was the last missing chunk, Added if not, or why it was rejected.
+     */
+    Result add_chunk(size_t index, const uint8_t* data, size_t size);
+
+    bool is_complete() const;
+
+    bool has_chunk(size_t index) const;
+
+    /**
+     * \brief Gets the chunks received so far, as ranges.
+     */
+    void received(Ranges& ranges) const;
+
+    const std::string& id() const;
+
+    size_t total() const;
+
+    size_t count() const;
+
+    /**
+     * \brief Number of bytes allocated for the message, in memory or on disk.
+     */
+    size_t capacity() const;
+
+    /**
+     * \brief Number of bytes of memory a message would allocate.
+     *
+     * Includes the record of which chunks were received, so spilled messages
+     * take up memory too.
+     */
+    static size_t memory(size_t total, size_t chunk_size, bool spilled);
+
+    size_t memory() const;
+
+    /**
+     * \brief Number of message bytes, once complete.
+     */
+    size_t size() const;
+
+    /**
+     * \brief Whether chunks are written to a file.
+     */
+    bool is_spilled() const;
+
+    /**
+     * \brief Whether the spill file is usable, or true if not spilling.
+     */
+    bool is_open() const;
+
+    const std::string& path() const;
+
+    /**
+     * \brief Moves the reassembled bytes of a completed message to dst.
+     * \param dst Receives the message bytes.
+     */
+    void release(std::vector<uint8_t>& dst);
+
+    /**
+     * \brief Hands the spill file of a completed message to the caller, who must remove it.
+     * \param path Receives the path of the file.
+     * \return Whether the message was spilled and complete.
+     */
+    bool release(std::string& path);
+
+private:
+
+    ChunkedMessage(const ChunkedMessage&);
+
+    ChunkedMessage& operator=(const ChunkedMessage&);
+
+    std::string _id;
+
+    size_t _total;
+
+    size_t _chunk_size;
+
+    size_t _count;
+
+    size_t _length;
+
+    std::vector<bool> _received;
+
+    std::vector<uint8_t> _buffer;
+
+    bool _spilled;
+
+    std::string _path; /*! Spill file, while owned. */
+
+    int _fd;
+
+};
+
+/**
+ * \brief Byte budget shared by everything reassembling chunked messages.
+ */
+class ChunkedMessageBudget {
+
+public:
+
+    /**
+     * \param limit Maximum number of bytes that can be reserved, or 0 for no limit.
+     */
+    ChunkedMessageBudget(size_t limit=0);
+
+    /**
+     * \brief Reserves bytes if that would not exceed the limit.
+     * \return Whether the bytes were reserved.
+     */
+    bool reserve(size_t bytes);
+
+    void release(size_t bytes);
+
+    size_t used() const;
+
+    size_t limit() const;
+
+private:
+
+    const size_t _limit;
+
+    std::atomic<size_t> _used;
+
+};
+
+typedef boost::shared_ptr<ChunkedMessage> ChunkedMessagePtr;
+
+typedef boost::shared_ptr<ChunkedMessageBudget> ChunkedMessageBudgetPtr;
+
+#endif /* ROS_WEBRTC_CHUNKED_MESSAGE_H_ */
@@ -0,0 +1,72 @@
+#include "coalesced_frame.h"
+
+static size_t varint_size(uint64_t value) {
+    size_t size = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+size_t CoalescedFrame::record_size(size_t size) {
+    return varint_size(static_cast<uint64_t>(size) << 1) + size;
+}
+
+bool CoalescedFrame::parse(const uint8_t* src, size_t size, std::vector<Record>& records) {
+    const uint8_t* end = src + size;
+    while (src != end) {
+        uint64_t header = 0;
+        size_t shift = 0;
+        while (true) {
+            if (src == end || shift > 63)
+                return false;
+            uint8_t byte = *src++;
+            header |= static_cast<uint64_t>(byte & 0x7f) << shift;
+            shift += 7;
+            if ((byte & 0x80) == 0)
+                break;
+        }
+        Record record;
+        record.binary = (header & 1) != 0;
+        record.size = header >> 1;
+        if (record.size > static_cast<size_t>(end - src))
+            return false;
+        record.data = src;
+        src += record.size;
+        records.push_back(record);
+    }
+    return true;
+}
+
+CoalescedFrame::CoalescedFrame() : _count(0) {
+}
+
+void CoalescedFrame::append(const uint8_t* data, size_t size, bool binary) {
+    uint64_t header = (static_cast<uint64_t>(size) << 1) | (binary ? 1 : 0);
+    while (header >= 0x80) {
+        _buffer.push_back(static_cast<uint8_t>(header) | 0x80);
+        header >>= 7;
+    }
+    _buffer.push_back(static_cast<uint8_t>(header));
+    _buffer.insert(_buffer.end(), data, data + size);
+    _count += 1;
+}
+
+bool CoalescedFrame::empty() const {
+    return _count == 0;
+}
+
+size_t CoalescedFrame::size() const {
+    return _buffer.size();
+}
+
+size_t CoalescedFrame::count() const {
+    return _count;
+}
+
+void CoalescedFrame::release(std::vector<uint8_t>& dst) {
+    dst.swap(_buffer);
+    _buffer.clear();
+    _count = 0;
+}
@@ -0,0 +1,74 @@
+#ifndef ROS_WEBRTC_COALESCED_FRAME_H_
+#define ROS_WEBRTC_COALESCED_FRAME_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * \brief Packs small messages into one data channel message.
+ *
+ * A frame is a sequence of records, each a varint (LEB128) of the message
+ * size shifted left by one, with the low bit set if the message is binary,
+ * followed by the message bytes.
+ */
+class CoalescedFrame {
+
+public:
+
+    struct Record {
+
+        const uint8_t* data;
+
+        size_t size;
+
+        bool binary;
+
+    };
+
+    /**
+     * \brief Number of frame bytes used by a message.
+     * \param size Number of message bytes.
+     */
+    static size_t record_size(size_t size);
+
+    /**
+     * \brief Splits a frame into its messages, which point into src.
+     * \param src Frame bytes.
+     * \param size Number of frame bytes.
+     * \param records Receives the messages, in the order they were appended.
+     * \return Whether the frame was well formed.
+     */
+    static bool parse(const uint8_t* src, size_t size, std::vector<Record>& records);
+
+    CoalescedFrame();
+
+    void append(const uint8_t* data, size_t size, bool binary);
+
+    bool empty() const;
+
+    /**
+     * \brief Number of frame bytes.
+     */
+    size_t size() const;
+
+    /**
+     * \brief Number of messages in the frame.
+     */
+    size_t count() const;
+
+    /**
+     * \brief Moves the frame bytes to dst and resets the frame.
+     */
+    void release(std::vector<uint8_t>& dst);
+
+private:
+
+    std::vector<uint8_t> _buffer;
+
+    size_t _count;
+
+};
+
+#endif /* ROS_WEBRTC_COALESCED_FRAME_H_ */
@@ -0,0 +1,164 @@
+#include "compression.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include <lz4.h>
+#include <zstd.h>
+
+static const uint8_t BINARY_FLAG = 0x80;
+
+static void put_header(uint8_t* dst, Compression::Algorithm algorithm, bool binary, uint32_t size) {
+    dst[0] = static_cast<uint8_t>(algorithm) | (binary ? BINARY_FLAG : 0);
+    for (size_t i = 0; i != 4; i++) {
+        dst[1 + i] = static_cast<uint8_t>(size >> (8 * i));
+    }
+}
+
+bool Compression::matches(const MediaType& media_type) {
+    return media_type.params.find("compress") != media_type.params.end();
+}
+
+Compression::Compression(const MediaType& media_type, size_t max_size) {
+    Algorithm algorithm = None;
+    int level = 0;
+    size_t threshold = DEFAULT_THRESHOLD;
+    auto i = media_type.params.find("compress");
+    if (i != media_type.params.end()) {
+        if ((*i).second == "lz4")
+            algorithm = LZ4;
+        else if ((*i).second == "zstd")
+            algorithm = Zstd;
+    }
+    i = media_type.params.find("level");
+    if (i != media_type.params.end())
+        level = std::atoi((*i).second.c_str());
+    i = media_type.params.find("compressmin");
+    if (i != media_type.params.end())
+        threshold = std::atoi((*i).second.c_str());
+    _init(algorithm, level, threshold, max_size);
+}
+
+Compression::Compression(Algorithm algorithm, int level, size_t threshold, size_t max_size) {
+    _init(algorithm, level, threshold, max_size);
+}
+
+Compression::~Compression() {
+    if (_zstd_cctx != NULL)
+        ZSTD_freeCCtx(_zstd_cctx);
+    if (_zstd_dctx != NULL)
+        ZSTD_freeDCtx(_zstd_dctx);
+}
+
+void Compression::_init(Algorithm algorithm, int level, size_t threshold, size_t max_size) {
+    _algorithm = algorithm;
+    _level = level;
+    _threshold = threshold;
+    // peers name the size to allocate, so there is always a limit
+    _max_size = max_size == 0 || max_size > MAX_SIZE ? MAX_SIZE : max_size;
+    _zstd_cctx = NULL;
+    _zstd_dctx = NULL;
+}
+
+Compression::Algorithm Compression::algorithm() const {
+    return _algorithm;
+}
+
+bool Compression::compress(const uint8_t* src, size_t size, bool binary, std::vector<uint8_t>& dst) {
+    Algorithm algorithm = _algorithm;
+    if (size < _threshold || size > static_cast<size_t>(std::numeric_limits<int>::max()))
+        algorithm = None;
+
+    size_t compressed = 0;
+    switch (algorithm) {
+        case LZ4: {
+            if (_lz4_state.empty())
+                _lz4_state.resize(LZ4_sizeofState());
+            dst.resize(HEADER_SIZE + LZ4_compressBound(size));
+            int rc = LZ4_compress_fast_extState(
+                &_lz4_state[0],
+                reinterpret_cast<const char *>(src),
+                reinterpret_cast<char *>(&dst[HEADER_SIZE]),
+                size,
+                dst.size() - HEADER_SIZE,
+                1
+            );
+            compressed = rc > 0 ? rc : 0;
+            break;
+        }
+        case Zstd: {
+            if (_zstd_cctx == NULL)
+                _zstd_cctx = ZSTD_createCCtx();
+            dst.resize(HEADER_SIZE + ZSTD_compressBound(size));
+            size_t rc = ZSTD_compressCCtx(
+                _zstd_cctx,
+                &dst[HEADER_SIZE],
+                dst.size() - HEADER_SIZE,
+                src,
+                size,
+                _level
+            );
+            compressed = ZSTD_isError(rc) ? 0 : rc;
+            break;
+        }
+        default:
+            break;
+    }
+
+    // not worth it, so send as is
+    if (compressed == 0 || compressed >= size) {
+        dst.resize(HEADER_SIZE + size);
+        put_header(&dst[0], None, binary, size);
+        if (size != 0)
+            std::memcpy(&dst[HEADER_SIZE], src, size);
+        return false;
+    }
+    dst.resize(HEADER_SIZE + compressed);
+    put_header(&dst[0], algorithm, binary, size);
+    return true;
+}
+
+bool Compression::decompress(const uint8_t* src, size_t size, bool& binary, std::vector<uint8_t>& dst) {
+    if (size < HEADER_SIZE)
+        return false;
+    Algorithm algorithm = static_cast<Algorithm>(src[0] & ~BINARY_FLAG);
+    binary = (src[0] & BINARY_FLAG) != 0;
+    uint32_t length = 0;
+    for (size_t i = 0; i != 4; i++) {
+        length |= static_cast<uint32_t>(src[1 + i]) << (8 * i);
+    }
+    if (length > _max_size)
+        return false;
+    src += HEADER_SIZE;
+    size -= HEADER_SIZE;
+
+    switch (algorithm) {
+        case None:
+            if (size != length)
+                return false;
+            dst.assign(src, src + size);
+            return true;
+        case LZ4: {
+            if (length > static_cast<uint32_t>(std::numeric_limits<int>::max()))
+                return false;
+            dst.resize(length);
+            int rc = LZ4_decompress_safe(
+                reinterpret_cast<const char *>(src),
+                reinterpret_cast<char *>(dst.data()),
+                size,
+                length
+            );
+            return rc >= 0 && static_cast<uint32_t>(rc) == length;
+        }
+        case Zstd: {
+            if (_zstd_dctx == NULL)
+                _zstd_dctx = ZSTD_createDCtx();
+            dst.resize(length);
+            size_t rc = ZSTD_decompressDCtx(_zstd_dctx, dst.data(), length, src, size);
+            return !ZSTD_isError(rc) && rc == length;
+        }
+        default:
+            return false;
+    }
+}
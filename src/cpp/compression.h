@@ -0,0 +1,117 @@
+#ifndef ROS_WEBRTC_COMPRESSION_H_
+#define ROS_WEBRTC_COMPRESSION_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "media_type.h"
+
+struct ZSTD_CCtx_s;
+
+struct ZSTD_DCtx_s;
+
+/**
+ * \brief Compresses data channel messages.
+ *
+ * Selected by data channel media type parameters, e.g.:
+ *
+ *  application/vnd.mayfield.msg.v1+json; compress=zstd; level=3; compressmin=512
+ *
+ * where compress is lz4 or zstd, level is the zstd compression level and
+ * compressmin is the size in bytes below which messages are sent as is.
+ *
+ * Every message is prefixed with a 5 byte header:
+ *
+ *  uint8  algorithm, with high bit set if the message is binary
+ *  uint32 uncompressed size, little-endian
+ *
+ * Each message is compressed independently, since data channels may be
+ * unordered or unreliable, but (de)compression contexts are reused. Not
+ * thread-safe.
+ */
+class Compression {
+
+public:
+
+    enum Algorithm {
+        None = 0,
+        LZ4 = 1,
+        Zstd = 2,
+    };
+
+    static const size_t HEADER_SIZE = 5;
+
+    static const size_t DEFAULT_THRESHOLD = 256;
+
+    static const size_t MAX_SIZE = 256 * 1024 * 1024; /*! Largest uncompressed message decompress ever accepts. */
+
+    /**
+     * \brief Whether a data channel media type selects compression.
+     */
+    static bool matches(const MediaType& media_type);
+
+    /**
+     * \param media_type Media type with compression parameters.
+     * \param max_size Largest uncompressed message accepted by decompress, at most and by default MAX_SIZE.
+     */
+    Compression(const MediaType& media_type, size_t max_size=0);
+
+    /**
+     * \param algorithm Algorithm to compress with.
+     * \param level Compression level, if algorithm has them.
+     * \param threshold Messages smaller than this are not compressed.
+     * \param max_size Largest uncompressed message accepted by decompress, at most and by default MAX_SIZE.
+     */
+    Compression(Algorithm algorithm, int level, size_t threshold, size_t max_size=0);
+
+    ~Compression();
+
+    Algorithm algorithm() const;
+
+    /**
+     * \brief Frames a message, compressing it if worthwhile.
+     * \param src Message bytes.
+     * \param size Number of message bytes.
+     * \param binary Whether the message is binary.
+     * \param dst Receives the framed message.
+     * \return Whether the message was compressed.
+     */
+    bool compress(const uint8_t* src, size_t size, bool binary, std::vector<uint8_t>& dst);
+
+    /**
+     * \brief Unframes a message, decompressing it if needed.
+     * \param src Framed message bytes.
+     * \param size Number of framed message bytes.
+     * \param binary Set to whether the message is binary.
+     * \param dst Receives the message.
+     * \return Whether the message was well formed.
+     */
+    bool decompress(const uint8_t* src, size_t size, bool& binary, std::vector<uint8_t>& dst);
+
+private:
+
+    void _init(Algorithm algorithm, int level, size_t threshold, size_t max_size);
+
+    Algorithm _algorithm;
+
+    int _level;
+
+    size_t _threshold;
+
+    size_t _max_size;
+
+    std::vector<char> _lz4_state;
+
+    ZSTD_CCtx_s* _zstd_cctx;
+
+    ZSTD_DCtx_s* _zstd_dctx;
+
+};
+
+typedef boost::shared_ptr<Compression> CompressionPtr;
+
+#endif /* ROS_WEBRTC_COMPRESSION_H_ */
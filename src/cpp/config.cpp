@@ -56,7 +56,7 @@ Config Config::get(ros::NodeHandle& nh) {
     }
 
     // flush_frequency
-    instance.flush_frequency = 10 * 60;  // 10 minutes
+    instance.flush_frequency = 10;  // 10 seconds
     if (nh.hasParam("flush_frequency")) {
         if (!nh.getParam("flush_frequency", instance.flush_frequency)) {
             ROS_WARN("'flush_frequency' param type not int");
@@ -124,6 +124,11 @@ Config Config::get(ros::NodeHandle& nh) {
         _get(nh, "queue_sizes", instance.queue_sizes);
     }
 
+    // data channel limits
+    if (nh.hasParam("data_channel")) {
+        _get(nh, "data_channel", instance.dc_limits);
+    }
+
     // open media sources
     instance.open_media_sources = true;
     if (nh.hasParam("open_media_sources")) {
@@ -132,6 +137,74 @@ Config Config::get(ros::NodeHandle& nh) {
         }
     }
 
+    // spinner_threads
+    instance.spinner_threads = 4;
+    if (nh.hasParam("spinner_threads")) {
+        if (!nh.getParam("spinner_threads", instance.spinner_threads)) {
+            ROS_WARN("'spinner_threads' param type not int");
+        }
+    }
+
+    // session_threads
+    int session_threads = instance.threads.sessions;
+    if (nh.hasParam("session_threads")) {
+        if (!nh.getParam("session_threads", session_threads)) {
+            ROS_WARN("'session_threads' param type not int");
+        }
+    }
+    instance.threads.sessions = std::max(1, session_threads);
+
+    // callback_threads
+    int callback_threads = instance.threads.callbacks;
+    if (nh.hasParam("callback_threads")) {
+        if (!nh.getParam("callback_threads", callback_threads)) {
+            ROS_WARN("'callback_threads' param type not int");
+        }
+    }
+    instance.threads.callbacks = std::max(1, callback_threads);
+
+    // callback_timeout
+    if (nh.hasParam("callback_timeout")) {
+        if (!nh.getParam("callback_timeout", instance.threads.callback_timeout)) {
+            ROS_WARN("'callback_timeout' param type not double");
+        }
+    }
+
+    // peer_connection_pool_size
+    int pool_size = instance.pool_sizes.connections;
+    if (nh.hasParam("peer_connection_pool_size")) {
+        if (!nh.getParam("peer_connection_pool_size", pool_size)) {
+            ROS_WARN("'peer_connection_pool_size' param type not int");
+        }
+    }
+    instance.pool_sizes.connections = std::max(0, pool_size);
+
+    // ice_candidate_pool_size
+    if (nh.hasParam("ice_candidate_pool_size")) {
+        if (!nh.getParam("ice_candidate_pool_size", instance.pool_sizes.ice_candidates)) {
+            ROS_WARN("'ice_candidate_pool_size' param type not int");
+        }
+    }
+    instance.pool_sizes.ice_candidates = std::max(0, instance.pool_sizes.ice_candidates);
+
+    // dtls_certificates
+    if (nh.hasParam("dtls_certificates")) {
+        _get(nh, "dtls_certificates", instance.certificate_settings);
+    }
+
+    // ice_restart
+    if (nh.hasParam("ice_restart")) {
+        _get(nh, "ice_restart", instance.ice_restart);
+    }
+
+    // shared_video_encoders
+    instance.shared_video_encoders = false;
+    if (nh.hasParam("shared_video_encoders")) {
+        if (!nh.getParam("shared_video_encoders", instance.shared_video_encoders)) {
+            ROS_WARN("'shared_video_encoders' param type not boolean");
+        }
+    }
+
     return instance;
 }
 
@@ -175,6 +248,28 @@ bool Config::_get(ros::NodeHandle& nh, const std::string& root, VideoSource& val
         }
         value.rotation = rotation;
     }
+    std::vector<int> layers;
+    if (nh.getParam(ros::names::append(root, "layers"), layers)) {
+        if (!is_video_layer_ladder(layers)) {
+            ROS_ERROR_STREAM(
+                "'" << ros::names::append(root, "layers") << "' " <<
+                "invalid, must start w/ 1 and each be a multiple of the one before, " <<
+                "at most " << MAX_VIDEO_LAYERS
+            );
+            return false;
+        }
+        value.layers = layers;
+    }
+    if (nh.getParam(ros::names::append(root, "temporal_layers"), value.temporal_layers)) {
+        if (value.temporal_layers < 1 || value.temporal_layers > MAX_TEMPORAL_LAYERS) {
+            ROS_ERROR_STREAM(
+                "'" << ros::names::append(root, "temporal_layers") << "' = " <<
+                value.temporal_layers << " " <<
+                "invalid, must be 1 to " << MAX_TEMPORAL_LAYERS
+            );
+            return false;
+        }
+    }
     return true;
 }
 
@@ -236,6 +331,89 @@ bool Config::_get(ros::NodeHandle& nh, const std::string& root, QueueSizes& valu
     return true;
 }
 
+bool Config::_get(ros::NodeHandle& nh, const std::string& root, DataChannelLimits& value) {
+    int size;
+    if (nh.getParam(ros::names::append(root, "send_high_watermark"), size))
+        value.send_high_watermark = size;
+    if (nh.getParam(ros::names::append(root, "send_low_watermark"), size))
+        value.send_low_watermark = size;
+    if (nh.getParam(ros::names::append(root, "send_queue_limit"), size))
+        value.send_queue_limit = size;
+    if (nh.hasParam(ros::names::append(root, "send_bandwidth_limit"))) {
+        if (!nh.getParam(ros::names::append(root, "send_bandwidth_limit"), value.send_bandwidth_limit)) {
+            ROS_WARN("'%s' param type not double", ros::names::append(root, "send_bandwidth_limit").c_str());
+        }
+    }
+    if (nh.getParam(ros::names::append(root, "reassembly_channel_limit"), size))
+        value.reassembly_channel_limit = size;
+    if (nh.getParam(ros::names::append(root, "reassembly_limit"), size))
+        value.reassembly_limit = size;
+    if (nh.getParam(ros::names::append(root, "reassembly_spill_threshold"), size))
+        value.reassembly_spill_threshold = size;
+    nh.getParam(ros::names::append(root, "reassembly_spill_dir"), value.reassembly_spill_dir);
+    if (nh.getParam(ros::names::append(root, "reassembly_spill_limit"), size))
+        value.reassembly_spill_limit = size;
+    if (nh.getParam(ros::names::append(root, "resume_limit"), size))
+        value.resume_limit = size;
+    if (nh.hasParam(ros::names::append(root, "reassembly_expiry"))) {
+        if (!nh.getParam(ros::names::append(root, "reassembly_expiry"), value.reassembly_expiry)) {
+            ROS_WARN("'%s' param type not double", ros::names::append(root, "reassembly_expiry").c_str());
+        }
+    }
+    if (value.send_low_watermark > value.send_high_watermark) {
+        ROS_WARN(
+            "'%s' > '%s', clamping ...",
+            ros::names::append(root, "send_low_watermark").c_str(),
+            ros::names::append(root, "send_high_watermark").c_str()
+        );
+        value.send_low_watermark = value.send_high_watermark;
+    }
+    return true;
+}
+
+bool Config::_get(ros::NodeHandle& nh, const std::string& root, CertificateSettings& value) {
+    int count;
+    if (nh.getParam(ros::names::append(root, "count"), count))
+        value.count = std::max(0, count);
+    if (nh.hasParam(ros::names::append(root, "lifetime"))) {
+        if (!nh.getParam(ros::names::append(root, "lifetime"), value.lifetime)) {
+            ROS_WARN("'%s' param type not double", ros::names::append(root, "lifetime").c_str());
+        }
+    }
+    if (nh.hasParam(ros::names::append(root, "rotation"))) {
+        if (!nh.getParam(ros::names::append(root, "rotation"), value.rotation)) {
+            ROS_WARN("'%s' param type not double", ros::names::append(root, "rotation").c_str());
+        }
+    }
+    nh.getParam(ros::names::append(root, "directory"), value.directory);
+    if (value.rotation > value.lifetime) {
+        ROS_WARN(
+            "'%s' > '%s', clamping ...",
+            ros::names::append(root, "rotation").c_str(),
+            ros::names::append(root, "lifetime").c_str()
+        );
+        value.rotation = value.lifetime;
+    }
+    return true;
+}
+
+bool Config::_get(ros::NodeHandle& nh, const std::string& root, IceRestartPolicy& value) {
+    if (nh.hasParam(ros::names::append(root, "grace"))) {
+        if (!nh.getParam(ros::names::append(root, "grace"), value.grace)) {
+            ROS_WARN("'%s' param type not double", ros::names::append(root, "grace").c_str());
+        }
+    }
+    int attempts;
+    if (nh.getParam(ros::names::append(root, "attempts"), attempts))
+        value.attempts = std::max(0, attempts);
+    if (nh.hasParam(ros::names::append(root, "timeout"))) {
+        if (!nh.getParam(ros::names::append(root, "timeout"), value.timeout)) {
+            ROS_WARN("'%s' param type not double", ros::names::append(root, "timeout").c_str());
+        }
+    }
+    return true;
+}
+
 Config::TraceLevels Config::_trace_levels = {
     {"stateinfo", webrtc::TraceLevel::kTraceStateInfo},
     {"warning", webrtc::TraceLevel::kTraceWarning},
@@ -38,6 +38,10 @@ public:
                 minWidth: "640"
                 maxHeight: "480"
                 minHeight: "480"
+          # also send at 320x240 and 160x120
+          layers: [1, 2, 4]
+          # each w/ 30, 15 and 7.5 fps layers
+          temporal_layers: 3
         wayward:
           # video device is system dependent name (e.g. Linux 2.6+ its `cat /sys/class/video4linux/video{#}/name`)
           name: HD Camera
@@ -58,7 +62,32 @@ public:
         audio: 1000
         video: 1000
         data: 1000
+       data_channel:
+        send_high_watermark: 1048576
+        send_low_watermark: 262144
+        send_queue_limit: 67108864
+        reassembly_expiry: 600.0
+        reassembly_channel_limit: 67108864
+        reassembly_limit: 268435456
+        reassembly_spill_limit: 1073741824
+        resume_limit: 1073741824
        open_media_sources: true
+       spinner_threads: 4
+       session_threads: 4
+       callback_threads: 2
+       callback_timeout: 30.0
+       peer_connection_pool_size: 0
+       ice_candidate_pool_size: 0
+       ice_restart:
+        grace: 2.0
+        attempts: 3
+        timeout: 5.0
+       dtls_certificates:
+        count: 4
+        lifetime: 2592000.0
+        rotation: 86400.0
+        directory: /var/lib/ros_webrtc
+       shared_video_encoders: false
 
      * \endcode
      */
@@ -93,8 +122,22 @@ public:
 
     QueueSizes queue_sizes; /*! Sizes of audio, video and data publisher/subscriber queues. */
 
+    DataChannelLimits dc_limits; /*! Limits applied to data channels. */
+
     bool open_media_sources; /*! Open media sources on start. */
 
+    int spinner_threads; /*! Threads serving the global callback queue (e.g. timers and host-wide services). */
+
+    HostThreads threads; /*! Threads serving peer connection requests and delivering their callbacks. */
+
+    PeerConnectionPoolSizes pool_sizes; /*! Peer connections to create ahead of sessions, and candidates each gathers. */
+
+    CertificateSettings certificate_settings; /*! DTLS certificates shared by peer connections. */
+
+    IceRestartPolicy ice_restart; /*! How peer connections recover when ICE disconnects. */
+
+    bool shared_video_encoders; /*! Encode each video source once for all peer connections sending it. */
+
 private:
 
     static bool _get(ros::NodeHandle& nh, const std::string& root, VideoSource& value);
@@ -107,6 +150,12 @@ private:
 
     static bool _get(ros::NodeHandle& nh, const std::string& root, QueueSizes& value);
 
+    static bool _get(ros::NodeHandle& nh, const std::string& root, DataChannelLimits& value);
+
+    static bool _get(ros::NodeHandle& nh, const std::string& root, CertificateSettings& value);
+
+    static bool _get(ros::NodeHandle& nh, const std::string& root, IceRestartPolicy& value);
+
     typedef std::map<std::string, webrtc::TraceLevel> TraceLevels;
 
     static TraceLevels _trace_levels;
@@ -1,85 +1,306 @@
+#include <errno.h>
+#include <string.h>
+
 #include <json/json.h>
 
+#include <boost/bind.hpp>
+
 #include "data_channel.h"
 #include "util.h"
 
-// ChunkedDataTransfer
+// DataChannelLimits
+
+DataChannelLimits::DataChannelLimits() :
+    send_high_watermark(1024 * 1024),  // 1 MiB
+    send_low_watermark(256 * 1024),  // 256 KiB
+    send_bandwidth_limit(0),
+    send_queue_limit(64 * 1024 * 1024),  // 64 MiB
+    reassembly_expiry(10 * 60),  // 10 mins
+    reassembly_channel_limit(64 * 1024 * 1024),  // 64 MiB
+    reassembly_limit(256 * 1024 * 1024),  // 256 MiB
+    reassembly_spill_threshold(0),
+    reassembly_spill_dir("/tmp"),
+    reassembly_spill_limit(1024 * 1024 * 1024),  // 1 GiB
+    resume_limit(1024 * 1024 * 1024) {  // 1 GiB
+}
 
-struct ChunkedDataTransfer {
+// DataChannel::Transfer
 
-    ChunkedDataTransfer(
+/**
+ * \brief Outbound message, handed to the provider a chunk at a time.
+ */
+struct DataChannel::Transfer {
+
+    Transfer(
         const std::string& id,
         const webrtc::DataBuffer& data_buffer,
+        size_t size,
+        const std::string& key
+    );
+
+    /**
+     * \brief Streams a file, reading each chunk only as it is sent.
+     */
+    Transfer(
+        const std::string& id,
+        const FileReaderPtr& file,
         size_t size
     );
 
+    /**
+     * \brief Sends buffers already encoded, and shared, w/ other channels.
+     */
+    Transfer(
+        const EncodedDataConstPtr& encoded,
+        const std::string& key
+    );
+
     bool is_complete() const;
 
-    size_t operator()(webrtc::DataChannelInterface* provider);
+    bool is_started() const;
+
+    bool is_file() const;
+
+    uint64_t remaining() const;
+
+    size_t next_size() const;
 
-    const std::string id;
+    bool next(webrtc::DataBuffer& dst, size_t& bytes);
 
-    const rtc::CopyOnWriteBuffer& data;
+    /**
+     * \brief Skips chunks the remote peer already has.
+     * \param have Ranges of chunk indices received.
+     */
+    void resume(const ChunkedMessage::Ranges& have);
 
-    const size_t size;
+    std::string id;
 
-    const size_t total;
+    rtc::CopyOnWriteBuffer data;
+
+    FileReaderPtr file; /*! Read from instead of data, if set. */
+
+    EncodedDataConstPtr encoded; /*! Sent instead of data, if set. */
+
+    bool binary;
+
+    uint64_t length;
+
+    size_t size;
+
+    size_t total;
 
     size_t current;
 
+    std::vector<bool> skip; /*! Chunks not to send, if resumed. */
+
+    std::string key; /*! Conflation key, or empty. */
+
 };
 
-ChunkedDataTransfer::ChunkedDataTransfer(
+DataChannel::Transfer::Transfer(
     const std::string& id,
     const webrtc::DataBuffer& data_buffer,
-    size_t size) :
+    size_t size,
+    const std::string& key) :
     id(id),
     data(data_buffer.data),
+    binary(data_buffer.binary),
+    length(data.size()),
+    size(size),
+    total(size == 0 ? 1 : std::max<size_t>(1, std::ceil((double)length / (double)size))),
+    current(0),
+    key(key) {
+}
+
+DataChannel::Transfer::Transfer(
+    const std::string& id,
+    const FileReaderPtr& file,
+    size_t size) :
+    id(id),
+    file(file),
+    binary(true),
+    length(file->size()),
     size(size),
+    total(std::max<size_t>(1, std::ceil((double)length / (double)size))),
+    current(0) {
+}
+
+DataChannel::Transfer::Transfer(
+    const EncodedDataConstPtr& encoded,
+    const std::string& key) :
+    id(encoded->id),
+    encoded(encoded),
+    binary(encoded->binary),
+    length(encoded->length),
+    size(encoded->chunk_size),
+    total(encoded->buffers.size()),
     current(0),
-    total(static_cast<size_t>(std::ceil((double)data.size() / (double)size))) {
+    key(key) {
+}
+
+bool DataChannel::Transfer::is_started() const {
+    return current != 0;
 }
 
-bool ChunkedDataTransfer::is_complete() const {
+bool DataChannel::Transfer::is_complete() const {
     return current == total;
 }
 
-size_t ChunkedDataTransfer::operator()(webrtc::DataChannelInterface* provider) {
-    size_t bytes = 0;
+bool DataChannel::Transfer::is_file() const {
+    return file != NULL;
+}
+
+uint64_t DataChannel::Transfer::remaining() const {
+    if (size == 0)
+        return is_complete() ? 0 : length;
+    return length - std::min<uint64_t>(length, (uint64_t)current * size);
+}
+
+size_t DataChannel::Transfer::next_size() const {
+    if (size == 0)
+        return length;
+    return std::min<uint64_t>(size, remaining());
+}
 
+bool DataChannel::Transfer::next(webrtc::DataBuffer& dst, size_t& bytes) {
+    if (encoded) {
+        bytes = next_size();
+        dst = webrtc::DataBuffer(encoded->buffers[current], binary);
+        current++;
+        return true;
+    }
+
+    if (size == 0) {
+        bytes = length;
+        current++;
+        dst = webrtc::DataBuffer(data, binary);
+        return true;
+    }
+
+    bytes = next_size();
+    uint64_t offset = (uint64_t)current * size;
     Json::Value chunk;
     chunk["id"] = id;
     chunk["index"] = static_cast<Json::UInt>(current);
     chunk["total"] = static_cast<Json::UInt>(total);
-    chunk["data"] = std::string(
-        (const char *)(&data.data()[0] + current * size),
-        std::min(size, data.size() - current * size)
-    );
-    std::string serialized = chunk.toStyledString();
-    webrtc::DataBuffer data_buffer(serialized);
-    provider->Send(data_buffer);
-    bytes += data_buffer.size();
+    if (file) {
+        std::vector<uint8_t> buffer;
+        if (!file->read(offset, bytes, buffer))
+            return false;
+        chunk["data"] = std::string((const char *)buffer.data(), bytes);
+        chunk["crc32"] = static_cast<Json::UInt>(crc32(buffer.data(), bytes));
+    } else {
+        chunk["data"] = std::string((const char *)(&data.data()[0] + offset), bytes);
+    }
     current++;
+    while (current < skip.size() && skip[current])
+        current++;
+    dst = webrtc::DataBuffer(chunk.toStyledString());
+    return true;
+}
 
-    return bytes;
+void DataChannel::Transfer::resume(const ChunkedMessage::Ranges& have) {
+    skip.assign(total, false);
+    for (auto i = have.begin(); i != have.end(); i++) {
+        for (size_t j = (*i).first; j < std::min((*i).second, total); j++)
+            skip[j] = true;
+    }
+    current = 0;
+    while (current < total && skip[current])
+        current++;
 }
 
 // DataChannel
 
+bool DataChannel::parse_priority(const std::string& value, Priority& priority) {
+    if (value == "very-low")
+        priority = VeryLow;
+    else if (value == "low")
+        priority = Low;
+    else if (value == "medium")
+        priority = Medium;
+    else if (value == "high")
+        priority = High;
+    else
+        return false;
+    return true;
+}
+
+std::string DataChannel::priority_name(Priority priority) {
+    switch (priority) {
+        case VeryLow:
+            return "very-low";
+        case Low:
+            return "low";
+        case Medium:
+            return "medium";
+        case High:
+            return "high";
+    }
+    return "low";
+}
+
 DataChannel::DataChannel(
     ros::NodeHandle& nh,
     const std::string& recv_topic,
+    const std::string& send_topic,
     webrtc::DataChannelInterface *provider,
     const MediaType& media_type,
+    const DataChannelLimits& limits,
     size_t queue_size) :
         _provider(provider),
-        _media_type(media_type) {
+        _label(provider->label()),
+        _media_type(media_type),
+        _limits(limits),
+        _priority(Low),
+        _state(webrtc::DataChannelInterface::kConnecting),
+        _send_queue_bytes(0),
+        _superseded(0),
+        _pumping(false),
+        _pump_requested(false),
+        _coalesced_messages(0),
+        _coalesced_frames(0),
+        _coalesce_armed(false),
+        _offered(false) {
+    // remote peer may tell us its priority in the protocol
+    auto priority = _media_type.params.find("priority");
+    if (priority != _media_type.params.end()) {
+        Priority value;
+        if (parse_priority((*priority).second, value)) {
+            _priority = value;
+        } else {
+            ROS_WARN_STREAM(
+                "data channel '" << _label << "' has invalid " <<
+                "priority '" << (*priority).second << "'"
+            );
+        }
+    }
+    if (Compression::matches(_media_type)) {
+        _compression.reset(new Compression(
+            _media_type,
+            _limits.reassembly_channel_limit != 0 ? _limits.reassembly_channel_limit : _limits.reassembly_limit
+        ));
+        if (_compression->algorithm() == Compression::None) {
+            ROS_WARN_STREAM(
+                "data channel '" << _label << "' w/ protocol '" <<
+                provider->protocol() << "' has unsupported compression, " <<
+                "sending uncompressed"
+            );
+        }
+    }
     if (is_chunked()) {
         _data_observer.reset(new ChunkedDataObserver(
             nh,
             recv_topic,
             queue_size,
-            provider
+            provider,
+            chunk_size(),
+            ros::Duration(_limits.reassembly_expiry),
+            _limits.reassembly_channel_limit,
+            _limits.reassembly_budget,
+            _limits.reassembly_spill_threshold,
+            _limits.reassembly_spill_dir,
+            _limits.reassembly_spill_budget
         ));
     } else {
         _data_observer.reset(new UnchunkedDataObserver(
@@ -89,6 +310,199 @@ DataChannel::DataChannel(
             provider
         ));
     }
+    _data_observer->on_drain(boost::bind(&DataChannel::_on_drain, this));
+    _state = provider->state();
+    if (is_chunked()) {
+        _file_pub = nh.advertise<ros_webrtc::FileTransfer>(
+            recv_topic + "/file_transfer",
+            queue_size
+        );
+    }
+    if (TopicBridge::matches(_media_type)) {
+        _bridge.reset(new TopicBridge(
+            TopicBridge::is_mux(_media_type),
+            nh,
+            recv_topic,
+            _label,
+            [this](webrtc::DataBuffer& data_buffer, const std::string& key) {
+                return send(data_buffer, key);
+            },
+            queue_size
+        ));
+    }
+    if (is_chunked()) {
+        _data_observer->on_resume(boost::bind(&DataChannel::_on_resume, this, _1, _2, _3));
+    }
+    if (_compression || _bridge || is_coalesced()) {
+        _data_observer->on_message(boost::bind(&DataChannel::_on_recv, this, _1));
+    }
+    if (is_coalesced()) {
+        auto i = _media_type.params.find("coalescedelay");
+        _coalesce_delay = ros::WallDuration(
+            (i == _media_type.params.end() ? 1000 : std::atoi((*i).second.c_str())) * 1e-6
+        );
+        _coalesce_timer = nh.createWallTimer(
+            _coalesce_delay,
+            &DataChannel::_on_coalesce_timer,
+            this,
+            true,  // oneshot
+            false  // autostart
+        );
+    }
+    _send_sub = nh.subscribe(
+        send_topic,
+        queue_size,
+        &DataChannel::_on_send,
+        this,
+        ros::TransportHints().tcpNoDelay()
+    );
+}
+
+DataChannel::~DataChannel() {
+    // waits for any in-flight send and flush callbacks
+    _send_sub.shutdown();
+    _coalesce_timer.stop();
+    // unregisters observer, so no more drain callbacks after this
+    _data_observer.reset();
+    _bridge.reset();
+    // suspends files still being sent
+    _discard();
+}
+
+bool DataChannel::bridge(const std::string& topic, uint32_t queue_size) {
+    if (!_bridge) {
+        ROS_WARN_STREAM(
+            "data channel '" << _label << "' w/ protocol '" <<
+            _provider->protocol() << "' does not bridge topics"
+        );
+        return false;
+    }
+    return _bridge->forward(topic, queue_size);
+}
+
+bool DataChannel::is_bridge() const {
+    return _bridge != NULL;
+}
+
+bool DataChannel::is_compressed() const {
+    return _compression != NULL;
+}
+
+bool DataChannel::is_coalesced() const {
+    return coalesce_size() != 0;
+}
+
+size_t DataChannel::coalesce_size() const {
+    auto i = _media_type.params.find("coalesce");
+    return i == _media_type.params.end() ? 0 : std::atoi((*i).second.c_str());
+}
+
+bool DataChannel::is_conflated() const {
+    return _media_type.params.find("conflate") != _media_type.params.end();
+}
+
+size_t DataChannel::conflate_watermark() const {
+    auto i = _media_type.params.find("conflate");
+    return i == _media_type.params.end() ? 0 : std::atoi((*i).second.c_str());
+}
+
+DataChannel::Priority DataChannel::priority() const {
+    return static_cast<Priority>(_priority.load());
+}
+
+void DataChannel::set_priority(Priority priority) {
+    _priority = priority;
+    if (_scheduler)
+        _scheduler->update(this, priority, weight());
+}
+
+size_t DataChannel::weight() const {
+    auto i = _media_type.params.find("weight");
+    return i == _media_type.params.end() ? 1 : std::max(1, std::atoi((*i).second.c_str()));
+}
+
+void DataChannel::schedule(const SendSchedulerPtr& scheduler) {
+    _scheduler = scheduler;
+    _pump();
+}
+
+void DataChannel::adopt(const std::string& peer_id) {
+    if (!_limits.resume_store || !is_chunked())
+        return;
+    _resume_key = ResumeStore::key(peer_id, _label);
+    _data_observer->resume(_limits.resume_store, _resume_key);
+    std::vector<SuspendedFile> files;
+    _limits.resume_store->take(_resume_key, files);
+    {
+        rtc::CritScope cs(&_send_cs);
+        for (auto i = files.begin(); i != files.end(); i++) {
+            FileReaderPtr file(new FileReader());
+            if (!file->open((*i).path)) {
+                ROS_WARN_STREAM(
+                    "data channel '" << _label << "' cannot reopen '" <<
+                    (*i).path << "' - " << strerror(errno) << ", not resuming"
+                );
+                continue;
+            }
+            _suspended[(*i).id] = TransferPtr(new Transfer((*i).id, file, chunk_size()));
+        }
+    }
+    _offer();
+}
+
+void DataChannel::_offer() {
+    if (_state != webrtc::DataChannelInterface::kOpen || _offered.exchange(true))
+        return;
+    std::vector<webrtc::DataBuffer> offers;
+    {
+        rtc::CritScope cs(&_send_cs);
+        for (auto i = _suspended.begin(); i != _suspended.end(); i++) {
+            Json::Value offer;
+            offer["offer"] = (*i).first;
+            offer["total"] = static_cast<Json::UInt>((*i).second->total);
+            offers.push_back(webrtc::DataBuffer(offer.toStyledString()));
+        }
+    }
+    for (auto i = offers.begin(); i != offers.end(); i++)
+        _provider->Send(*i);
+}
+
+void DataChannel::_on_resume(const std::string& id, size_t total, const ChunkedMessage::Ranges& have) {
+    ros_webrtc::FileTransfer msg;
+    {
+        rtc::CritScope cs(&_send_cs);
+        auto i = _suspended.find(id);
+        if (i == _suspended.end()) {
+            ROS_WARN_STREAM(
+                "data channel '" << _label << "' ignoring resume " <<
+                "of unknown transfer w/ id " << id
+            );
+            return;
+        }
+        TransferPtr xfer = (*i).second;
+        _suspended.erase(i);
+        if (total == xfer->total) {
+            xfer->resume(have);
+        } else {
+            ROS_WARN_STREAM(
+                "data channel '" << _label << "' resuming '" <<
+                xfer->file->path() << "' w/ " << xfer->total << " chunk(s) but " <<
+                "remote peer has " << total << ", sending all"
+            );
+        }
+        if (xfer->is_complete()) {
+            msg = _file_message(*xfer, "completed");
+        } else {
+            ROS_INFO_STREAM(
+                "data channel '" << _label << "' resuming '" <<
+                xfer->file->path() << "' w/ id " << id << " at chunk " << xfer->current
+            );
+            _send_queue.push_back(xfer);
+            msg = _file_message(*xfer, "resumed");
+        }
+    }
+    _file_pub.publish(msg);
+    _pump();
 }
 
 bool DataChannel::is_chunked() const {
@@ -100,35 +514,515 @@ size_t DataChannel::chunk_size() const {
     return i == _media_type.params.end() ? 0 : std::atoi((*i).second.c_str());
 }
 
-void DataChannel::send(const ros_webrtc::Data& msg) {
+std::string DataChannel::protocol() const {
+    return _provider->protocol();
+}
+
+bool DataChannel::send(const ros_webrtc::Data& msg) {
     webrtc::DataBuffer data_buffer(
         rtc::CopyOnWriteBuffer(&msg.buffer[0], msg.buffer.size()),
         msg.encoding == "binary"
     );
-    send(data_buffer);
+    return send(data_buffer, msg.key);
+}
+
+void DataChannel::_on_send(const ros_webrtc::Data::ConstPtr& msg) {
+    if (!msg->label.empty() && msg->label != _label) {
+        ROS_WARN_STREAM(
+            "data channel '" << _label << "' ignoring message " <<
+            "for label '" << msg->label << "'"
+        );
+        return;
+    }
+    send(*msg);
+}
+
+bool DataChannel::_on_recv(ros_webrtc::Data& msg) {
+    // only ever called from the signaling thread, so no need to lock
+    if (_compression) {
+        std::vector<uint8_t> buffer;
+        bool binary = false;
+        if (!_compression->decompress(msg.buffer.data(), msg.buffer.size(), binary, buffer)) {
+            ROS_WARN_STREAM(
+                "data channel '" << _label << "' dropping " <<
+                "malformed compressed message w/ size " << msg.buffer.size()
+            );
+            return false;
+        }
+        msg.buffer.swap(buffer);
+        msg.encoding = binary ? "binary" : "utf-8";
+    }
+    if (is_coalesced()) {
+        std::vector<CoalescedFrame::Record> records;
+        if (!CoalescedFrame::parse(msg.buffer.data(), msg.buffer.size(), records)) {
+            ROS_WARN_STREAM(
+                "data channel '" << _label << "' dropping " <<
+                "malformed coalesced message w/ size " << msg.buffer.size()
+            );
+            return false;
+        }
+        for (auto i = records.begin(); i != records.end(); i++) {
+            ros_webrtc::Data part;
+            part.label = msg.label;
+            part.encoding = (*i).binary ? "binary" : "utf-8";
+            part.buffer.assign((*i).data, (*i).data + (*i).size);
+            _dispatch(part);
+        }
+        return false;
+    }
+    _dispatch(msg);
+    return false;
+}
+
+void DataChannel::_dispatch(ros_webrtc::Data& msg) {
+    if (_bridge) {
+        _bridge->receive(msg.buffer.data(), msg.buffer.size());
+        return;
+    }
+    _data_observer->publish(msg);
+}
+
+bool DataChannel::send(webrtc::DataBuffer& data_buffer, const std::string& key) {
+    bool queued = is_coalesced() ? _coalesce(data_buffer) : _enqueue(data_buffer, key);
+    _pump();
+    return queued;
+}
+
+bool DataChannel::encode(const webrtc::DataBuffer& data_buffer, EncodedDataConstPtr& encoded) {
+    // frames are packed per channel as they fill
+    if (is_coalesced())
+        return false;
+    Transfer xfer(
+        is_chunked() ? generate_id() : std::string(),
+        _compress(data_buffer),
+        chunk_size(),
+        std::string()
+    );
+    boost::shared_ptr<EncodedData> dst(new EncodedData());
+    dst->id = xfer.id;
+    dst->length = xfer.length;
+    dst->chunk_size = xfer.size;
+    dst->binary = xfer.binary;
+    dst->buffers.reserve(xfer.total);
+    webrtc::DataBuffer buffer(std::string(""));
+    size_t bytes = 0;
+    while (!xfer.is_complete()) {
+        xfer.next(buffer, bytes);
+        dst->binary = buffer.binary;
+        dst->buffers.push_back(buffer.data);
+    }
+    encoded = dst;
+    return true;
+}
+
+bool DataChannel::send(const EncodedDataConstPtr& encoded, const std::string& key) {
+    bool queued = _push(Transfer(encoded, is_conflated() ? key : std::string()));
+    _pump();
+    return queued;
+}
+
+bool DataChannel::_coalesce(const webrtc::DataBuffer& data_buffer) {
+    bool queued = true;
+    bool pending = false;
+    {
+        // frames are queued under the lock so they go out in order
+        rtc::CritScope cs(&_coalesce_cs);
+        size_t record_size = CoalescedFrame::record_size(data_buffer.size());
+        if (!_coalesced.empty() && _coalesced.size() + record_size > coalesce_size())
+            queued = _flush_coalesced();
+        _coalesced.append(data_buffer.data.cdata(), data_buffer.size(), data_buffer.binary);
+        _coalesced_messages += 1;
+        if (_coalesced.size() >= coalesce_size())
+            queued = _flush_coalesced() && queued;
+        pending = !_coalesced.empty();
+    }
+    if (pending && !_coalesce_armed.exchange(true)) {
+        _coalesce_timer.stop();
+        _coalesce_timer.setPeriod(_coalesce_delay);
+        _coalesce_timer.start();
+    }
+    return queued;
+}
+
+bool DataChannel::_flush_coalesced() {
+    std::vector<uint8_t> frame;
+    _coalesced.release(frame);
+    _coalesced_frames += 1;
+    webrtc::DataBuffer data_buffer(rtc::CopyOnWriteBuffer(frame.data(), frame.size()), true);
+    return _enqueue(data_buffer);
+}
+
+void DataChannel::_on_coalesce_timer(const ros::WallTimerEvent& event) {
+    _coalesce_armed = false;
+    {
+        rtc::CritScope cs(&_coalesce_cs);
+        if (_coalesced.empty())
+            return;
+        _flush_coalesced();
+    }
+    _pump();
+}
+
+bool DataChannel::_enqueue(webrtc::DataBuffer& data_buffer, const std::string& key) {
+    return _push(_compress(data_buffer), key);
+}
+
+webrtc::DataBuffer DataChannel::_compress(const webrtc::DataBuffer& data_buffer) {
+    // compress before chunking, so fewer chunks are sent
+    if (!_compression)
+        return data_buffer;
+    std::vector<uint8_t> compressed;
+    {
+        rtc::CritScope cs(&_compress_cs);
+        _compression->compress(
+            data_buffer.data.cdata(),
+            data_buffer.size(),
+            data_buffer.binary,
+            compressed
+        );
+    }
+    return webrtc::DataBuffer(
+        rtc::CopyOnWriteBuffer(compressed.data(), compressed.size()),
+        true
+    );
 }
 
-void DataChannel::send(webrtc::DataBuffer& data_buffer) {
-    if (!is_chunked()) {
-        _provider->Send(data_buffer);
+bool DataChannel::_push(const webrtc::DataBuffer& data_buffer, const std::string& key) {
+    return _push(Transfer(
+        is_chunked() ? generate_id() : std::string(),
+        data_buffer,
+        chunk_size(),
+        is_conflated() ? key : std::string()
+    ));
+}
+
+bool DataChannel::_push(const Transfer& xfer) {
+    rtc::CritScope cs(&_send_cs);
+
+    // when backed up replace an unsent message w/ the same key, in place
+    TransferPtr superseded;
+    if (!xfer.key.empty() && _send_queue_bytes >= conflate_watermark()) {
+        auto i = _send_keys.find(xfer.key);
+        if (i != _send_keys.end())
+            superseded = (*i).second;
+    }
+    size_t queued_bytes = _send_queue_bytes - (superseded ? superseded->remaining() : 0);
+
+    if (_limits.send_queue_limit != 0 &&
+        queued_bytes + xfer.length > _limits.send_queue_limit) {
+        ROS_WARN_STREAM(
+            "data channel '" << _label << "' send queue full - " <<
+            "queued=" << _send_queue_bytes << ", " <<
+            "size=" << xfer.length << ", " <<
+            "limit=" << _limits.send_queue_limit
+        );
+        return false;
+    }
+    if (superseded) {
+        *superseded = xfer;
+        _superseded += 1;
     } else {
-        ChunkedDataTransfer xfer(generate_id(), data_buffer, chunk_size());
-        while (!xfer.is_complete()) {
-            // TODO: rate limit?
-            xfer(_provider);
+        TransferPtr queued(new Transfer(xfer));
+        _send_queue.push_back(queued);
+        if (!queued->key.empty())
+            _send_keys[queued->key] = queued;
+    }
+    _send_queue_bytes = queued_bytes + xfer.length;
+    return true;
+}
+
+void DataChannel::_on_drain() {
+    // only ever called from the signaling thread, so provider calls are direct
+    _state = _provider->state();
+    if (_state == webrtc::DataChannelInterface::kClosing ||
+        _state == webrtc::DataChannelInterface::kClosed) {
+        // here rather than when scheduled, which is done w/ the scheduler locked
+        _discard();
+    }
+    _offer();
+    if (_scheduler)
+        _scheduler->buffered(this, _provider->buffered_amount());
+    _pump();
+}
+
+void DataChannel::_pump() {
+    if (_scheduler) {
+        _scheduler->pump();
+        return;
+    }
+    // Called from both ROS and WebRTC signaling threads. Only one of them
+    // drains at a time and never while holding a lock the other may need
+    // (i.e. provider calls are proxied to and block on the signaling thread).
+    _pump_requested = true;
+    while (_pump_requested) {
+        bool expected = false;
+        if (!_pumping.compare_exchange_strong(expected, true))
+            return;  // whoever is pumping will see the request
+        _pump_requested = false;
+        _drain();
+        _pumping = false;
+    }
+}
+
+void DataChannel::_drain() {
+    auto state = _provider->state();
+    if (state == webrtc::DataChannelInterface::kClosing ||
+        state == webrtc::DataChannelInterface::kClosed) {
+        _discard();
+        return;
+    }
+    if (state != webrtc::DataChannelInterface::kOpen)
+        return;
+
+    // resume after a stall only once provider has drained below low watermark
+    bool is_stalled;
+    {
+        rtc::CritScope cs(&_send_cs);
+        is_stalled = !_stalled_at.isZero();
+    }
+    uint64_t buffered_amount = _provider->buffered_amount();
+    if (is_stalled) {
+        if (buffered_amount > _limits.send_low_watermark)
+            return;
+        stalled(false);
+    }
+
+    while (true) {
+        {
+            rtc::CritScope cs(&_send_cs);
+            if (_send_queue.empty())
+                break;
         }
+        if (buffered_amount >= _limits.send_high_watermark) {
+            stalled(true);
+            break;
+        }
+        if (!send_head(buffered_amount))
+            break;
+    }
+}
+
+void DataChannel::_discard() {
+    // files can be read again, so are kept for the next channel to resume
+    std::vector<TransferPtr> files;
+    {
+        rtc::CritScope cs(&_send_cs);
+        for (auto i = _suspended.begin(); i != _suspended.end(); i++)
+            files.push_back((*i).second);
+        _suspended.clear();
+        if (!_send_queue.empty()) {
+            ROS_WARN_STREAM(
+                "data channel '" << _label << "' closed, " <<
+                "discarding " << _send_queue.size() << " queued message(s)"
+            );
+            for (auto i = _send_queue.begin(); i != _send_queue.end(); i++) {
+                if ((*i)->is_file())
+                    files.push_back(*i);
+            }
+            _send_queue.clear();
+            _send_keys.clear();
+            _send_queue_bytes = 0;
+        }
+    }
+    double now = ros::Time::now().toSec();
+    for (auto i = files.begin(); i != files.end(); i++) {
+        if (_limits.resume_store && !_resume_key.empty()) {
+            SuspendedFile file = {(*i)->id, (*i)->file->path()};
+            _limits.resume_store->suspend(_resume_key, file, now);
+            _file_pub.publish(_file_message(**i, "suspended"));
+        } else {
+            _file_pub.publish(_file_message(**i, "failed"));
+        }
+    }
+}
+
+bool DataChannel::head(size_t& size) {
+    // called w/ the scheduler locked, so no provider calls and closed
+    // channels are discarded by _on_drain instead
+    if (_state != webrtc::DataChannelInterface::kOpen)
+        return false;
+    rtc::CritScope cs(&_send_cs);
+    if (_send_queue.empty())
+        return false;
+    size = _send_queue.front()->next_size();
+    return true;
+}
+
+bool DataChannel::send_head(uint64_t& buffered_amount) {
+    TransferPtr xfer;
+    webrtc::DataBuffer data_buffer(std::string(""));
+    size_t bytes = 0;
+    bool failed = false;
+    {
+        rtc::CritScope cs(&_send_cs);
+        if (_send_queue.empty())
+            return false;
+        xfer = _send_queue.front();
+        if (!xfer->is_started() && !xfer->key.empty()) {
+            auto i = _send_keys.find(xfer->key);
+            if (i != _send_keys.end() && (*i).second == xfer)
+                _send_keys.erase(i);
+        }
+        if (!xfer->next(data_buffer, bytes)) {
+            ROS_WARN_STREAM(
+                "data channel '" << _label << "' failed to read " <<
+                "'" << xfer->file->path() << "', discarding rest of file"
+            );
+            _send_queue.pop_front();
+            failed = true;
+        } else {
+            // files are read as they are sent, so are not queued bytes
+            if (!xfer->is_file())
+                _send_queue_bytes -= bytes;
+            if (xfer->is_complete())
+                _send_queue.pop_front();
+        }
+    }
+    if (failed) {
+        _file_pub.publish(_file_message(*xfer, "failed"));
+        return false;
+    }
+    if (!_provider->Send(data_buffer)) {
+        ROS_WARN_STREAM(
+            "data channel '" << _label << "' send failed, " <<
+            "discarding rest of message"
+        );
+        {
+            rtc::CritScope cs(&_send_cs);
+            if (!_send_queue.empty() && _send_queue.front() == xfer) {
+                if (!xfer->is_file())
+                    _send_queue_bytes -= xfer->remaining();
+                _send_queue.pop_front();
+            }
+        }
+        if (xfer->is_file())
+            _file_pub.publish(_file_message(*xfer, "failed"));
+        return false;
+    }
+    if (xfer->is_file()) {
+        // progress at most every percent
+        if (xfer->is_complete())
+            _file_pub.publish(_file_message(*xfer, "completed"));
+        else if ((xfer->current * 100) / xfer->total != ((xfer->current - 1) * 100) / xfer->total)
+            _file_pub.publish(_file_message(*xfer, "sending"));
+    }
+    buffered_amount = _provider->buffered_amount();
+    return true;
+}
+
+bool DataChannel::send_file(const std::string& path, std::string& id, uint64_t& size) {
+    if (!is_chunked() || _compression || is_coalesced() || _bridge) {
+        ROS_WARN_STREAM(
+            "data channel '" << _label << "' w/ protocol '" <<
+            _provider->protocol() << "' cannot send files, must be chunked " <<
+            "and not compressed, coalesced or bridged"
+        );
+        return false;
+    }
+    FileReaderPtr file(new FileReader());
+    if (!file->open(path)) {
+        ROS_WARN_STREAM(
+            "data channel '" << _label << "' cannot open '" <<
+            path << "' - " << strerror(errno)
+        );
+        return false;
+    }
+    if (id.empty())
+        id = generate_id();
+    size = file->size();
+    TransferPtr xfer(new Transfer(id, file, chunk_size()));
+    {
+        rtc::CritScope cs(&_send_cs);
+        if (_suspended.find(id) != _suspended.end())
+            return true;  // already waiting to resume
+        _send_queue.push_back(xfer);
+    }
+    _file_pub.publish(_file_message(*xfer, "queued"));
+    ROS_INFO_STREAM(
+        "data channel '" << _label << "' sending '" << path << "' " <<
+        "w/ id " << id << ", size " << size
+    );
+    _pump();
+    return true;
+}
+
+bool DataChannel::cancel_file(const std::string& id) {
+    TransferPtr xfer;
+    {
+        rtc::CritScope cs(&_send_cs);
+        auto suspended = _suspended.find(id);
+        if (suspended != _suspended.end()) {
+            xfer = (*suspended).second;
+            _suspended.erase(suspended);
+        } else {
+            for (auto i = _send_queue.begin(); i != _send_queue.end(); i++) {
+                if ((*i)->is_file() && (*i)->id == id) {
+                    // chunks already sent are left for the remote peer to expire
+                    xfer = *i;
+                    _send_queue.erase(i);
+                    break;
+                }
+            }
+        }
+    }
+    if (!xfer)
+        return false;
+    _file_pub.publish(_file_message(*xfer, "cancelled"));
+    return true;
+}
+
+ros_webrtc::FileTransfer DataChannel::_file_message(const Transfer& xfer, const std::string& state) const {
+    ros_webrtc::FileTransfer msg;
+    msg.label = _label;
+    msg.id = xfer.id;
+    msg.path = xfer.file->path();
+    msg.size = xfer.length;
+    msg.sent = xfer.length - xfer.remaining();
+    msg.state = state;
+    return msg;
+}
+
+void DataChannel::stalled(bool stalled) {
+    rtc::CritScope cs(&_send_cs);
+    if (stalled && _stalled_at.isZero()) {
+        _stalled_at = ros::WallTime::now();
+    } else if (!stalled && !_stalled_at.isZero()) {
+        _stall_time += ros::WallTime::now() - _stalled_at;
+        _stalled_at = ros::WallTime();
     }
 }
 
 DataChannel::operator ros_webrtc::DataChannel () const {
     ros_webrtc::DataChannel dst;
-    dst.label = _provider->label();
+    dst.label = _label;
     dst.id = _provider->id();
     dst.reliable = _provider->reliable();
     dst.ordered = _provider->ordered();
     dst.protocol = _provider->protocol();
+    // unset limits are reported by the provider as uint16 -1
+    dst.max_retransmits = _provider->maxRetransmits() == 0xffff ? -1 : _provider->maxRetransmits();
+    dst.max_packet_life_time = _provider->maxRetransmitTime() == 0xffff ? -1 : _provider->maxRetransmitTime();
+    dst.negotiated = _provider->negotiated();
+    dst.priority = priority_name(priority());
     dst.chunk_size = chunk_size();
     dst.state = _provider->state();
+    dst.buffered_amount = _provider->buffered_amount();
+    {
+        rtc::CritScope cs(&_send_cs);
+        dst.send_queue_size = _send_queue.size();
+        dst.send_queue_bytes = _send_queue_bytes;
+        ros::WallDuration stall_time = _stall_time;
+        if (!_stalled_at.isZero())
+            stall_time += ros::WallTime::now() - _stalled_at;
+        dst.send_stall_time = stall_time.toSec();
+        dst.send_superseded = _superseded;
+    }
+    {
+        rtc::CritScope cs(&_coalesce_cs);
+        dst.coalesced_messages = _coalesced_messages;
+        dst.coalesced_frames = _coalesced_frames;
+    }
+    _data_observer->stats(dst);
     return dst;
 }
 
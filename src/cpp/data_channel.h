@@ -1,44 +1,366 @@
 #ifndef ROS_WEBRTC_DATA_CHANNEL_H_
 #define ROS_WEBRTC_DATA_CHANNEL_H_
 
+#include <atomic>
+#include <deque>
+#include <unordered_map>
+
 #include <ros/ros.h>
 #include <ros_webrtc/Data.h>
 #include <ros_webrtc/DataChannel.h>
+#include <ros_webrtc/FileTransfer.h>
 #include <webrtc/api/datachannelinterface.h>
+#include <webrtc/base/criticalsection.h>
 #include <webrtc/base/scoped_ref_ptr.h>
 
+#include "bridge.h"
+#include "coalesced_frame.h"
+#include "compression.h"
+#include "file_transfer.h"
 #include "media_type.h"
 #include "renderer.h"
+#include "resume_store.h"
+#include "send_scheduler.h"
+
+/**
+ * \brief Limits applied to data channel send queues.
+ */
+struct DataChannelLimits {
+
+    DataChannelLimits();
+
+    size_t send_high_watermark; /*! Stop handing data to the provider once its buffered amount reaches this, summed across a peer connection's channels if scheduled. */
+
+    size_t send_low_watermark; /*! Resume handing data to the provider once its buffered amount drains to this. */
+
+    double send_bandwidth_limit; /*! Bytes per second sent across a peer connection's scheduled channels, or 0 for no limit. */
+
+    size_t send_queue_limit; /*! Reject sends once this many bytes are queued, or 0 for no limit. */
+
+    double reassembly_expiry; /*! Seconds after which partially received messages are discarded. */
+
+    size_t reassembly_channel_limit; /*! Bytes of partially received messages per channel, or 0 for no limit. */
+
+    size_t reassembly_limit; /*! Bytes of partially received messages across channels, or 0 for no limit. */
+
+    ChunkedMessageBudgetPtr reassembly_budget; /*! Tracks reassembly_limit, shared by channels using these limits. */
+
+    size_t reassembly_spill_threshold; /*! Reassemble messages larger than this in a file, or 0 to never. */
+
+    std::string reassembly_spill_dir; /*! Directory reassembly spill files are created in. */
+
+    size_t reassembly_spill_limit; /*! Bytes of messages being spilled across channels, or 0 for no limit. */
+
+    ChunkedMessageBudgetPtr reassembly_spill_budget; /*! Tracks reassembly_spill_limit, shared by channels using these limits. */
+
+    size_t resume_limit; /*! Bytes of partially received messages kept across closed channels, or 0 for no limit. */
+
+    ResumeStorePtr resume_store; /*! Transfers of closed channels, resumed by the next channel w/ the same peer and label, if set. */
+
+};
+
+/**
+ * \brief A message compressed and chunked once, so it can be queued on many channels.
+ */
+struct EncodedData {
+
+    std::string id; /*! Id of the chunked message, or empty if not chunked. */
+
+    uint64_t length; /*! Bytes, once compressed. */
+
+    size_t chunk_size;
+
+    bool binary;
+
+    std::vector<rtc::CopyOnWriteBuffer> buffers; /*! Handed to each channel's provider in order. */
+
+};
+
+typedef boost::shared_ptr<const EncodedData> EncodedDataConstPtr;
 
-class DataChannel {
+class DataChannel : public SendScheduler::Queue {
 
 public:
 
+    /**
+     * \brief Relative importance of data channel sends.
+     * \link https://www.w3.org/TR/webrtc-priority/
+     */
+    enum Priority {
+        VeryLow = 0,
+        Low,
+        Medium,
+        High,
+    };
+
+    /**
+     * \brief Parses a priority from its name (e.g. "very-low").
+     * \return Whether value named a priority.
+     */
+    static bool parse_priority(const std::string& value, Priority& priority);
+
+    static std::string priority_name(Priority priority);
+
+    /**
+     * \brief Adapts a data channel to ROS.
+     * \param nh Node handle used to advertise and subscribe.
+     * \param recv_topic Topic on which messages received from the remote peer are published.
+     * \param send_topic Topic subscribed to for messages to send to the remote peer.
+     * \param provider The WebRTC data channel.
+     * \param media_type Media type parsed from the channel protocol.
+     * \param limits Limits applied to send queue and reassembly.
+     * \param queue_size Size of publisher and subscriber queues.
+     */
     DataChannel(
         ros::NodeHandle &nh,
         const std::string& recv_topic,
+        const std::string& send_topic,
         webrtc::DataChannelInterface *provider,
         const MediaType& media_type,
+        const DataChannelLimits& limits=DataChannelLimits(),
         size_t queue_size=1000);
 
-    void send(const ros_webrtc::Data& msg);
+    ~DataChannel();
+
+    /**
+     * \brief Queues a message to be sent to the remote peer.
+     * \param msg The message.
+     * \return Whether the message was queued.
+     *
+     * Queued messages are handed to the provider as its buffered amount
+     * allows, so this returns without waiting for the transfer to complete.
+     */
+    bool send(const ros_webrtc::Data& msg);
+
+    /**
+     * \brief Queues a message to be sent to the remote peer.
+     * \param data_buffer The message.
+     * \param key If conflating, an unsent message w/ the same key is replaced by this one.
+     * \return Whether the message was queued.
+     */
+    bool send(webrtc::DataBuffer& data_buffer, const std::string& key=std::string());
+
+    /**
+     * \brief Compresses and chunks a message once for all channels w/ this protocol.
+     * \param data_buffer The message.
+     * \param encoded Set to the encoded message.
+     * \return Whether the message was encoded, which coalescing channels do not do up front.
+     */
+    bool encode(const webrtc::DataBuffer& data_buffer, EncodedDataConstPtr& encoded);
+
+    /**
+     * \brief Queues a message encoded by a channel w/ the same protocol.
+     * \param encoded The message, shared w/ other channels.
+     * \param key If conflating, an unsent message w/ the same key is replaced by this one.
+     * \return Whether the message was queued.
+     */
+    bool send(const EncodedDataConstPtr& encoded, const std::string& key=std::string());
+
+    /**
+     * \brief Queues a file to be sent to the remote peer as a chunked message.
+     * \param path Path of the file.
+     * \param id Id of the transfer, generated if empty.
+     * \param size Set to the size of the file.
+     * \return Whether the file was queued.
+     *
+     * Each chunk is read from the file only as it is handed to the provider,
+     * so memory use does not depend on the file size. Progress is published
+     * as ros_webrtc::FileTransfer messages.
+     */
+    bool send_file(const std::string& path, std::string& id, uint64_t& size);
+
+    /**
+     * \brief Stops sending a file.
+     * \param id Id of the transfer.
+     * \return Whether the file was still being sent.
+     */
+    bool cancel_file(const std::string& id);
+
+    /**
+     * \brief Forwards a local topic to the remote peer, if this channel bridges topics.
+     * \param topic The topic.
+     * \param queue_size Size of the subscriber queue.
+     * \return Whether the topic is being forwarded.
+     */
+    bool bridge(const std::string& topic, uint32_t queue_size);
+
+    bool is_bridge() const;
 
-    void send(webrtc::DataBuffer& data_buffer);
+    bool is_compressed() const;
+
+    /**
+     * \brief Whether small messages are packed together before being sent.
+     */
+    bool is_coalesced() const;
+
+    /**
+     * \brief Size at which a frame of coalesced messages is sent, or 0 if not coalescing.
+     */
+    size_t coalesce_size() const;
+
+    /**
+     * \brief Whether messages w/ a key replace unsent ones w/ the same key once the send queue backs up.
+     */
+    bool is_conflated() const;
+
+    /**
+     * \brief Queued bytes above which messages are conflated.
+     */
+    size_t conflate_watermark() const;
+
+    Priority priority() const;
+
+    void set_priority(Priority priority);
+
+    /**
+     * \brief Share of sends relative to other channels of the same priority.
+     */
+    size_t weight() const;
+
+    /**
+     * \brief Hands sends to a scheduler rather than straight to the provider.
+     * \param scheduler Scheduler this channel was added to.
+     */
+    void schedule(const SendSchedulerPtr& scheduler);
+
+    /**
+     * \brief Takes over transfers suspended when a previous channel w/ this label to the peer closed.
+     * \param peer_id Id of the remote peer.
+     *
+     * Suspended files are offered to the remote peer once the channel is
+     * open, and only the chunks it does not already have are sent again.
+     */
+    void adopt(const std::string& peer_id);
 
     bool is_chunked() const;
 
     size_t chunk_size() const;
 
+    /**
+     * \brief Protocol of the provider, which determines how messages are encoded.
+     */
+    std::string protocol() const;
+
     operator ros_webrtc::DataChannel () const;
 
     size_t reap();
 
 private:
 
+    struct Transfer;
+
+    typedef boost::shared_ptr<Transfer> TransferPtr;
+
+    void _on_send(const ros_webrtc::Data::ConstPtr& msg);
+
+    bool _on_recv(ros_webrtc::Data& msg);
+
+    void _dispatch(ros_webrtc::Data& msg);
+
+    bool _coalesce(const webrtc::DataBuffer& data_buffer);
+
+    bool _flush_coalesced();
+
+    void _on_coalesce_timer(const ros::WallTimerEvent& event);
+
+    bool _enqueue(webrtc::DataBuffer& data_buffer, const std::string& key=std::string());
+
+    webrtc::DataBuffer _compress(const webrtc::DataBuffer& data_buffer);
+
+    bool _push(const webrtc::DataBuffer& data_buffer, const std::string& key);
+
+    bool _push(const Transfer& xfer);
+
+    void _on_drain();
+
+    void _pump();
+
+    void _drain();
+
+    void _discard();
+
+    void _offer();
+
+    void _on_resume(const std::string& id, size_t total, const ChunkedMessage::Ranges& have);
+
+    // SendScheduler::Queue
+
+    bool head(size_t& size);
+
+    bool send_head(uint64_t& buffered_amount);
+
+    void stalled(bool stalled);
+
+    /**
+     * \brief Progress of a file transfer, built under the send lock but
+     * published after releasing it.
+     */
+    ros_webrtc::FileTransfer _file_message(const Transfer& xfer, const std::string& state) const;
+
     rtc::scoped_refptr<webrtc::DataChannelInterface> _provider;
+
+    std::string _label; /*! Of the provider, cached since asking it blocks on the signaling thread. */
+
     MediaType _media_type;
+
+    DataChannelLimits _limits;
+
+    std::atomic<int> _priority;
+
+    std::atomic<int> _state; /*! Provider state, as of its last state change. */
+
+    SendSchedulerPtr _scheduler;
+
+    rtc::CriticalSection _send_cs;
+
+    std::deque<TransferPtr> _send_queue;
+
+    size_t _send_queue_bytes;
+
+    std::unordered_map<std::string, TransferPtr> _send_keys; /*! Unsent transfers by conflation key. */
+
+    uint64_t _superseded;
+
+    ros::WallTime _stalled_at;
+
+    ros::WallDuration _stall_time;
+
+    std::atomic<bool> _pumping;
+
+    std::atomic<bool> _pump_requested;
+
+    rtc::CriticalSection _coalesce_cs;
+
+    CoalescedFrame _coalesced;
+
+    uint64_t _coalesced_messages;
+
+    uint64_t _coalesced_frames;
+
+    ros::WallDuration _coalesce_delay;
+
+    ros::WallTimer _coalesce_timer;
+
+    std::atomic<bool> _coalesce_armed;
+
+    rtc::CriticalSection _compress_cs;
+
+    CompressionPtr _compression;
+
     DataObserverPtr _data_observer;
 
+    TopicBridgePtr _bridge;
+
+    ros::Subscriber _send_sub;
+
+    ros::Publisher _file_pub;
+
+    std::string _resume_key; /*! Set if transfers are suspended when closed. */
+
+    std::unordered_map<std::string, TransferPtr> _suspended; /*! Adopted files waiting for the remote peer to say what it has. */
+
+    std::atomic<bool> _offered;
+
 };
 
 typedef boost::shared_ptr<DataChannel> DataChannelPtr;
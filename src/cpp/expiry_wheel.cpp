@@ -0,0 +1,80 @@
+#include "expiry_wheel.h"
+
+#include <algorithm>
+#include <cmath>
+
+// ExpiryWheel::Handle
+
+ExpiryWheel::Handle::Handle() : slot(0), valid(false) {
+}
+
+bool ExpiryWheel::Handle::is_valid() const {
+    return valid;
+}
+
+// ExpiryWheel
+
+ExpiryWheel::ExpiryWheel(double resolution, size_t slots) :
+    _resolution(resolution),
+    _slots(std::max<size_t>(slots, 1)),
+    _current(0),
+    _started(false),
+    _size(0) {
+}
+
+ExpiryWheel::Handle ExpiryWheel::add(const std::string& id, double deadline) {
+    int64_t tick = _tick(deadline);
+    if (!_started) {
+        _current = tick;
+        _started = true;
+    }
+    tick = std::max(tick, _current);
+    Handle handle;
+    handle.slot = tick % _slots.size();
+    Entry entry = {id, tick};
+    handle.entry = _slots[handle.slot].insert(_slots[handle.slot].end(), entry);
+    handle.valid = true;
+    _size += 1;
+    return handle;
+}
+
+void ExpiryWheel::remove(Handle& handle) {
+    if (!handle.valid)
+        return;
+    _slots[handle.slot].erase(handle.entry);
+    handle.valid = false;
+    _size -= 1;
+}
+
+void ExpiryWheel::advance(double now, std::vector<std::string>& expired) {
+    int64_t target = _tick(now);
+    if (!_started) {
+        _current = target;
+        _started = true;
+        return;
+    }
+    // every slot is visited at most once, covering all ticks before target
+    int64_t steps = std::min<int64_t>(target - _current, _slots.size());
+    for (int64_t i = 0; i < steps; i++) {
+        Slot& slot = _slots[(_current + i) % _slots.size()];
+        Slot::iterator j = slot.begin();
+        while (j != slot.end()) {
+            if ((*j).tick < target) {
+                expired.push_back((*j).id);
+                j = slot.erase(j);
+                _size -= 1;
+            } else {
+                j++;
+            }
+        }
+    }
+    _current = std::max(_current, target);
+}
+
+size_t ExpiryWheel::size() const {
+    return _size;
+}
+
+int64_t ExpiryWheel::_tick(double time) const {
+    return static_cast<int64_t>(std::floor(time / _resolution));
+}
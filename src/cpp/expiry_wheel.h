@@ -0,0 +1,91 @@
+#ifndef ROS_WEBRTC_EXPIRY_WHEEL_H_
+#define ROS_WEBRTC_EXPIRY_WHEEL_H_
+
+#include <stdint.h>
+
+#include <list>
+#include <string>
+#include <vector>
+
+/**
+ * \brief Hashed timing wheel used to expire ids by deadline.
+ *
+ * Deadlines are bucketed into slots of resolution seconds, so advancing only
+ * visits the slots whose time has passed rather than every pending id.
+ */
+class ExpiryWheel {
+
+private:
+
+    struct Entry {
+
+        std::string id;
+
+        int64_t tick;
+
+    };
+
+    typedef std::list<Entry> Slot;
+
+public:
+
+    /**
+     * \brief Identifies a scheduled id so it can be removed in O(1).
+     */
+    struct Handle {
+
+        Handle();
+
+        bool is_valid() const;
+
+        size_t slot;
+
+        Slot::iterator entry;
+
+        bool valid;
+
+    };
+
+    /**
+     * \brief Creates an empty wheel.
+     * \param resolution Seconds covered by each slot.
+     * \param slots Number of slots, deadlines further out wrap around.
+     */
+    ExpiryWheel(double resolution=1.0, size_t slots=256);
+
+    /**
+     * \brief Schedules an id to expire.
+     * \param id The id.
+     * \param deadline Time in seconds at which it expires.
+     * \return Handle used to remove it.
+     */
+    Handle add(const std::string& id, double deadline);
+
+    void remove(Handle& handle);
+
+    /**
+     * \brief Expires ids whose deadline slot has passed.
+     * \param now Current time in seconds.
+     * \param expired Expired ids are appended to this.
+     */
+    void advance(double now, std::vector<std::string>& expired);
+
+    size_t size() const;
+
+private:
+
+    int64_t _tick(double time) const;
+
+    double _resolution;
+
+    std::vector<Slot> _slots;
+
+    int64_t _current;
+
+    bool _started;
+
+    size_t _size;
+
+};
+
+#endif /* ROS_WEBRTC_EXPIRY_WHEEL_H_ */
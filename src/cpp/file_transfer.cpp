@@ -0,0 +1,96 @@
+#include "file_transfer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace {
+
+struct Crc32Table {
+
+    Crc32Table() {
+        for (uint32_t i = 0; i != 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k != 8; k++)
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            values[i] = c;
+        }
+    }
+
+    uint32_t values[256];
+
+};
+
+const Crc32Table crc32_table;
+
+}
+
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc) {
+    crc = ~crc;
+    for (size_t i = 0; i != size; i++)
+        crc = crc32_table.values[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+// FileReader
+
+FileReader::FileReader() : _fd(-1), _size(0) {
+}
+
+FileReader::~FileReader() {
+    close();
+}
+
+bool FileReader::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+    // read front to back, once
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    _fd = fd;
+    _path = path;
+    _size = st.st_size;
+    return true;
+}
+
+bool FileReader::is_open() const {
+    return _fd >= 0;
+}
+
+void FileReader::close() {
+    if (_fd >= 0) {
+        ::close(_fd);
+        _fd = -1;
+    }
+}
+
+const std::string& FileReader::path() const {
+    return _path;
+}
+
+uint64_t FileReader::size() const {
+    return _size;
+}
+
+bool FileReader::read(uint64_t offset, size_t size, std::vector<uint8_t>& dst) {
+    if (_fd < 0 || offset > _size || size > _size - offset)
+        return false;
+    dst.resize(size);
+    size_t done = 0;
+    while (done != size) {
+        ssize_t n = pread(_fd, dst.data() + done, size - done, offset + done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;  // error, or truncated since opened
+        done += n;
+    }
+    return true;
+}
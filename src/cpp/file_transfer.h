@@ -0,0 +1,74 @@
+#ifndef ROS_WEBRTC_FILE_TRANSFER_H_
+#define ROS_WEBRTC_FILE_TRANSFER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+/**
+ * \brief Computes a CRC-32 (IEEE 802.3), continuing from a previous one.
+ * \param data Bytes to checksum.
+ * \param size Number of bytes.
+ * \param crc CRC-32 of the preceding bytes, or 0 if none.
+ * \return CRC-32 of the preceding bytes and these.
+ */
+uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc=0);
+
+/**
+ * \brief Reads a file a piece at a time, so it is never all in memory.
+ */
+class FileReader {
+
+public:
+
+    FileReader();
+
+    ~FileReader();
+
+    /**
+     * \brief Opens a regular file for reading.
+     * \return Whether the file was opened.
+     */
+    bool open(const std::string& path);
+
+    bool is_open() const;
+
+    void close();
+
+    const std::string& path() const;
+
+    /**
+     * \brief Size of the file when it was opened.
+     */
+    uint64_t size() const;
+
+    /**
+     * \brief Reads bytes, which must all be within the file.
+     * \param offset Offset of the first byte to read.
+     * \param size Number of bytes to read.
+     * \param dst Resized to and receives the bytes.
+     * \return Whether all bytes were read.
+     */
+    bool read(uint64_t offset, size_t size, std::vector<uint8_t>& dst);
+
+private:
+
+    FileReader(const FileReader&);
+
+    FileReader& operator=(const FileReader&);
+
+    int _fd;
+
+    std::string _path;
+
+    uint64_t _size;
+
+};
+
+typedef boost::shared_ptr<FileReader> FileReaderPtr;
+
+#endif /* ROS_WEBRTC_FILE_TRANSFER_H_ */
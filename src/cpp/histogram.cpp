@@ -0,0 +1,60 @@
+#include "histogram.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Histogram
+
+std::vector<double> Histogram::latency_bounds() {
+    std::vector<double> bounds;
+    for (double scale = 0.001; scale < 10; scale *= 10) {
+        bounds.push_back(1 * scale);
+        bounds.push_back(2 * scale);
+        bounds.push_back(5 * scale);
+    }
+    bounds.push_back(10);
+    return bounds;
+}
+
+Histogram::Histogram(const std::vector<double>& bounds) :
+    _bounds(bounds),
+    _counts(bounds.size() + 1, 0),
+    _count(0),
+    _max(0) {
+}
+
+void Histogram::add(double value) {
+    size_t i = std::lower_bound(_bounds.begin(), _bounds.end(), value) - _bounds.begin();
+    _counts[i]++;
+    _max = _count == 0 ? value : std::max(_max, value);
+    _count++;
+}
+
+const std::vector<double>& Histogram::bounds() const {
+    return _bounds;
+}
+
+const std::vector<uint64_t>& Histogram::counts() const {
+    return _counts;
+}
+
+uint64_t Histogram::count() const {
+    return _count;
+}
+
+double Histogram::max() const {
+    return _max;
+}
+
+double Histogram::quantile(double q) const {
+    if (_count == 0)
+        return 0;
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(q * _count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i != _bounds.size(); i++) {
+        seen += _counts[i];
+        if (seen >= rank)
+            return _bounds[i];
+    }
+    return _max;
+}
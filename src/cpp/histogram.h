@@ -0,0 +1,57 @@
+#ifndef ROS_WEBRTC_HISTOGRAM_H_
+#define ROS_WEBRTC_HISTOGRAM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * \brief Counts values into buckets w/ fixed upper bounds.
+ */
+class Histogram {
+
+public:
+
+    /**
+     * \brief Bounds from 1 ms to 10 s in 1-2-5 steps, for latencies in seconds.
+     */
+    static std::vector<double> latency_bounds();
+
+    /**
+     * \param bounds Ascending upper bound of each bucket, values above the last go in an extra unbounded bucket.
+     */
+    Histogram(const std::vector<double>& bounds);
+
+    void add(double value);
+
+    const std::vector<double>& bounds() const;
+
+    /**
+     * \brief Count of each bucket, one more than there are bounds.
+     */
+    const std::vector<uint64_t>& counts() const;
+
+    uint64_t count() const;
+
+    double max() const;
+
+    /**
+     * \brief Upper bound of the bucket containing a quantile, or max() if in the unbounded one.
+     * \param q Quantile in [0, 1].
+     */
+    double quantile(double q) const;
+
+private:
+
+    std::vector<double> _bounds;
+
+    std::vector<uint64_t> _counts;
+
+    uint64_t _count;
+
+    double _max;
+
+};
+
+#endif /* ROS_WEBRTC_HISTOGRAM_H_ */
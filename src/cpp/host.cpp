@@ -8,13 +8,20 @@
 #include "host.h"
 #include "util.h"
 
+namespace {
+
+// establish_session wait for a local description, unless the request has one
+const double ESTABLISH_SESSION_TIMEOUT = 10.0;
+
+}
 
 // VideoSource
 
 VideoSource::VideoSource() :
     type(NameType),
     publish(false),
-    rotation(0) {
+    rotation(0),
+    temporal_layers(1) {
 }
 
 VideoSource::VideoSource(
@@ -29,7 +36,8 @@ VideoSource::VideoSource(
     label(label),
     constraints(constraints),
     publish(publish),
-    rotation(rotation) {
+    rotation(rotation),
+    temporal_layers(1) {
 }
 
 // AudioSource
@@ -62,6 +70,14 @@ QueueSizes::QueueSizes(uint32_t video, uint32_t audio, uint32_t data, uint32_t e
     event(event) {
 }
 
+// HostThreads
+
+HostThreads::HostThreads() :
+    sessions(4),
+    callbacks(2),
+    callback_timeout(30) {
+}
+
 // Host
 
 Host::Host(
@@ -72,7 +88,13 @@ Host::Host(
     double pc_bond_connect_timeout,
     double pc_bond_heartbeat_timeout,
     const std::vector<webrtc::PeerConnectionInterface::IceServer>& default_ice_servers,
-    const QueueSizes& queue_sizes) :
+    const QueueSizes& queue_sizes,
+    const DataChannelLimits& dc_limits,
+    const HostThreads& threads,
+    const PeerConnectionPoolSizes& pool_sizes,
+    const CertificateSettings& certificate_settings,
+    const IceRestartPolicy& ice_restart,
+    bool shared_video_encoders) :
     _nh(nh),
     _video_srcs(video_srcs),
     _video_capture_modules(new VideoCaptureModuleRegistry()),
@@ -83,8 +105,24 @@ Host::Host(
     _default_ice_servers(default_ice_servers),
     _ice_servers(default_ice_servers),
     _queue_sizes(queue_sizes),
+    _dc_limits(dc_limits),
+    _threads(threads),
+    _pool_sizes(pool_sizes),
+    _certificate_settings(certificate_settings),
+    _ice_restart(ice_restart),
+    _shared_video_encoders(shared_video_encoders),
+    _creating(0),
     _srv(*this),
     _auto_close_media(false) {
+    _dc_limits.reassembly_budget.reset(
+        new ChunkedMessageBudget(_dc_limits.reassembly_limit)
+    );
+    _dc_limits.reassembly_spill_budget.reset(
+        new ChunkedMessageBudget(_dc_limits.reassembly_spill_limit)
+    );
+    _dc_limits.resume_store.reset(
+        new ResumeStore(_dc_limits.reassembly_expiry, _dc_limits.resume_limit)
+    );
 }
 
 Host::Host(const Host& other) :
@@ -97,6 +135,13 @@ Host::Host(const Host& other) :
     _default_ice_servers(other._default_ice_servers),
     _ice_servers(other._ice_servers),
     _queue_sizes(other._queue_sizes),
+    _dc_limits(other._dc_limits),
+    _threads(other._threads),
+    _pool_sizes(other._pool_sizes),
+    _certificate_settings(other._certificate_settings),
+    _ice_restart(other._ice_restart),
+    _shared_video_encoders(other._shared_video_encoders),
+    _creating(0),
     _srv(*this),
     _auto_close_media(false) {
 }
@@ -119,6 +164,25 @@ bool Host::open(bool media) {
     } else {
         ROS_DEBUG_STREAM("deferring media sources");
     }
+    ros::NodeHandle data_nh(_nh);
+    data_nh.setCallbackQueue(&_data_queue);
+    _scheduler.reset(new SendScheduler(data_nh));
+    _data_spinner.reset(new ros::AsyncSpinner(1, &_data_queue));
+    _data_spinner->start();
+    _session_queues.reset(new SessionQueues(_threads.sessions));
+    _dispatcher.reset(new CallbackDispatcher(_nh, _threads.callbacks, _threads.callback_timeout));
+    _session_queues->start();
+    if (_certificate_settings.count != 0) {
+        _certificates.reset(new CertificateStore(_certificate_settings));
+        if (!_certificates->open())
+            _certificates.reset();
+    }
+    if (_pool_sizes.connections != 0) {
+        ROS_INFO_STREAM("pooling " << _pool_sizes.connections << " peer connection(s)");
+        _pc_pool.reset(new PeerConnectionPool(_pc_factory, _pc_constraints, _pool_sizes, _certificates));
+        rtc::CritScope cs(&_cs);
+        _pc_pool->start(_ice_servers);
+    }
     _srv.advertise();
     return true;
 }
@@ -128,6 +192,18 @@ bool Host::is_open() const {
 }
 
 void Host::close() {
+    if (_session_queues) {
+        _session_queues->stop();
+        _session_queues.reset();
+    }
+    if (_data_spinner) {
+        _data_spinner->stop();
+        _data_spinner.reset();
+    }
+    _scheduler.reset();
+    _dispatcher.reset();
+    _pc_pool.reset();
+    _certificates.reset();
     _close_media();
     _pc_factory = NULL;
     _worker_thd.reset();
@@ -141,21 +217,29 @@ PeerConnectionPtr Host::create_peer_connection(
     const std::string& peer_id,
     const MediaConstraints& sdp_constraints,
     const std::vector<std::string>& audio_sources,
-    const std::vector<std::string>& video_sources) {
+    const std::vector<std::string>& video_sources,
+    const webrtc::PeerConnectionInterface::IceServers& extra_ice_servers) {
     ROS_INFO(
         "creating peer connection id='%s', peer='%s' for node='%s'",
         session_id.c_str(), peer_id.c_str(), node_name.c_str()
     );
 
-    if (!_is_media_open()) {
-        _open_media();
-        _auto_close_media = true;
+    // media stays open until this is registered, see delete_peer_connection
+    {
+        rtc::CritScope cs(&_media_cs);
+        if (!_is_media_open()) {
+            _open_media();
+            _auto_close_media = true;
+        }
+        _creating++;
     }
 
     // key
     PeerConnectionKey key = {session_id, peer_id};
-    if (_pcs.find(key) != _pcs.end()) {
+    if (_find_peer_connection(key) != NULL) {
         ROS_ERROR("peer connection w/ id='%s', peer='%s' already exists", session_id.c_str(), peer_id.c_str());
+        rtc::CritScope cs(&_media_cs);
+        _creating--;
         return PeerConnectionPtr();
     }
 
@@ -180,7 +264,7 @@ PeerConnectionPtr Host::create_peer_connection(
             if (*(j) == video_src.label || *(j) == "*") {
                 video_srcs.push_back(PeerConnection::VideoSource(
                     video_src.label,
-                    video_src.interface,
+                    video_src.layer_chain ? video_src.layer_chain->layer(0) : video_src.interface,
                     video_src.publish
                 ));
                 break;
@@ -188,6 +272,23 @@ PeerConnectionPtr Host::create_peer_connection(
         }
     }
 
+    std::vector<webrtc::PeerConnectionInterface::IceServer> ice_servers;
+    {
+        rtc::CritScope cs(&_cs);
+        ice_servers = _ice_servers;
+    }
+    ice_servers.insert(ice_servers.end(), extra_ice_servers.begin(), extra_ice_servers.end());
+
+    webrtc::PeerConnectionInterface::RTCConfiguration rtc_conf;
+    rtc_conf.servers = ice_servers;
+    if (_certificates)
+        rtc_conf.certificates = _certificates->next();
+
+    // pre-created w/ the same servers, if any
+    WarmPeerConnectionPtr warm;
+    if (_pc_pool)
+        warm = _pc_pool->claim(ice_servers);
+
     // create it
     PeerConnectionPtr pc(new PeerConnection(
         node_name,
@@ -195,8 +296,14 @@ PeerConnectionPtr Host::create_peer_connection(
         peer_id,
         sdp_constraints,
         _queue_sizes,
+        _dc_limits,
         _pc_bond_connect_timeout,
-        _pc_bond_heartbeat_timeout
+        _pc_bond_heartbeat_timeout,
+        &_data_queue,
+        _scheduler,
+        _dispatcher,
+        _ice_restart,
+        _session_queues ? &_session_queues->queue(session_id, peer_id) : NULL
     ));
 
     // and start it
@@ -204,31 +311,50 @@ PeerConnectionPtr Host::create_peer_connection(
     if (!pc->begin(
         _pc_factory,
         &_pc_constraints,
-        _ice_servers,
+        rtc_conf,
         audio_srcs,
         video_srcs,
-        pc_observer)) {
+        pc_observer,
+        warm)) {
+        rtc::CritScope cs(&_media_cs);
+        _creating--;
         return PeerConnectionPtr();
     }
 
     // register it w/ key
-    _pcs[key] = pc;
+    {
+        rtc::CritScope cs(&_cs);
+        _pcs[key] = pc;
+    }
+    rtc::CritScope cs(&_media_cs);
+    _creating--;
     return pc;
 }
 
 bool Host::delete_peer_connection(const std::string& session_id, const std::string& peer_id) {
     PeerConnectionKey key = {session_id, peer_id};
-    auto i = _pcs.find(key);
-    if (i == _pcs.end()) {
+    PeerConnectionPtr pc;
+    {
+        rtc::CritScope cs(&_cs);
+        auto i = _pcs.find(key);
+        if (i != _pcs.end()) {
+            pc = (*i).second;
+            _pcs.erase(i);
+        }
+    }
+    if (pc == NULL) {
         ROS_INFO("no pc w/ session_id='%s' peer_id='%s'", session_id.c_str(), peer_id.c_str());
     } else {
         ROS_INFO("deleting pc w/ session_id='%s' peer_id='%s'", session_id.c_str(), peer_id.c_str());
-        PeerConnectionPtr pc = (*i).second;
-        _pcs.erase(i);
         pc->end();
-
     }
-    if (_pcs.empty() && _auto_close_media) {
+    rtc::CritScope media_cs(&_media_cs);
+    bool empty;
+    {
+        rtc::CritScope cs(&_cs);
+        empty = _pcs.empty();
+    }
+    if (empty && _creating == 0 && _auto_close_media) {
         _close_media();
     }
     return true;
@@ -236,17 +362,64 @@ bool Host::delete_peer_connection(const std::string& session_id, const std::stri
 
 Host::FlushStats Host::flush() {
     FlushStats flush;
-    for (auto i = _pcs.begin(); i != _pcs.end(); i++) {
+    Sessions pcs = _sessions();
+    for (auto i = pcs.begin(); i != pcs.end(); i++) {
         auto session_flush = (*i).second->flush();
         flush += session_flush;
     }
+    flush.reaped_data_messages += _dc_limits.resume_store->reap(ros::Time::now().toSec());
+    if (_certificates)
+        _certificates->rotate();
+    if (_dispatcher)
+        _dispatcher->publish();
     return flush;
 }
 
+void Host::broadcast(
+    const std::string& session_id,
+    const ros_webrtc::Data& msg,
+    std::vector<ros_webrtc::PeerConnectionKey>& sent) {
+    // one copy of the payload, referenced by every channel
+    webrtc::DataBuffer data_buffer(
+        rtc::CopyOnWriteBuffer(msg.buffer.data(), msg.buffer.size()),
+        msg.encoding == "binary"
+    );
+    std::map<std::string, EncodedDataConstPtr> encoded;  // by protocol
+    Sessions pcs = _sessions();
+    for (auto i = pcs.begin(); i != pcs.end(); i++) {
+        if (!session_id.empty() && (*i).first.session_id != session_id)
+            continue;
+        DataChannelPtr dc = (*i).second->data_channel(msg.label);
+        if (dc == NULL)
+            continue;
+        bool queued = false;
+        std::string protocol = dc->protocol();
+        auto j = encoded.find(protocol);
+        if (j != encoded.end()) {
+            queued = dc->send((*j).second, msg.key);
+        } else {
+            EncodedDataConstPtr encoding;
+            if (dc->encode(data_buffer, encoding)) {
+                encoded[protocol] = encoding;
+                queued = dc->send(encoding, msg.key);
+            } else {
+                queued = dc->send(data_buffer, msg.key);
+            }
+        }
+        if (queued) {
+            ros_webrtc::PeerConnectionKey key;
+            key.session_id = (*i).first.session_id;
+            key.peer_id = (*i).first.peer_id;
+            sent.push_back(key);
+        }
+    }
+}
+
 Host::ReapStats Host::reap(double stale_threshold) {
     ReapStats reap;
     double now = ros::Time::now().toSec();
-    for (auto i = _pcs.begin(); i != _pcs.end(); i++) {
+    Sessions pcs = _sessions();
+    for (auto i = pcs.begin(); i != pcs.end(); i++) {
         PeerConnectionPtr pc = (*i).second;
         if ((pc->is_connecting() || pc->is_disconnected()) &&
             now - pc->last_connection_state_change() > stale_threshold) {
@@ -256,10 +429,7 @@ Host::ReapStats Host::reap(double stale_threshold) {
                 "for deletion"
             );
             PeerConnectionKey key = {pc->session_id(), pc->peer_id()};
-            ros::CallbackInterfacePtr callback(
-                new Host::DeletePeerConnectionCallback(*this, key)
-            );
-            _nh.getCallbackQueue()->addCallback(callback);
+            _schedule_delete(key);
             reap.deleted_connections += 1;
         }
     }
@@ -292,12 +462,18 @@ bool Host::_create_pc_factory() {
     }
 
     ROS_INFO_STREAM("creating pc factory");
+    // factory takes ownership of the encoder factory
+    cricket::WebRtcVideoEncoderFactory* encoder_factory = NULL;
+    if (_shared_video_encoders) {
+        ROS_INFO_STREAM("sharing video encoders across peer connections");
+        encoder_factory = new SharedVideoEncoderFactory();
+    }
     _pc_factory =  webrtc::CreatePeerConnectionFactory(
         _network_thd.get(),
         _worker_thd.get(),
         _signaling_thd.get(),
         NULL,
-        NULL,
+        encoder_factory,
         NULL
     );
     if (!_pc_factory.get()) {
@@ -494,6 +670,20 @@ bool Host::_open_media() {
             video_src.capture_module->SetCaptureRotation(rotation);
         }
 
+        // layers
+        if (video_src.layers.size() > 1 || video_src.temporal_layers > 1) {
+            if (video_src.temporal_layers > 1 && !_shared_video_encoders) {
+                ROS_WARN_STREAM(
+                    "video src '" << video_src.name << "' temporal layers need shared_video_encoders"
+                );
+            }
+            video_src.layer_chain.reset(new VideoLayerChain(
+                video_src.layers.empty() ? std::vector<int>(1, 1) : video_src.layers,
+                video_src.temporal_layers
+            ));
+            video_src.layer_chain->attach(video_src.interface);
+        }
+
         // track
         std::string video_label = video_src.label;
         if (video_label.empty()) {
@@ -546,6 +736,10 @@ void Host::_close_media() {
             (*i).renderer->Close();
             (*i).renderer = NULL;
         }
+        if ((*i).layer_chain) {
+            (*i).layer_chain->detach();
+            (*i).layer_chain.reset();
+        }
         if ((*i).interface) {
             (*i).interface->Stop();
         }
@@ -555,6 +749,7 @@ void Host::_close_media() {
 }
 
 PeerConnectionPtr Host::_find_peer_connection(const PeerConnectionKey& key) {
+    rtc::CritScope cs(&_cs);
     auto i = _pcs.find(key);
     if (i == _pcs.end())
         return PeerConnectionPtr();
@@ -562,12 +757,27 @@ PeerConnectionPtr Host::_find_peer_connection(const PeerConnectionKey& key) {
 }
 
 PeerConnectionConstPtr Host::_find_peer_connection(const PeerConnectionKey& key) const {
+    rtc::CritScope cs(&_cs);
     auto i = _pcs.find(key);
     if (i == _pcs.end())
         return PeerConnectionConstPtr();
     return (*i).second;
 }
 
+Host::Sessions Host::_sessions() const {
+    rtc::CritScope cs(&_cs);
+    return _pcs;
+}
+
+void Host::_schedule_delete(const PeerConnectionKey& key) {
+    // behind anything else queued for it
+    ros::CallbackInterfacePtr callback(new Host::DeletePeerConnectionCallback(*this, key));
+    if (_session_queues)
+        _session_queues->queue(key.session_id, key.peer_id).addCallback(callback);
+    else
+        _nh.getCallbackQueue()->addCallback(callback);
+}
+
 // Host::Flush
 
 Host::FlushStats& Host::FlushStats::operator += (const PeerConnection::FlushStats & rhs) {
@@ -580,18 +790,62 @@ Host::FlushStats& Host::FlushStats::operator += (const PeerConnection::FlushStat
 Host::Service::Service(Host& instance) : _instance(instance) {
 }
 
+template<class Request, class Response>
+void Host::Service::_advertise_session(
+    const std::string& name,
+    bool (Service::*callback)(ros::ServiceEvent<Request, Response>& event)) {
+    typedef ros::ServiceEvent<Request, Response> Event;
+    boost::function<bool (Event&)> sharded = [this, callback](Event& event) {
+        const auto& req = event.getRequest();
+        return _instance._session_queues->call(
+            req.session_id,
+            req.peer_id,
+            [this, callback, &event]() { return (this->*callback)(event); }
+        );
+    };
+    _srvs.push_back(_instance._nh.advertiseService<Event>(name, sharded));
+}
+
+MediaConstraints Host::Service::_sdp_constraints(const ros_webrtc::MediaConstraints& msg) {
+    MediaConstraints sdp_constraints;
+    for(size_t i = 0; i != msg.mandatory.size(); i++) {
+        sdp_constraints.mandatory().push_back(MediaConstraints::Constraint(
+            msg.mandatory[i].key,
+            msg.mandatory[i].value
+        ));
+    }
+    for(size_t i = 0; i != msg.optional.size(); i++) {
+        sdp_constraints.optional().push_back(MediaConstraints::Constraint(
+            msg.optional[i].key,
+            msg.optional[i].value
+        ));
+    }
+    return sdp_constraints;
+}
+
+int Host::Service::_reliability_limit(bool is_set, int32_t value) {
+    return is_set && value >= 0 ? value : -1;
+}
+
 void Host::Service::advertise() {
-    _srvs.push_back(_instance._nh.advertiseService("add_ice_candidate", &Host::Service::add_ice_candidate, this));
-    _srvs.push_back(_instance._nh.advertiseService("create_data_channel", &Host::Service::create_data_channel, this));
-    _srvs.push_back(_instance._nh.advertiseService("create_offer", &Host::Service::create_offer, this));
-    _srvs.push_back(_instance._nh.advertiseService("create_peer_connection", &Host::Service::create_peer_connection, this));
-    _srvs.push_back(_instance._nh.advertiseService("delete_peer_connection", &Host::Service::delete_peer_connection, this));
+    _advertise_session("add_ice_candidate", &Host::Service::add_ice_candidate);
+    _advertise_session("add_ice_candidates", &Host::Service::add_ice_candidates);
+    _advertise_session("bridge_topic", &Host::Service::bridge_topic);
+    _srvs.push_back(_instance._nh.advertiseService("broadcast_data", &Host::Service::broadcast_data, this));
+    _advertise_session("cancel_file", &Host::Service::cancel_file);
+    _advertise_session("create_data_channel", &Host::Service::create_data_channel);
+    _advertise_session("create_offer", &Host::Service::create_offer);
+    _advertise_session("create_peer_connection", &Host::Service::create_peer_connection);
+    _advertise_session("delete_peer_connection", &Host::Service::delete_peer_connection);
+    _advertise_session("establish_session", &Host::Service::establish_session);
     _srvs.push_back(_instance._nh.advertiseService("get_host", &Host::Service::get_host, this));
-    _srvs.push_back(_instance._nh.advertiseService("get_peer_connection", &Host::Service::get_peer_connection, this));
-    _srvs.push_back(_instance._nh.advertiseService("send_data", &Host::Service::send_data, this));
+    _advertise_session("get_peer_connection", &Host::Service::get_peer_connection);
+    _advertise_session("send_data", &Host::Service::send_data);
+    _advertise_session("send_file", &Host::Service::send_file);
     _srvs.push_back(_instance._nh.advertiseService("set_ice_servers", &Host::Service::set_ice_servers, this));
-    _srvs.push_back(_instance._nh.advertiseService("set_remote_description", &Host::Service::set_remote_description, this));
+    _advertise_session("set_remote_description", &Host::Service::set_remote_description);
     _srvs.push_back(_instance._nh.advertiseService("rotate_video_source", &Host::Service::rotate_video_source, this));
+    _advertise_session("select_video_layer", &Host::Service::select_video_layer);
 }
 
 void Host::Service::shutdown() {
@@ -612,18 +866,120 @@ bool Host::Service::add_ice_candidate(ros::ServiceEvent<ros_webrtc::AddIceCandid
     return true;
 }
 
+bool Host::Service::add_ice_candidates(ros::ServiceEvent<ros_webrtc::AddIceCandidates::Request, ros_webrtc::AddIceCandidates::Response>& event) {
+    const auto& req = event.getRequest();
+    auto& resp = event.getResponse();
+    PeerConnectionKey key = {req.session_id, req.peer_id};
+    PeerConnectionPtr pc = _instance._find_peer_connection(key);
+    if (pc == NULL)
+        return false;
+    std::vector<PeerConnection::IceCandidatePtr> candidates;
+    candidates.reserve(req.candidates.size());
+    for (auto i = req.candidates.begin(); i != req.candidates.end(); i++) {
+        webrtc::SdpParseError error;
+        PeerConnection::IceCandidatePtr candidate(webrtc::CreateIceCandidate(
+            i->sdp_mid, i->sdp_mline_index, i->candidate, &error
+        ));
+        if (candidate == NULL) {
+            ROS_WARN_STREAM(
+                "pc ('" << key.session_id << "', '" << key.peer_id << "') " <<
+                "ice candidate '" << i->candidate << "' invalid - " << error.description
+            );
+            continue;
+        }
+        candidates.push_back(candidate);
+    }
+    // one hop to the signaling thread for the whole batch vs one per candidate
+    _instance._signaling_thd->Invoke<void>(RTC_FROM_HERE, [&pc, &candidates]() {
+        pc->add_ice_candidates(candidates);
+    });
+    resp.added = candidates.size();
+    return true;
+}
+
+bool Host::Service::bridge_topic(ros::ServiceEvent<ros_webrtc::BridgeTopic::Request, ros_webrtc::BridgeTopic::Response>& event) {
+    const auto& req = event.getRequest();
+    PeerConnectionKey key = {req.session_id, req.peer_id};
+    PeerConnectionPtr pc = _instance._find_peer_connection(key);
+    if (pc == NULL) {
+        ROS_INFO_STREAM(
+            "pc (" << key.session_id << "', '" << key.peer_id << "') " <<
+            "not found"
+        );
+        return false;
+    }
+    DataChannelPtr dc = pc->data_channel(req.label);
+    if (dc == NULL) {
+        ROS_INFO_STREAM(
+            "pc (" << key.session_id << "', '" << key.peer_id << "') " <<
+            "has no data channel w/ label " << req.label
+        );
+        return false;
+    }
+    uint32_t queue_size = req.queue_size == 0 ? 1 : req.queue_size;
+    if (!req.topic.empty() && !dc->bridge(req.topic, queue_size))
+        return false;
+    for (auto i = req.topics.begin(); i != req.topics.end(); i++) {
+        if (!dc->bridge(*i, queue_size))
+            return false;
+    }
+    return true;
+}
+
+bool Host::Service::broadcast_data(ros::ServiceEvent<ros_webrtc::BroadcastData::Request, ros_webrtc::BroadcastData::Response>& event) {
+    const auto& req = event.getRequest();
+    auto& resp = event.getResponse();
+    _instance.broadcast(req.session_id, req.data, resp.peer_connections);
+    ROS_DEBUG_STREAM(
+        "broadcast data w/ label '" << req.data.label << "' to " <<
+        resp.peer_connections.size() << " peer connection(s)"
+    );
+    return true;
+}
+
+bool Host::Service::cancel_file(ros::ServiceEvent<ros_webrtc::CancelFile::Request, ros_webrtc::CancelFile::Response>& event) {
+    const auto& req = event.getRequest();
+    PeerConnectionKey key = {req.session_id, req.peer_id};
+    PeerConnectionPtr pc = _instance._find_peer_connection(key);
+    if (pc == NULL) {
+        ROS_INFO_STREAM(
+            "pc (" << key.session_id << "', '" << key.peer_id << "') " <<
+            "not found"
+        );
+        return false;
+    }
+    DataChannelPtr dc = pc->data_channel(req.label);
+    if (dc == NULL) {
+        ROS_INFO_STREAM(
+            "pc (" << key.session_id << "', '" << key.peer_id << "') " <<
+            "has no data channel w/ label " << req.label
+        );
+        return false;
+    }
+    return dc->cancel_file(req.id);
+}
+
 bool Host::Service::create_data_channel(ros::ServiceEvent<ros_webrtc::CreateDataChannel::Request, ros_webrtc::CreateDataChannel::Response>& event) {
     const auto& req = event.getRequest();
     PeerConnectionKey key = {req.session_id, req.peer_id};
     PeerConnectionPtr pc= _instance._find_peer_connection(key);
     if (pc == NULL)
         return false;
+    DataChannel::Priority priority = DataChannel::Low;
+    if (!req.priority.empty() && !DataChannel::parse_priority(req.priority, priority)) {
+        ROS_WARN_STREAM("invalid data channel priority '" << req.priority << "'");
+        return false;
+    }
     return pc->create_data_channel(
         req.label,
         req.protocol,
         req.reliable,
         req.ordered,
-        req.id
+        req.id,
+        _reliability_limit(req.has_max_retransmits, req.max_retransmits),
+        _reliability_limit(req.has_max_packet_life_time, req.max_packet_life_time),
+        req.negotiated,
+        priority
     );
 }
 
@@ -641,32 +997,21 @@ bool Host::Service::create_offer(ros::ServiceEvent<ros_webrtc::CreateOffer::Requ
 bool Host::Service::create_peer_connection(ros::ServiceEvent<ros_webrtc::CreatePeerConnection::Request, ros_webrtc::CreatePeerConnection::Response>& event) {
     const auto &req = event.getRequest();
 
-    if (!_instance._is_media_open()) {
-        if (!_instance._open_media()) {
-            return false;
+    {
+        rtc::CritScope cs(&_instance._media_cs);
+        if (!_instance._is_media_open()) {
+            if (!_instance._open_media()) {
+                return false;
+            }
+            _instance._auto_close_media = true;
         }
-        _instance._auto_close_media = true;
-    }
-
-    MediaConstraints sdp_constraints;
-    for(size_t i = 0; i != req.sdp_constraints.mandatory.size(); i++) {
-        sdp_constraints.mandatory().push_back(MediaConstraints::Constraint(
-            req.sdp_constraints.mandatory[i].key,
-            req.sdp_constraints.mandatory[i].value
-        ));
-    }
-    for(size_t i = 0; i != req.sdp_constraints.optional.size(); i++) {
-        sdp_constraints.optional().push_back(MediaConstraints::Constraint(
-            req.sdp_constraints.optional[i].key,
-            req.sdp_constraints.optional[i].value
-        ));
     }
 
     PeerConnectionPtr pc(_instance.create_peer_connection(
         event.getCallerName(),
         req.session_id,
         req.peer_id,
-        sdp_constraints,
+        _sdp_constraints(req.sdp_constraints),
         req.audio_sources,
         req.video_sources
     ));
@@ -678,6 +1023,90 @@ bool Host::Service::delete_peer_connection(ros::ServiceEvent<ros_webrtc::DeleteP
     return _instance.delete_peer_connection(req.session_id, req.peer_id);
 }
 
+bool Host::Service::establish_session(ros::ServiceEvent<ros_webrtc::EstablishSession::Request, ros_webrtc::EstablishSession::Response>& event) {
+    const auto& req = event.getRequest();
+    auto& resp = event.getResponse();
+    PeerConnectionKey key = {req.session_id, req.peer_id};
+
+    // peer connection
+    webrtc::PeerConnectionInterface::IceServers ice_servers;
+    for (auto i = req.ice_servers.begin(); i != req.ice_servers.end(); i++) {
+        webrtc::PeerConnectionInterface::IceServer server;
+        server.uri = i->uri;
+        server.username = i->username;
+        server.password = i->password;
+        ice_servers.push_back(server);
+    }
+    PeerConnectionPtr pc(_instance.create_peer_connection(
+        event.getCallerName(),
+        req.session_id,
+        req.peer_id,
+        _sdp_constraints(req.sdp_constraints),
+        req.audio_sources,
+        req.video_sources,
+        ice_servers
+    ));
+    if (pc == NULL)
+        return false;
+
+    // data channels, before negotiating so they're in the description
+    for (auto i = req.data_channels.begin(); i != req.data_channels.end(); i++) {
+        DataChannel::Priority priority = DataChannel::Low;
+        if (!i->priority.empty() && !DataChannel::parse_priority(i->priority, priority)) {
+            ROS_WARN_STREAM("invalid data channel priority '" << i->priority << "'");
+            _instance.delete_peer_connection(key.session_id, key.peer_id);
+            return false;
+        }
+        if (!pc->create_data_channel(
+                i->label,
+                i->protocol,
+                i->reliable,
+                i->ordered,
+                i->id,
+                _reliability_limit(i->has_max_retransmits, i->max_retransmits),
+                _reliability_limit(i->has_max_packet_life_time, i->max_packet_life_time),
+                i->negotiated,
+                priority)) {
+            _instance.delete_peer_connection(key.session_id, key.peer_id);
+            return false;
+        }
+    }
+
+    // offer, or answer theirs
+    if (req.remote_description.type.empty()) {
+        pc->create_offer();
+    } else {
+        webrtc::SdpParseError err;
+        auto desc = webrtc::CreateSessionDescription(
+            req.remote_description.type,
+            req.remote_description.sdp,
+            &err
+        );
+        if (desc == NULL) {
+            ROS_INFO(
+                "webrtc::CreateSessionDescription() == NULL - line=%s, description=%s",
+                err.line.c_str(), err.description.c_str()
+            );
+            _instance.delete_peer_connection(key.session_id, key.peer_id);
+            return false;
+        }
+        pc->set_remote_session_description(desc);
+        pc->create_answer();
+    }
+
+    // and reply w/ ours
+    double timeout = req.timeout > 0 ? req.timeout : ESTABLISH_SESSION_TIMEOUT;
+    if (!pc->wait_for_local_description(req.wait_for_gathering, timeout, resp.local_description)) {
+        ROS_WARN_STREAM(
+            "pc ('" << key.session_id << "', '" << key.peer_id << "') " <<
+            "no local description after " << timeout << " sec(s)"
+        );
+        _instance.delete_peer_connection(key.session_id, key.peer_id);
+        return false;
+    }
+    return true;
+}
+
 bool Host::Service::get_host(ros::ServiceEvent<ros_webrtc::GetHost::Request, ros_webrtc::GetHost::Response>& event) {
     const auto &req = event.getRequest();
     auto &resp = event.getResponse();
@@ -704,12 +1133,15 @@ bool Host::Service::get_host(ros::ServiceEvent<ros_webrtc::GetHost::Request, ros
         src.state = video_src.interface != NULL ? to_string(video_src.interface->state()) : "ended";
         src.publish = video_src.publish;
         src.rotation = video_src.rotation;
+        src.layers = video_src.layers;
+        src.temporal_layers = video_src.temporal_layers;
 
         resp.video_sources.push_back(src);
     }
 
     // peer connections
-    for (auto i = _instance._pcs.begin(); i != _instance._pcs.end(); i++) {
+    Host::Sessions pcs = _instance._sessions();
+    for (auto i = pcs.begin(); i != pcs.end(); i++) {
         ros_webrtc::PeerConnectionKey key;
         key.session_id = (*i).second->session_id();
         key.peer_id = (*i).second->peer_id();
@@ -754,14 +1186,38 @@ bool Host::Service::send_data(ros::ServiceEvent<ros_webrtc::SendData::Request, r
         );
         return false;
     }
-    dc->send(req.data);
-    return true;
+    return dc->send(req.data);
+}
+
+bool Host::Service::send_file(ros::ServiceEvent<ros_webrtc::SendFile::Request, ros_webrtc::SendFile::Response>& event) {
+    const auto& req = event.getRequest();
+    auto &resp = event.getResponse();
+    PeerConnectionKey key = {req.session_id, req.peer_id};
+    PeerConnectionPtr pc = _instance._find_peer_connection(key);
+    if (pc == NULL) {
+        ROS_INFO_STREAM(
+            "pc (" << key.session_id << "', '" << key.peer_id << "') " <<
+            "not found"
+        );
+        return false;
+    }
+    DataChannelPtr dc = pc->data_channel(req.label);
+    if (dc == NULL) {
+        ROS_INFO_STREAM(
+            "pc (" << key.session_id << "', '" << key.peer_id << "') " <<
+            "has no data channel w/ label " << req.label
+        );
+        return false;
+    }
+    resp.id = req.id;
+    return dc->send_file(req.path, resp.id, resp.size);
 }
 
 bool Host::Service::set_ice_servers(
         ros::ServiceEvent<ros_webrtc::SetIceServers::Request,
         ros_webrtc::SetIceServers::Response>& event) {
     const auto& req = event.getRequest();
+    rtc::CritScope cs(&_instance._cs);
     _instance._ice_servers = _instance._default_ice_servers;
 
     for (auto i = 0; i < req.ice_servers.size(); i++) {
@@ -773,6 +1229,8 @@ bool Host::Service::set_ice_servers(
         _instance._ice_servers.push_back(server);
 
     }
+    if (_instance._pc_pool)
+        _instance._pc_pool->set_ice_servers(_instance._ice_servers);
     return true;
 }
 
@@ -860,6 +1318,56 @@ bool Host::Service::rotate_video_source(ros::ServiceEvent<ros_webrtc::RotateVide
     return true;
 }
 
+bool Host::Service::select_video_layer(ros::ServiceEvent<ros_webrtc::SelectVideoLayer::Request, ros_webrtc::SelectVideoLayer::Response>& event) {
+    const auto& req = event.getRequest();
+    PeerConnectionKey key = {req.session_id, req.peer_id};
+    PeerConnectionPtr pc = _instance._find_peer_connection(key);
+    if (pc == NULL)
+        return false;
+
+    // layer
+    rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> layer;
+    {
+        rtc::CritScope cs(&_instance._media_cs);
+        for (auto i = _instance._video_srcs.begin(); i != _instance._video_srcs.end(); i++) {
+            const auto& video_src = (*i);
+            if (video_src.label != req.label)
+                continue;
+            if (video_src.layer_chain)
+                layer = video_src.layer_chain->layer(req.layer, req.temporal_layers);
+            else if (req.layer == 0)
+                layer = video_src.interface;
+            break;
+        }
+    }
+    if (layer == NULL) {
+        ROS_ERROR_STREAM("no layer " << req.layer << " for video src w/ label '" << req.label << "'");
+        return false;
+    }
+
+    // swap the peer connection's track for one on it
+    rtc::scoped_refptr<webrtc::VideoTrackInterface> video_track(
+        _instance._pc_factory->CreateVideoTrack(req.label, layer)
+    );
+    if (video_track == NULL) {
+        ROS_ERROR_STREAM("cannot create video track '" << req.label << "' for layer " << req.layer);
+        return false;
+    }
+    if (!pc->replace_video_track(req.label, video_track)) {
+        ROS_ERROR_STREAM(
+            "pc ('" << req.session_id << "', '" << req.peer_id << "') " <<
+            "has no video track '" << req.label << "'"
+        );
+        return false;
+    }
+    ROS_INFO_STREAM(
+        "pc ('" << req.session_id << "', '" << req.peer_id << "') " <<
+        "video src '" << req.label << "' layer set to " << req.layer << " " <<
+        "forwarding " << req.temporal_layers << " temporal layer(s)"
+    );
+    return true;
+}
+
 // Host::DeletePeerConnectionCallback
 
 Host::DeletePeerConnectionCallback::DeletePeerConnectionCallback(Host& instance, const PeerConnectionKey& key) :
@@ -884,17 +1392,17 @@ Host::PeerConnectionObserver::~PeerConnectionObserver() {
 }
 
 void Host::PeerConnectionObserver::on_connection_change(webrtc::PeerConnectionInterface::IceConnectionState state) {
-    if (state == webrtc::PeerConnectionInterface::kIceConnectionDisconnected) {
-        PeerConnectionKey key = {_pc->session_id(), _pc->peer_id()};
-        ros::CallbackInterfacePtr callback(new Host::DeletePeerConnectionCallback(_instance, key));
-        _instance._nh.getCallbackQueue()->addCallback(callback);
-    }
+    // disconnects are recovered from by the peer connection, see on_ice_failed
 }
 
 void Host::PeerConnectionObserver::on_bond_broken() {
     PeerConnectionKey key = {_pc->session_id(), _pc->peer_id()};
-    ros::CallbackInterfacePtr callback(new Host::DeletePeerConnectionCallback(_instance, key));
-    _instance._nh.getCallbackQueue()->addCallback(callback);
+    _instance._schedule_delete(key);
+}
+
+void Host::PeerConnectionObserver::on_ice_failed() {
+    PeerConnectionKey key = {_pc->session_id(), _pc->peer_id()};
+    _instance._schedule_delete(key);
 }
 
 // HostFactory
@@ -908,6 +1416,12 @@ Host HostFactory::operator()(ros::NodeHandle &nh) {
         pc_bond_connect_timeout,
         pc_bond_heartbeat_timeout,
         default_ice_servers,
-        queue_sizes
+        queue_sizes,
+        dc_limits,
+        threads,
+        pool_sizes,
+        certificate_settings,
+        ice_restart,
+        shared_video_encoders
     );
 }
@@ -3,23 +3,38 @@
 
 #include <memory>
 
+#include <ros/callback_queue.h>
 #include <ros/callback_queue_interface.h>
+#include <ros/spinner.h>
 #include <ros_webrtc/AddIceCandidate.h>
+#include <ros_webrtc/AddIceCandidates.h>
+#include <ros_webrtc/BridgeTopic.h>
+#include <ros_webrtc/BroadcastData.h>
+#include <ros_webrtc/CancelFile.h>
 #include <ros_webrtc/CreateDataChannel.h>
 #include <ros_webrtc/CreateOffer.h>
 #include <ros_webrtc/CreatePeerConnection.h>
 #include <ros_webrtc/DeletePeerConnection.h>
+#include <ros_webrtc/EstablishSession.h>
 #include <ros_webrtc/GetHost.h>
 #include <ros_webrtc/GetPeerConnection.h>
 #include <ros_webrtc/RotateVideoSource.h>
+#include <ros_webrtc/SelectVideoLayer.h>
 #include <ros_webrtc/SendData.h>
+#include <ros_webrtc/SendFile.h>
 #include <ros_webrtc/SetIceServers.h>
 #include <ros_webrtc/SetRemoteDescription.h>
 #include <webrtc/api/peerconnectioninterface.h>
+#include <webrtc/base/criticalsection.h>
 
+#include "certificate_store.h"
 #include "media_constraints.h"
 #include "peer_connection.h"
+#include "peer_connection_pool.h"
+#include "session_queues.h"
+#include "shared_video_encoder.h"
 #include "video_capture.h"
+#include "video_layers.h"
 
 /**
  * \brief Description of a local video source.
@@ -56,10 +71,16 @@ struct VideoSource {
 
     int rotation;
 
+    std::vector<int> layers; /*! Downscale factors of its spatial layers, or empty for just the capture. */
+
+    int temporal_layers; /*! Temporal layers to encode each of its layers w/. */
+
     rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> interface;
 
     rtc::scoped_refptr<webrtc::VideoCaptureModule> capture_module;
 
+    VideoLayerChainPtr layer_chain; /*! Produces its layers, if it has any. */
+
     VideoRendererPtr renderer;
 
 };
@@ -89,6 +110,21 @@ struct AudioSource {
 
 };
 
+/**
+ * \brief Threads serving peer connection requests and delivering their callbacks.
+ */
+struct HostThreads {
+
+    HostThreads();
+
+    size_t sessions; /*! Threads, each w/ its own queue, that requests for peer connections are sharded across. */
+
+    size_t callbacks; /*! Threads delivering callbacks to the application. */
+
+    double callback_timeout; /*! Drop callbacks queued longer than this many seconds, or 0 to never. */
+
+};
+
 /**
  * \brief Accesses local media and manages peer connections.
  */
@@ -104,7 +140,13 @@ public:
         double pc_bond_connect_timeout,
         double pc_bond_heartbeat_timeout,
         const std::vector<webrtc::PeerConnectionInterface::IceServer>& default_ice_servers,
-        const QueueSizes& queue_sizes);
+        const QueueSizes& queue_sizes,
+        const DataChannelLimits& dc_limits,
+        const HostThreads& threads=HostThreads(),
+        const PeerConnectionPoolSizes& pool_sizes=PeerConnectionPoolSizes(),
+        const CertificateSettings& certificate_settings=CertificateSettings(),
+        const IceRestartPolicy& ice_restart=IceRestartPolicy(),
+        bool shared_video_encoders=false);
 
     Host(const Host& other);
 
@@ -122,7 +164,8 @@ public:
         const std::string& peer_id,
         const MediaConstraints& sdp_constraints,
         const std::vector<std::string>& audio_sources,
-        const std::vector<std::string>& video_sources
+        const std::vector<std::string>& video_sources,
+        const webrtc::PeerConnectionInterface::IceServers& ice_servers=webrtc::PeerConnectionInterface::IceServers()
     );
 
     bool delete_peer_connection(
@@ -148,6 +191,22 @@ public:
 
     ReapStats reap(double stale_threshold);
 
+    /**
+     * \brief Sends a message on the data channel w/ its label in every matching peer connection.
+     * \param session_id Only peer connections in this session, or all if empty.
+     * \param msg The message, whose label names the channels.
+     * \param sent Set to the peer connections it was queued for.
+     *
+     * The message is compressed and chunked once per distinct channel
+     * protocol, and the resulting buffers are shared by every channel's
+     * send queue rather than copied.
+     */
+    void broadcast(
+        const std::string& session_id,
+        const ros_webrtc::Data& msg,
+        std::vector<ros_webrtc::PeerConnectionKey>& sent
+    );
+
 private:
 
     class Service {
@@ -162,6 +221,14 @@ private:
 
         bool add_ice_candidate(ros::ServiceEvent<ros_webrtc::AddIceCandidate::Request, ros_webrtc::AddIceCandidate::Response>& event);
 
+        bool add_ice_candidates(ros::ServiceEvent<ros_webrtc::AddIceCandidates::Request, ros_webrtc::AddIceCandidates::Response>& event);
+
+        bool bridge_topic(ros::ServiceEvent<ros_webrtc::BridgeTopic::Request, ros_webrtc::BridgeTopic::Response>& event);
+
+        bool broadcast_data(ros::ServiceEvent<ros_webrtc::BroadcastData::Request, ros_webrtc::BroadcastData::Response>& event);
+
+        bool cancel_file(ros::ServiceEvent<ros_webrtc::CancelFile::Request, ros_webrtc::CancelFile::Response>& event);
+
         bool create_data_channel(ros::ServiceEvent<ros_webrtc::CreateDataChannel::Request, ros_webrtc::CreateDataChannel::Response>& event);
 
         bool create_offer(ros::ServiceEvent<ros_webrtc::CreateOffer::Request, ros_webrtc::CreateOffer::Response>& event);
@@ -170,12 +237,16 @@ private:
 
         bool delete_peer_connection(ros::ServiceEvent<ros_webrtc::DeletePeerConnection::Request, ros_webrtc::DeletePeerConnection::Response>& event);
 
+        bool establish_session(ros::ServiceEvent<ros_webrtc::EstablishSession::Request, ros_webrtc::EstablishSession::Response>& event);
+
         bool get_host(ros::ServiceEvent<ros_webrtc::GetHost::Request, ros_webrtc::GetHost::Response>& event);
 
         bool get_peer_connection(ros::ServiceEvent<ros_webrtc::GetPeerConnection::Request, ros_webrtc::GetPeerConnection::Response>& event);
 
         bool send_data(ros::ServiceEvent<ros_webrtc::SendData::Request, ros_webrtc::SendData::Response>& event);
 
+        bool send_file(ros::ServiceEvent<ros_webrtc::SendFile::Request, ros_webrtc::SendFile::Response>& event);
+
         bool set_ice_servers(
                 ros::ServiceEvent<ros_webrtc::SetIceServers::Request,
                 ros_webrtc::SetIceServers::Response>& event);
@@ -184,8 +255,27 @@ private:
 
         bool rotate_video_source(ros::ServiceEvent<ros_webrtc::RotateVideoSource::Request, ros_webrtc::RotateVideoSource::Response>& event);
 
+        bool select_video_layer(ros::ServiceEvent<ros_webrtc::SelectVideoLayer::Request, ros_webrtc::SelectVideoLayer::Response>& event);
+
     private:
 
+        /**
+         * \brief Advertises a service whose requests run on the queue of the peer connection they name.
+         */
+        template<class Request, class Response>
+        void _advertise_session(
+            const std::string& name,
+            bool (Service::*callback)(ros::ServiceEvent<Request, Response>& event)
+        );
+
+        static MediaConstraints _sdp_constraints(const ros_webrtc::MediaConstraints& msg);
+
+        /**
+         * \brief Partial reliability limit of a request, as PeerConnection::create_data_channel takes it.
+         * \return The limit if set, including 0, or -1 if not.
+         */
+        static int _reliability_limit(bool is_set, int32_t value);
+
         Host &_instance;
 
         ros::V_ServiceServer _srvs;
@@ -214,6 +304,8 @@ private:
 
         void on_bond_broken();
 
+        void on_ice_failed();
+
     };
 
     struct PeerConnectionKey {
@@ -264,6 +356,10 @@ private:
 
     PeerConnectionConstPtr _find_peer_connection(const PeerConnectionKey& key) const;
 
+    Sessions _sessions() const;
+
+    void _schedule_delete(const PeerConnectionKey& key);
+
     ros::NodeHandle _nh;
 
     AudioSource _audio_src;
@@ -285,6 +381,14 @@ private:
 
     QueueSizes _queue_sizes;
 
+    DataChannelLimits _dc_limits;
+
+    ros::CallbackQueue _data_queue;
+
+    std::unique_ptr<ros::AsyncSpinner> _data_spinner;
+
+    SendSchedulerPtr _scheduler; /*! Schedules data channel sends across peer connections. */
+
     std::unique_ptr<rtc::Thread> _network_thd;
 
     std::unique_ptr<rtc::Thread> _signaling_thd;
@@ -293,8 +397,32 @@ private:
 
     rtc::scoped_refptr<webrtc::PeerConnectionFactoryInterface> _pc_factory;
 
+    HostThreads _threads;
+
+    PeerConnectionPoolSizes _pool_sizes;
+
+    std::unique_ptr<PeerConnectionPool> _pc_pool; /*! Pre-created peer connections, if enabled. */
+
+    CertificateSettings _certificate_settings;
+
+    CertificateStorePtr _certificates; /*! DTLS certificates shared by peer connections, if enabled. */
+
+    IceRestartPolicy _ice_restart;
+
+    bool _shared_video_encoders; /*! Peer connections sending the same source share one encoder. */
+
+    CallbackDispatcherPtr _dispatcher; /*! Delivers peer connection callbacks. */
+
+    SessionQueuesPtr _session_queues; /*! Runs requests for each peer connection in order, and for different ones in parallel. */
+
+    mutable rtc::CriticalSection _cs; /*! Guards _pcs and _ice_servers. */
+
     Sessions _pcs;
 
+    rtc::CriticalSection _media_cs; /*! Guards opening and closing media. */
+
+    size_t _creating; /*! Peer connections being created, so using media. */
+
     Service _srv;
 
     bool _auto_close_media;
@@ -323,6 +451,18 @@ struct HostFactory {
     std::vector<webrtc::PeerConnectionInterface::IceServer> default_ice_servers;
 
     QueueSizes queue_sizes;
+
+    DataChannelLimits dc_limits;
+
+    HostThreads threads;
+
+    PeerConnectionPoolSizes pool_sizes;
+
+    CertificateSettings certificate_settings;
+
+    IceRestartPolicy ice_restart;
+
+    bool shared_video_encoders;
 };
 
 #endif  /* WEBRTC_HOST_H_ */
@@ -1,5 +1,7 @@
 #include <stdio.h>
 
+#include <algorithm>
+
 #include <ros/ros.h>
 #include <webrtc/base/ssladapter.h>
 #include <webrtc/system_wrappers/include/trace.h>
@@ -132,6 +134,12 @@ int main(int argc, char **argv) {
     host_factory.pc_bond_connect_timeout = config.pc_bond_connect_timeout;
     host_factory.pc_bond_heartbeat_timeout = config.pc_bond_heartbeat_timeout;
     host_factory.queue_sizes = config.queue_sizes;
+    host_factory.dc_limits = config.dc_limits;
+    host_factory.threads = config.threads;
+    host_factory.pool_sizes = config.pool_sizes;
+    host_factory.certificate_settings = config.certificate_settings;
+    host_factory.ice_restart = config.ice_restart;
+    host_factory.shared_video_encoders = config.shared_video_encoders;
     Host host = host_factory(nh);
 
     ROS_INFO("opening host ... ");
@@ -165,8 +173,11 @@ int main(int argc, char **argv) {
     );
     mem_timer.start();
 
-    ROS_INFO("start spinning");
-    ros::spin();
+    ROS_INFO("start spinning w/ %d thread(s)", std::max(1, config.spinner_threads));
+    ros::AsyncSpinner spinner(std::max(1, config.spinner_threads));
+    spinner.start();
+    ros::waitForShutdown();
+    spinner.stop();
     ROS_INFO("stop spinning");
 
     ROS_INFO("closing host ...");
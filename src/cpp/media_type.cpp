@@ -15,7 +15,7 @@ static const boost::regex media_type_re(
     "((vnd|prs|x)\\.)?"
     "([\\w\\.\\-]+)"
     "(\\+(\\w+))?"
-    "(\\s*;((\\s*[\\w\\-_\\.]+?=(\"([^\"]+?)\"|([^\\s]+)))*))?"
+    "(\\s*;((\\s*;?\\s*[\\w\\-_\\.]+?=(\"([^\"]+?)\"|([^\\s;]+)))*))?"
     "$"
 );
 
@@ -25,7 +25,7 @@ static const boost::regex media_type_re(
 static const boost::regex media_type_param_re(
     "([\\w\\-_\\.]+?)"
     "="
-    "(\"([^\"]+?)\"|([^\\s]+))"
+    "(\"([^\"]+?)\"|([^\\s;]+))"
 );
 
 bool MediaType::matches(const std::string& value) {
@@ -4,6 +4,7 @@
 #include <ros_webrtc/Close.h>
 #include <ros_webrtc/DataChannel.h>
 #include <ros_webrtc/IceCandidate.h>
+#include <ros_webrtc/IceCandidates.h>
 #include <ros_webrtc/IceConnectionState.h>
 #include <ros_webrtc/SessionDescription.h>
 #include <ros_webrtc/SignalingState.h>
@@ -11,6 +12,7 @@
 #include <ros_webrtc/OnAddStream.h>
 #include <ros_webrtc/OnDataChannel.h>
 #include <ros_webrtc/OnIceCandidate.h>
+#include <ros_webrtc/OnIceCandidates.h>
 #include <ros_webrtc/OnIceConnectionStateChange.h>
 #include <ros_webrtc/OnNegotiationNeeded.h>
 #include <ros_webrtc/OnRemoveStream.h>
@@ -25,6 +27,20 @@
 
 #include "peer_connection.h"
 
+namespace {
+
+// gathered candidates arriving w/in this are delivered as one batch
+const double LOCAL_ICE_CANDIDATES_WINDOW = 0.02;  // 20 ms
+
+}
+
+// IceRestartPolicy
+
+IceRestartPolicy::IceRestartPolicy() :
+    grace(2.0),
+    attempts(3),
+    timeout(5.0) {
+}
 
 // PeerConnection
 
@@ -34,27 +50,71 @@ PeerConnection::PeerConnection(
     const std::string& peer_id,
     const MediaConstraints& sdp_constraints,
     const QueueSizes& queue_sizes,
+    const DataChannelLimits& dc_limits,
     double connect_timeout,
-    double heartbeat_timeout) :
+    double heartbeat_timeout,
+    ros::CallbackQueueInterface* data_queue,
+    const SendSchedulerPtr& scheduler,
+    const CallbackDispatcherPtr& dispatcher,
+    const IceRestartPolicy& ice_restart,
+    ros::CallbackQueueInterface* session_queue) :
     _nn(node_name),
     _session_id(session_id),
     _peer_id(peer_id),
     _ice_connection_changed_at(ros::Time::now().toSec()),
+    _ice_restart(ice_restart),
+    _recovering(false),
+    _ice_restarts(0),
+    _ice_restart_generation(0),
+    _ice_restart_armed(0),
     _sdp_constraints(sdp_constraints),
     _pco(*this),
     _csdo(new PeerConnection::CreateSessionDescriptionObserver(*this)),
     _ssdo(new PeerConnection::SetSessionDescriptionObserver(*this)),
     _is_offerer(false),
     _queue_remote_ice_candidates(true),
+    _local_desc_set(false),
+    _ice_gathered(false),
     _events(*this),
     _callbacks(*this),
     _queue_sizes(queue_sizes),
+    _dc_limits(dc_limits),
+    _scheduler(scheduler),
+    _send_link(0),
+    _dispatcher(dispatcher),
     _bond(
         "peer_connection_bond",
         _session_id + "_" + _peer_id,
         boost::function<void (void)>(boost::bind(&PeerConnection::_on_bond_broken, this)),
         boost::function<void (void)>(boost::bind(&PeerConnection::_on_bond_formed, this))
     ) {
+    if (data_queue != NULL) {
+        _data_nh.setCallbackQueue(data_queue);
+    }
+    if (session_queue != NULL) {
+        _session_nh.setCallbackQueue(session_queue);
+    }
+    _local_ice_candidates_timer = _nh.createWallTimer(
+        ros::WallDuration(LOCAL_ICE_CANDIDATES_WINDOW),
+        &PeerConnection::_on_local_ice_candidates_timer,
+        this,
+        true,  // oneshot
+        false  // autostart
+    );
+    _ice_restart_timer = _session_nh.createWallTimer(
+        ros::WallDuration(_ice_restart.grace),
+        &PeerConnection::_on_ice_restart_timer,
+        this,
+        true,  // oneshot
+        false  // autostart
+    );
+    if (_scheduler) {
+        _send_link = _scheduler->add_link(
+            _dc_limits.send_high_watermark,
+            _dc_limits.send_low_watermark,
+            _dc_limits.send_bandwidth_limit
+        );
+    }
     _bond.setConnectTimeout(connect_timeout);
     _bond.setHeartbeatTimeout(heartbeat_timeout);
     ROS_INFO_STREAM(
@@ -64,6 +124,14 @@ PeerConnection::PeerConnection(
     );
 }
 
+PeerConnection::~PeerConnection() {
+    _session_nh.getCallbackQueue()->removeByID(reinterpret_cast<uint64_t>(this));
+    _local_ice_candidates_timer.stop();
+    _ice_restart_timer.stop();
+    if (_scheduler)
+        _scheduler->remove_link(_send_link);
+}
+
 const std::string& PeerConnection::session_id() const {
     return _session_id;
 }
@@ -73,10 +141,11 @@ const std::string& PeerConnection::peer_id() const {
 }
 
 bool PeerConnection::is_connecting() const {
-    if (_pc == nullptr) {
+    auto pc = peer_connection();
+    if (pc == nullptr) {
         return false;
     }
-    auto state = _pc->ice_connection_state();
+    auto state = pc->ice_connection_state();
     return (
         state == webrtc::PeerConnectionInterface::kIceConnectionNew ||
         state == webrtc::PeerConnectionInterface::kIceConnectionChecking
@@ -85,10 +154,11 @@ bool PeerConnection::is_connecting() const {
 
 
 bool PeerConnection::is_disconnected() const {
-    if (_pc == nullptr) {
+    auto pc = peer_connection();
+    if (pc == nullptr) {
         return false;
     }
-    auto state = _pc->ice_connection_state();
+    auto state = pc->ice_connection_state();
     return (
         state == webrtc::PeerConnectionInterface::kIceConnectionFailed ||
         state == webrtc::PeerConnectionInterface::kIceConnectionDisconnected ||
@@ -120,16 +190,17 @@ std::string PeerConnection::callback(const std::string &name) const {
 bool PeerConnection::begin(
     webrtc::PeerConnectionFactoryInterface* pc_factory,
     const webrtc::MediaConstraintsInterface* pc_constraints,
-    const webrtc::PeerConnectionInterface::IceServers& ice_servers,
+    const webrtc::PeerConnectionInterface::RTCConfiguration& rtc_conf,
     const std::vector<AudioSource> &audio_srcs,
     const std::vector<VideoSource> &video_srcs,
-    PeerConnection::ObserverPtr observer) {
+    PeerConnection::ObserverPtr observer,
+    const WarmPeerConnectionPtr& warm) {
     _observer = observer;
     if (!_open_local_stream(pc_factory, audio_srcs, video_srcs)) {
         end();
         return false;
     }
-    if (!_open_peer_connection(pc_factory, pc_constraints, ice_servers)) {
+    if (!_open_peer_connection(pc_factory, pc_constraints, rtc_conf, warm)) {
         end();
         return false;
     }
@@ -156,8 +227,9 @@ void PeerConnection::end() {
     }
 }
 
-webrtc::PeerConnectionInterface* PeerConnection::peer_connection() {
-    return _pc.get();
+rtc::scoped_refptr<webrtc::PeerConnectionInterface> PeerConnection::peer_connection() const {
+    std::lock_guard<std::mutex> lock(_pc_mutex);
+    return _pc;
 }
 
 bool PeerConnection::create_data_channel(
@@ -165,13 +237,31 @@ bool PeerConnection::create_data_channel(
         std::string protocol,
         bool reliable,
         bool ordered,
-        int id) {
+        int id,
+        int max_retransmits,
+        int max_packet_life_time,
+        bool negotiated,
+        DataChannel::Priority priority) {
+    if (max_retransmits >= 0 && max_packet_life_time >= 0) {
+        ROS_ERROR_STREAM(
+            "pc('" << _session_id << "', '" << _peer_id << "') " <<
+            "data channel w/ label='" << label << "' cannot have both " <<
+            "max_retransmits and max_packet_life_time"
+        );
+        return false;
+    }
     webrtc::DataChannelInit init;
     init.id = id;
     init.protocol = protocol;
     init.ordered = ordered;
     init.reliable = reliable;
-    rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel = _pc->CreateDataChannel(label, &init);
+    init.maxRetransmits = max_retransmits;
+    init.maxRetransmitTime = max_packet_life_time;
+    init.negotiated = negotiated;
+    auto pc = peer_connection();
+    rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel;
+    if (pc != NULL)
+        data_channel = pc->CreateDataChannel(label, &init);
     if (data_channel == NULL) {
         ROS_ERROR_STREAM(
             "pc('" << _session_id << "', '" << _peer_id << "') " <<
@@ -192,17 +282,21 @@ bool PeerConnection::create_data_channel(
         }
     }
     DataChannelPtr dc(new DataChannel(
-        _nh,
+        _data_nh,
         topic("data_" + label),
+        topic("data_" + label + "/send"),
         data_channel,
         media_type,
+        _dc_limits,
         _queue_sizes.data
     ));
-    _dcs[label] = dc;
+    dc->set_priority(priority);
+    _add_data_channel(label, dc);
     return true;
 }
 
 DataChannelPtr PeerConnection::data_channel(const std::string& label) {
+    std::lock_guard<std::mutex> lock(_pc_mutex);
     auto i = _dcs.find(label);
     if (i == _dcs.end())
         return DataChannelPtr();
@@ -210,46 +304,146 @@ DataChannelPtr PeerConnection::data_channel(const std::string& label) {
 }
 
 DataChannelConstPtr PeerConnection::data_channel(const std::string& label) const {
+    std::lock_guard<std::mutex> lock(_pc_mutex);
     auto i = _dcs.find(label);
     if (i == _dcs.end())
         return DataChannelConstPtr();
     return (*i).second;
 }
 
+std::vector<DataChannelPtr> PeerConnection::data_channels() const {
+    std::lock_guard<std::mutex> lock(_pc_mutex);
+    std::vector<DataChannelPtr> dcs;
+    dcs.reserve(_dcs.size());
+    for (auto i = _dcs.begin(); i != _dcs.end(); i++)
+        dcs.push_back((*i).second);
+    return dcs;
+}
+
 bool PeerConnection::create_offer() {
+    auto pc = peer_connection();
+    if (pc == NULL)
+        return false;
     _is_offerer = true;
-    _pc->CreateOffer(_csdo, &_sdp_constraints);
+    pc->CreateOffer(_csdo, &_sdp_constraints);
     return true;
 }
 
 void PeerConnection::create_answer() {
+    auto pc = peer_connection();
+    if (pc == NULL)
+        return;
     _is_offerer = false;
-    _pc->CreateAnswer(_csdo, &_sdp_constraints);
+    pc->CreateAnswer(_csdo, &_sdp_constraints);
+}
+
+bool PeerConnection::replace_video_track(const std::string& label, webrtc::VideoTrackInterface* track) {
+    auto pc = peer_connection();
+    if (pc == NULL)
+        return false;
+    auto senders = pc->GetSenders();
+    for (auto i = senders.begin(); i != senders.end(); i++) {
+        // a sender's id is that of the track it was created for
+        if ((*i)->media_type() != cricket::MEDIA_TYPE_VIDEO || (*i)->id() != label)
+            continue;
+        return (*i)->SetTrack(track);
+    }
+    return false;
+}
+
+void PeerConnection::restart_ice() {
+    auto pc = peer_connection();
+    if (pc == NULL)
+        return;
+    MediaConstraints constraints(_sdp_constraints);
+    constraints.mandatory().push_back(MediaConstraints::Constraint(
+        webrtc::MediaConstraintsInterface::kIceRestart,
+        webrtc::MediaConstraintsInterface::kValueTrue
+    ));
+    // whichever side offered originally, we offer the restart
+    _is_offerer = true;
+    {
+        std::lock_guard<std::mutex> lock(_local_desc_mutex);
+        _local_desc.reset();
+        _local_desc_set = false;
+        _ice_gathered = false;
+    }
+    // their new candidates are only valid once their answer is set
+    {
+        std::lock_guard<std::mutex> lock(_remote_ice_candidates_mutex);
+        _queue_remote_ice_candidates = true;
+    }
+    pc->CreateOffer(_csdo, &constraints);
 }
 
 bool PeerConnection::is_offerer() const {
     return _is_offerer;
 }
 
+bool PeerConnection::wait_for_local_description(bool gathered, double timeout, ros_webrtc::SessionDescription& desc) {
+    {
+        std::unique_lock<std::mutex> lock(_local_desc_mutex);
+        bool ready = _local_desc_cond.wait_for(
+            lock,
+            std::chrono::duration<double>(timeout),
+            [this, gathered]() { return _local_desc_set && (!gathered || _ice_gathered); }
+        );
+        if (!ready)
+            return false;
+    }
+    // current description has candidates gathered so far, vs the one created
+    auto pc = peer_connection();
+    if (pc == NULL || pc->local_description() == NULL)
+        return false;
+    desc.type = is_offerer() ? "offer" : "answer";
+    pc->local_description()->ToString(&desc.sdp);
+    return true;
+}
+
 void PeerConnection::add_ice_candidate(webrtc::IceCandidateInterface* candidate) {
-    if (_queue_remote_ice_candidates) {
-        // FIXME: capture and log error
-        std::string sdp;
-        candidate->ToString(&sdp);
-        IceCandidatePtr copy(webrtc::CreateIceCandidate(
-            candidate->sdp_mid(),
-            candidate->sdp_mline_index(),
-            sdp,
-            NULL
-        ));
-        _remote_ice_cadidates.push_back(copy);
-    } else {
-        _pc->AddIceCandidate(candidate);
+    {
+        std::lock_guard<std::mutex> lock(_remote_ice_candidates_mutex);
+        if (_queue_remote_ice_candidates) {
+            // FIXME: capture and log error
+            std::string sdp;
+            candidate->ToString(&sdp);
+            IceCandidatePtr copy(webrtc::CreateIceCandidate(
+                candidate->sdp_mid(),
+                candidate->sdp_mline_index(),
+                sdp,
+                NULL
+            ));
+            _remote_ice_cadidates.push_back(copy);
+            return;
+        }
+    }
+    auto pc = peer_connection();
+    if (pc != NULL)
+        pc->AddIceCandidate(candidate);
+}
+
+void PeerConnection::add_ice_candidates(const std::vector<IceCandidatePtr>& candidates) {
+    {
+        std::lock_guard<std::mutex> lock(_remote_ice_candidates_mutex);
+        if (_queue_remote_ice_candidates) {
+            _remote_ice_cadidates.insert(_remote_ice_cadidates.end(), candidates.begin(), candidates.end());
+            return;
+        }
     }
+    auto pc = peer_connection();
+    if (pc == NULL)
+        return;
+    for (auto i = candidates.begin(); i != candidates.end(); i++)
+        pc->AddIceCandidate((*i).get());
 }
 
 void PeerConnection::set_remote_session_description(webrtc::SessionDescriptionInterface* sdp) {
-    _pc->SetRemoteDescription(_ssdo, sdp);
+    auto pc = peer_connection();
+    if (pc == NULL) {
+        delete sdp;  // owned by SetRemoteDescription otherwise
+        return;
+    }
+    pc->SetRemoteDescription(_ssdo, sdp);
 }
 
 PeerConnection::operator ros_webrtc::PeerConnection () const {
@@ -263,9 +457,10 @@ PeerConnection::operator ros_webrtc::PeerConnection () const {
 
     pc.sdp_constraints = _sdp_constraints;
 
-    if (_pc.get() != NULL) {
+    auto peer_connection = this->peer_connection();
+    if (peer_connection != NULL) {
         // local stream
-        auto local_streams = _pc->local_streams();
+        auto local_streams = peer_connection->local_streams();
         for (size_t i = 0; i < local_streams->count(); i+= 1) {
             auto stream = local_streams->at(i);
 
@@ -285,7 +480,7 @@ PeerConnection::operator ros_webrtc::PeerConnection () const {
         }
 
         // local stream
-        auto remote_streams = _pc->remote_streams();
+        auto remote_streams = peer_connection->remote_streams();
         for (size_t i = 0; i < remote_streams->count(); i+= 1) {
             auto stream = remote_streams->at(i);
 
@@ -304,15 +499,16 @@ PeerConnection::operator ros_webrtc::PeerConnection () const {
             }
         }
 
-        pc.signaling_state = to_string(_pc->signaling_state());
+        pc.signaling_state = to_string(peer_connection->signaling_state());
 
-        pc.ice_connection_state = to_string(_pc->ice_connection_state());
+        pc.ice_connection_state = to_string(peer_connection->ice_connection_state());
 
-        pc.ice_gathering_state = to_string(_pc->ice_gathering_state());
+        pc.ice_gathering_state = to_string(peer_connection->ice_gathering_state());
     }
 
-    for (auto i = _dcs.begin(); i != _dcs.end(); i++) {
-        pc.data_channels.push_back(*(*i).second);
+    auto dcs = data_channels();
+    for (auto i = dcs.begin(); i != dcs.end(); i++) {
+        pc.data_channels.push_back(**i);
     }
 
     return pc;
@@ -320,8 +516,11 @@ PeerConnection::operator ros_webrtc::PeerConnection () const {
 
 PeerConnection::FlushStats PeerConnection::flush() {
     PeerConnection::FlushStats flush;
-    for (auto i = _dcs.begin(); i != _dcs.end(); i++) {
-        flush.reaped_data_messages += (*i).second->reap();
+    auto dcs = data_channels();
+    for (auto i = dcs.begin(); i != dcs.end(); i++) {
+        flush.reaped_data_messages += (*i)->reap();
+        ros_webrtc::DataChannel msg = **i;
+        _events.on_data_channel_stats.publish(msg);
     }
     return flush;
 }
@@ -329,16 +528,27 @@ PeerConnection::FlushStats PeerConnection::flush() {
 bool PeerConnection::_open_peer_connection(
         webrtc::PeerConnectionFactoryInterface* pc_factory,
         const webrtc::MediaConstraintsInterface* pc_constraints,
-        const webrtc::PeerConnectionInterface::IceServers& ice_servers) {
-    webrtc::PeerConnectionInterface::RTCConfiguration rtc_conf;
-    rtc_conf.servers = ice_servers;
-    _pc = pc_factory->CreatePeerConnection(
-        rtc_conf, pc_constraints, NULL, NULL, &_pco
-    );
-    if (_pc == NULL) {
+        const webrtc::PeerConnectionInterface::RTCConfiguration& rtc_conf,
+        const WarmPeerConnectionPtr& warm) {
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc;
+    if (warm != NULL) {
+        ROS_DEBUG_STREAM("pc ('" << _session_id << "', '"<< _peer_id << "') claimed from pool");
+        _warm = warm;
+        _warm->observer->bind(&_pco);
+        pc = _warm->pc;
+    } else {
+        pc = pc_factory->CreatePeerConnection(
+            rtc_conf, pc_constraints, NULL, NULL, &_pco
+        );
+    }
+    if (pc == NULL) {
         return false;
     }
-    if (!_pc->AddStream(_local_stream)) {
+    {
+        std::lock_guard<std::mutex> lock(_pc_mutex);
+        _pc = pc;
+    }
+    if (!pc->AddStream(_local_stream)) {
         return false;
     }
     return true;
@@ -347,11 +557,27 @@ bool PeerConnection::_open_peer_connection(
 void PeerConnection::_close_peer_connection() {
     _close_local_stream();
 
-    _dcs.clear();
+    // taken under the lock, but closed outside it as closing calls back
+    std::map<std::string, DataChannelPtr> dcs;
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc;
+    {
+        std::lock_guard<std::mutex> lock(_pc_mutex);
+        dcs.swap(_dcs);
+        pc.swap(_pc);
+    }
 
-    if (_pc != NULL) {
-        _pc->Close();
-        _pc = NULL;
+    if (_scheduler) {
+        for (auto i = dcs.begin(); i != dcs.end(); i++)
+            _scheduler->remove((*i).second.get());
+    }
+    dcs.clear();
+
+    if (pc != NULL) {
+        pc->Close();
+    }
+    if (_warm != NULL) {
+        _warm->observer->bind(NULL);
+        _warm.reset();
     }
 
     ROS_INFO_STREAM("pc ('" << _session_id << "', '"<< _peer_id << "') closed");
@@ -363,6 +589,25 @@ void PeerConnection::_close_peer_connection() {
     _events.on_close.publish(msg);
 }
 
+void PeerConnection::_add_data_channel(const std::string& label, const DataChannelPtr& dc) {
+    DataChannelPtr replaced;
+    {
+        std::lock_guard<std::mutex> lock(_pc_mutex);
+        auto i = _dcs.find(label);
+        if (i != _dcs.end())
+            replaced = (*i).second;
+        _dcs[label] = dc;
+    }
+    if (_scheduler) {
+        // one it replaces would otherwise be polled until shutdown
+        if (replaced)
+            _scheduler->remove(replaced.get());
+        _scheduler->add(dc, _send_link, dc->priority(), dc->weight());
+        dc->schedule(_scheduler);
+    }
+    dc->adopt(_peer_id);
+}
+
 bool PeerConnection::_open_local_stream(
         webrtc::PeerConnectionFactoryInterface* pc_factory,
         const std::vector<AudioSource> &audio_srcs,
@@ -459,6 +704,18 @@ void PeerConnection::_on_bond_broken() {
         _observer->on_bond_broken();
 }
 
+template<class Service>
+void PeerConnection::_callback(const std::string& name, const ros::ServiceClient& client, const Service& srv) {
+    // service calls block until answered, so are not made on WebRTC threads
+    auto call = [client, srv]() mutable {
+        return !client.exists() || client.call(srv);
+    };
+    if (_dispatcher)
+        _dispatcher->dispatch(_session_id + '\n' + _peer_id, name, call);
+    else
+        call();
+}
+
 void PeerConnection::_on_local_description(webrtc::SessionDescriptionInterface* desc) {
     ROS_INFO("pc '%s' local description", _session_id.c_str());
     ros_webrtc::SessionDescription msg;
@@ -466,25 +723,163 @@ void PeerConnection::_on_local_description(webrtc::SessionDescriptionInterface*
     msg.type = is_offerer() ? "offer" : "answer";
 
     // callback
-    if (_callbacks.on_set_session_description.exists()) {
+    {
         ros_webrtc::OnSetSessionDescription srv;
         srv.request.type = msg.type;
         srv.request.sdp = msg.sdp;
-        _callbacks.on_set_session_description.call(srv);
+        _callback("on_set_session_description", _callbacks.on_set_session_description, srv);
     }
 
     // event
     _events.on_set_session_description.publish(msg);
+
+    // and waiters
+    {
+        std::lock_guard<std::mutex> lock(_local_desc_mutex);
+        _local_desc_set = true;
+    }
+    _local_desc_cond.notify_all();
+}
+
+void PeerConnection::_batch_local_ice_candidate(const ros_webrtc::IceCandidate& candidate) {
+    bool first;
+    {
+        rtc::CritScope cs(&_local_ice_candidates_cs);
+        _local_ice_candidates.push_back(candidate);
+        first = _local_ice_candidates.size() == 1;
+    }
+    if (first) {
+        _local_ice_candidates_timer.stop();
+        _local_ice_candidates_timer.start();
+    }
+}
+
+void PeerConnection::_on_local_ice_candidates_timer(const ros::WallTimerEvent& event) {
+    _flush_local_ice_candidates();
+}
+
+void PeerConnection::_flush_local_ice_candidates() {
+    ros_webrtc::IceCandidates msg;
+    {
+        rtc::CritScope cs(&_local_ice_candidates_cs);
+        msg.candidates.swap(_local_ice_candidates);
+    }
+    if (msg.candidates.empty())
+        return;
+
+    // callback
+    {
+        ros_webrtc::OnIceCandidates srv;
+        srv.request.candidates = msg.candidates;
+        _callback("on_ice_candidates", _callbacks.on_ice_candidates, srv);
+    }
+
+    // event
+    _events.on_ice_candidates.publish(msg);
+}
+
+void PeerConnection::_on_ice_connection_change(webrtc::PeerConnectionInterface::IceConnectionState state) {
+    switch (state) {
+        case webrtc::PeerConnectionInterface::kIceConnectionDisconnected:
+        case webrtc::PeerConnectionInterface::kIceConnectionFailed: {
+            if (_ice_restart.attempts == 0) {
+                if (state == webrtc::PeerConnectionInterface::kIceConnectionDisconnected && _observer != NULL)
+                    _observer->on_ice_failed();
+                break;
+            }
+            uint64_t generation;
+            {
+                rtc::CritScope cs(&_ice_restart_cs);
+                if (_recovering)
+                    break;
+                _recovering = true;
+                _ice_restarts = 0;
+                generation = ++_ice_restart_generation;
+            }
+            ROS_INFO_STREAM(
+                "pc ('" << _session_id << "', '"<< _peer_id << "') ice disconnected, " <<
+                "restarting in " << _ice_restart.grace << " sec(s) unless it reconnects"
+            );
+            // Armed on the session queue rather than here, as stopping the
+            // timer waits on its callback, which may be blocked on a call
+            // this thread has to run.
+            _session_nh.getCallbackQueue()->addCallback(
+                ros::CallbackInterfacePtr(new IceRestartCallback(*this, generation)),
+                reinterpret_cast<uint64_t>(this)
+            );
+            break;
+        }
+        case webrtc::PeerConnectionInterface::kIceConnectionConnected:
+        case webrtc::PeerConnectionInterface::kIceConnectionCompleted: {
+            uint32_t restarts;
+            {
+                rtc::CritScope cs(&_ice_restart_cs);
+                if (!_recovering)
+                    break;
+                _recovering = false;
+                restarts = _ice_restarts;
+            }
+            // timer sees it's no longer recovering when it fires
+            ROS_INFO_STREAM(
+                "pc ('" << _session_id << "', '"<< _peer_id << "') ice recovered after " <<
+                restarts << " restart(s)"
+            );
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+void PeerConnection::_arm_ice_restart_timer(uint64_t generation, double period) {
+    _ice_restart_armed = generation;
+    _ice_restart_timer.stop();
+    _ice_restart_timer.setPeriod(ros::WallDuration(period));
+    _ice_restart_timer.start();
+}
+
+void PeerConnection::_on_ice_restart_timer(const ros::WallTimerEvent& event) {
+    uint32_t restarts = 0;
+    {
+        rtc::CritScope cs(&_ice_restart_cs);
+        // or armed for an earlier disconnect, and this one's yet to be
+        if (!_recovering || _ice_restart_armed != _ice_restart_generation)
+            return;
+        if (_ice_restarts < _ice_restart.attempts)
+            restarts = ++_ice_restarts;
+        else
+            _recovering = false;
+    }
+    if (restarts != 0) {
+        ROS_INFO_STREAM(
+            "pc ('" << _session_id << "', '"<< _peer_id << "') ice restart " <<
+            restarts << " of " << _ice_restart.attempts
+        );
+        _arm_ice_restart_timer(_ice_restart_armed, _ice_restart.timeout);
+        restart_ice();
+        return;
+    }
+    ROS_WARN_STREAM(
+        "pc ('" << _session_id << "', '"<< _peer_id << "') ice not recovered after " <<
+        _ice_restart.attempts << " restart(s)"
+    );
+    if (_observer != NULL)
+        _observer->on_ice_failed();
 }
 
 void PeerConnection::_drain_remote_ice_candidates() {
-    ROS_INFO("pc '%s' adding %zu q'd remote ice candidates", _session_id.c_str(), _remote_ice_cadidates.size());
-    while (!_remote_ice_cadidates.empty()) {
-        IceCandidatePtr ice_candidate = _remote_ice_cadidates.front();
-        _remote_ice_cadidates.pop_front();
-        _pc->AddIceCandidate(ice_candidate.get());
+    std::list<IceCandidatePtr> candidates;
+    {
+        std::lock_guard<std::mutex> lock(_remote_ice_candidates_mutex);
+        candidates.swap(_remote_ice_cadidates);
+        _queue_remote_ice_candidates = false;
     }
-    _queue_remote_ice_candidates = false;
+    ROS_INFO("pc '%s' adding %zu q'd remote ice candidates", _session_id.c_str(), candidates.size());
+    auto pc = peer_connection();
+    if (pc == NULL)
+        return;
+    for (auto i = candidates.begin(); i != candidates.end(); i++)
+        pc->AddIceCandidate((*i).get());
 }
 
 // PeerConnection::VideoSource
@@ -518,9 +913,9 @@ void PeerConnection::PeerConnectionObserver::OnSignalingChange(webrtc::PeerConne
     ROS_INFO_STREAM("pc ('" << instance._session_id << "', '"<< instance._peer_id << "') signaling change - " << new_state);
 
     // callback
-    if (instance._callbacks.on_signaling_state_change.exists()) {
+    {
         ros_webrtc::OnSignalingStateChange srv;
-        instance._callbacks.on_signaling_state_change.call(srv);
+        instance._callback("on_signaling_state_change", instance._callbacks.on_signaling_state_change, srv);
     }
 
     // event
@@ -565,9 +960,9 @@ void PeerConnection::PeerConnectionObserver::OnAddStream(rtc::scoped_refptr<webr
     }
 
     // callback
-    if (instance._callbacks.on_add_stream.exists()) {
+    {
         ros_webrtc::OnAddStream srv;
-        instance._callbacks.on_add_stream.call(srv);
+        instance._callback("on_add_stream", instance._callbacks.on_add_stream, srv);
     }
 
     // event
@@ -576,7 +971,9 @@ void PeerConnection::PeerConnectionObserver::OnAddStream(rtc::scoped_refptr<webr
 
 void PeerConnection::PeerConnectionObserver::OnRemoveStream(rtc::scoped_refptr<webrtc::MediaStreamInterface> stream) {
     ROS_INFO_STREAM("pc ('" << instance._session_id << "', '"<< instance._peer_id << "') remove stream - label: " << stream->label());
-    instance._pc->RemoveStream(stream);
+    auto pc = instance.peer_connection();
+    if (pc != NULL)
+        pc->RemoveStream(stream);
 
     // audio track sink
     webrtc::AudioTrackVector audio_tracks(stream->GetAudioTracks());
@@ -607,9 +1004,9 @@ void PeerConnection::PeerConnectionObserver::OnRemoveStream(rtc::scoped_refptr<w
     }
 
     // callback
-    if (instance._callbacks.on_remove_stream.exists()) {
+    {
         ros_webrtc::OnRemoveStream srv;
-        instance._callbacks.on_remove_stream.call(srv);
+        instance._callback("on_remove_stream", instance._callbacks.on_remove_stream, srv);
     }
 
     // event
@@ -635,19 +1032,21 @@ void PeerConnection::PeerConnectionObserver::OnDataChannel(rtc::scoped_refptr<we
     }
 
     DataChannelPtr dc(new DataChannel(
-        instance._nh,
+        instance._data_nh,
         instance.topic("data_" + data_channel->label()),
+        instance.topic("data_" + data_channel->label() + "/send"),
         data_channel,
         media_type,
+        instance._dc_limits,
         instance._queue_sizes.data
     ));
-    instance._dcs[data_channel->label()] = dc;
+    instance._add_data_channel(data_channel->label(), dc);
 
     // callback
-    if (instance._callbacks.on_data_channel.exists()) {
+    {
         ros_webrtc::OnDataChannel srv;
         srv.request.data_channel = *dc;
-        instance._callbacks.on_data_channel.call(srv);
+        instance._callback("on_data_channel", instance._callbacks.on_data_channel, srv);
     }
 
     // event
@@ -659,9 +1058,9 @@ void PeerConnection::PeerConnectionObserver::OnRenegotiationNeeded() {
     ROS_INFO_STREAM("pc ('" << instance._session_id << "', '"<< instance._peer_id << "') re-negotiation needed");
 
     // callback
-    if (instance._callbacks.on_negotiation_needed.exists()) {
+    {
         ros_webrtc::OnNegotiationNeeded srv;
-        instance._callbacks.on_negotiation_needed.call(srv);
+        instance._callback("on_negotiation_needed", instance._callbacks.on_negotiation_needed, srv);
     }
 
     // event
@@ -675,11 +1074,12 @@ void PeerConnection::PeerConnectionObserver::OnIceConnectionChange(webrtc::PeerC
     if (instance._observer != NULL) {
         instance._observer->on_connection_change(new_state);
     }
+    instance._on_ice_connection_change(new_state);
 
     // callback
-    if (instance._callbacks.on_ice_connection_state_change.exists()) {
+    {
         ros_webrtc::OnIceConnectionStateChange srv;
-        instance._callbacks.on_ice_connection_state_change.call(srv);
+        instance._callback("on_ice_connection_state_change", instance._callbacks.on_ice_connection_state_change, srv);
     }
 
     // event
@@ -690,10 +1090,20 @@ void PeerConnection::PeerConnectionObserver::OnIceConnectionChange(webrtc::PeerC
 void PeerConnection::PeerConnectionObserver::OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState new_state) {
     ROS_INFO_STREAM("pc ('" << instance._session_id << "', '"<< instance._peer_id << "') ice gathering state - " << new_state);
 
+    // deliver what's batched now rather than waiting out the window
+    if (new_state == webrtc::PeerConnectionInterface::kIceGatheringComplete) {
+        instance._flush_local_ice_candidates();
+        {
+            std::lock_guard<std::mutex> lock(instance._local_desc_mutex);
+            instance._ice_gathered = true;
+        }
+        instance._local_desc_cond.notify_all();
+    }
+
     // callback
-    if (instance._callbacks.on_ice_connection_state_change.exists()) {
+    {
         ros_webrtc::OnIceConnectionStateChange srv;
-        instance._callbacks.on_ice_connection_state_change.call(srv);
+        instance._callback("on_ice_connection_state_change", instance._callbacks.on_ice_connection_state_change, srv);
     }
 
     // event
@@ -708,14 +1118,17 @@ void PeerConnection::PeerConnectionObserver::OnIceCandidate(const webrtc::IceCan
     candidate->ToString(&msg.candidate);
 
     // callback
-    if (instance._callbacks.on_ice_candidate.exists()) {
+    {
         ros_webrtc::OnIceCandidate srv;
         srv.request.candidate = msg;
-        instance._callbacks.on_ice_candidate.call(srv);
+        instance._callback("on_ice_candidate", instance._callbacks.on_ice_candidate, srv);
     }
 
     // event
     instance._events.on_ice_candidate.publish(msg);
+
+    // and batched
+    instance._batch_local_ice_candidate(msg);
 }
 
 void PeerConnection::PeerConnectionObserver::OnIceCandidatesRemoved(const std::vector<cricket::Candidate>& candidates) {
@@ -746,17 +1159,21 @@ void PeerConnection::CreateSessionDescriptionObserver::OnSuccess(webrtc::Session
     // We now own |desc| by the calling convention
     std::unique_ptr<webrtc::SessionDescriptionInterface> own(desc);
     ROS_INFO_STREAM("pc('" << instance._session_id << "', '"<< instance._peer_id << "') create session description succeeded");
-    if (instance._local_desc != NULL) {
-        ROS_INFO_STREAM("local sdp already set, skipping");
-        return;
-    }
     std::string sdp;
     desc->ToString(&sdp);
-    // FIXME: capture and log errors
-    instance._local_desc.reset(webrtc::CreateSessionDescription(desc->type(), sdp, NULL));
-    if (instance._pc != NULL) {
+    {
+        std::lock_guard<std::mutex> lock(instance._local_desc_mutex);
+        if (instance._local_desc != NULL) {
+            ROS_INFO_STREAM("local sdp already set, skipping");
+            return;
+        }
+        // FIXME: capture and log errors
+        instance._local_desc.reset(webrtc::CreateSessionDescription(desc->type(), sdp, NULL));
+    }
+    auto pc = instance.peer_connection();
+    if (pc != NULL) {
         ROS_INFO_STREAM("setting local sdp, type - " << desc->type());
-        instance._pc->SetLocalDescription(
+        pc->SetLocalDescription(
             instance._ssdo,
             // FIXME: capture and log errors
             webrtc::CreateSessionDescription(desc->type(), sdp, NULL)
@@ -779,21 +1196,28 @@ PeerConnection::SetSessionDescriptionObserver::~SetSessionDescriptionObserver()
 
 void PeerConnection::SetSessionDescriptionObserver::OnSuccess() {
     ROS_INFO_STREAM("pc('" << instance._session_id << "', '"<< instance._peer_id << "') set session description succeeded");
-    if (instance._pc == NULL)
+    auto pc = instance.peer_connection();
+    if (pc == NULL)
         return;
+    std::shared_ptr<webrtc::SessionDescriptionInterface> local_desc;
+    {
+        std::lock_guard<std::mutex> lock(instance._local_desc_mutex);
+        local_desc = instance._local_desc;
+    }
     if (instance.is_offerer()) {
-        if (instance._pc->remote_description() == NULL) {
+        // vs remote_description(), which is also set when offering an ice restart
+        if (pc->signaling_state() == webrtc::PeerConnectionInterface::kHaveLocalOffer) {
             ROS_INFO_STREAM("pc('" << instance._session_id << "', '"<< instance._peer_id << "') local sdp set succeeded");
-            instance._on_local_description(instance._local_desc.get());
+            instance._on_local_description(local_desc.get());
         } else {
             ROS_INFO_STREAM("remote sdp set succeeded");
             instance._drain_remote_ice_candidates();
         }
     }
     else {
-        if (instance._pc->local_description() != NULL) {
+        if (pc->local_description() != NULL) {
             ROS_INFO_STREAM("pc('" << instance._session_id << "', '"<< instance._peer_id << "') local sdp set succeeded");
-            instance._on_local_description(instance._local_desc.get());
+            instance._on_local_description(local_desc.get());
             instance._drain_remote_ice_candidates();
         } else {
         }
@@ -804,30 +1228,46 @@ void PeerConnection::SetSessionDescriptionObserver::OnFailure(const std::string&
     ROS_INFO_STREAM("pc('" << instance._session_id << "', '"<< instance._peer_id << "') set description failed - " << error);
 }
 
+// PeerConnection::IceRestartCallback
+
+PeerConnection::IceRestartCallback::IceRestartCallback(PeerConnection& instance, uint64_t generation) :
+    _instance(instance),
+    _generation(generation) {
+}
+
+ros::CallbackInterface::CallResult PeerConnection::IceRestartCallback::call() {
+    _instance._arm_ice_restart_timer(_generation, _instance._ice_restart.grace);
+    return Success;
+}
+
 // PeerConnection::Events
 
 PeerConnection::Events::Events(PeerConnection &pc) :
     on_data_channel(pc._nh.advertise<ros_webrtc::DataChannel>("data_channel", pc._queue_sizes.event)),
     on_negotiation_needed(pc._nh.advertise<std_msgs::Empty>("negotiation_needed", pc._queue_sizes.event)),
     on_ice_candidate(pc._nh.advertise<ros_webrtc::IceCandidate>("ice_candidate", pc._queue_sizes.event)),
+    on_ice_candidates(pc._nh.advertise<ros_webrtc::IceCandidates>("ice_candidates", pc._queue_sizes.event)),
     on_ice_connection_state_change(pc._nh.advertise<ros_webrtc::IceConnectionState>("ice_connection_state_change", pc._queue_sizes.event)),
     on_signaling_state_change(pc._nh.advertise<ros_webrtc::SignalingState>("signaling_state_change", pc._queue_sizes.event)),
     on_add_stream(pc._nh.advertise<ros_webrtc::Stream>("add_stream", pc._queue_sizes.event)),
     on_remove_stream(pc._nh.advertise<ros_webrtc::Stream>("remove_stream", pc._queue_sizes.event)),
     on_set_session_description(pc._nh.advertise<ros_webrtc::SessionDescription>("set_session_description", pc._queue_sizes.event)),
-    on_close(pc._nh.advertise<ros_webrtc::Close>("close", pc._queue_sizes.event)) {
+    on_close(pc._nh.advertise<ros_webrtc::Close>("close", pc._queue_sizes.event)),
+    on_data_channel_stats(pc._nh.advertise<ros_webrtc::DataChannel>("data_channel_stats", pc._queue_sizes.event)) {
 }
 
 void PeerConnection::Events::shutdown() {
     on_data_channel.shutdown();
     on_negotiation_needed.shutdown();
     on_ice_candidate.shutdown();
+    on_ice_candidates.shutdown();
     on_ice_connection_state_change.shutdown();
     on_signaling_state_change.shutdown();
     on_set_session_description.shutdown();
     on_add_stream.shutdown();
     on_remove_stream.shutdown();
     on_close.shutdown();
+    on_data_channel_stats.shutdown();
 }
 
 // PeerConnection::Callbacks
@@ -836,6 +1276,7 @@ PeerConnection::Callbacks::Callbacks(PeerConnection &pc) :
     on_data_channel(pc._nh.serviceClient<ros_webrtc::OnDataChannel>(pc.callback("on_data_channel"))),
     on_negotiation_needed(pc._nh.serviceClient<ros_webrtc::OnNegotiationNeeded>(pc.callback("on_negotiation_needed"))),
     on_ice_candidate(pc._nh.serviceClient<ros_webrtc::OnIceCandidate>(pc.callback("on_ice_candidate"))),
+    on_ice_candidates(pc._nh.serviceClient<ros_webrtc::OnIceCandidates>(pc.callback("on_ice_candidates"))),
     on_ice_connection_state_change(pc._nh.serviceClient<ros_webrtc::OnIceConnectionStateChange>(pc.callback("on_ice_connection_state_change"))),
     on_signaling_state_change(pc._nh.serviceClient<ros_webrtc::OnSignalingStateChange>(pc.callback("on_signaling_state_change"))),
     on_add_stream(pc._nh.serviceClient<ros_webrtc::OnAddStream>(pc.callback("on_add_stream"))),
@@ -847,6 +1288,7 @@ void PeerConnection::Callbacks::shutdown() {
     on_data_channel.shutdown();
     on_negotiation_needed.shutdown();
     on_ice_candidate.shutdown();
+    on_ice_candidates.shutdown();
     on_ice_connection_state_change.shutdown();
     on_signaling_state_change.shutdown();
     on_add_stream.shutdown();
@@ -1,23 +1,31 @@
 #ifndef ROS_WEBRTC_PEER_CONNECTION_H_
 #define ROS_WEBRTC_PEER_CONNECTION_H_
 
+#include <atomic>
+#include <condition_variable>
 #include <list>
 #include <memory>
+#include <mutex>
 
 #include <boost/shared_ptr.hpp>
 #include <bondcpp/bond.h>
 #include <ros/ros.h>
 #include <ros_webrtc/DataChannel.h>
 #include <ros_webrtc/Data.h>
+#include <ros_webrtc/IceCandidate.h>
 #include <ros_webrtc/PeerConnection.h>
+#include <ros_webrtc/SessionDescription.h>
 #include <webrtc/api/mediaconstraintsinterface.h>
 #include <webrtc/api/peerconnectioninterface.h>
 #include <webrtc/media/base/videosourceinterface.h>
+#include <webrtc/base/criticalsection.h>
 #include <webrtc/base/refcount.h>
 #include <webrtc/base/scoped_ref_ptr.h>
 
+#include "callback_dispatcher.h"
 #include "data_channel.h"
 #include "media_constraints.h"
+#include "peer_connection_pool.h"
 #include "renderer.h"
 
 class Device;
@@ -38,6 +46,21 @@ struct QueueSizes {
 
 };
 
+/**
+ * \brief How a peer connection recovers when its ICE connection drops.
+ */
+struct IceRestartPolicy {
+
+    IceRestartPolicy();
+
+    double grace; /*! Seconds to wait for ICE to reconnect on its own before restarting it. */
+
+    uint32_t attempts; /*! ICE restarts before giving up on the peer connection, or 0 to give up on disconnect. */
+
+    double timeout; /*! Seconds to wait for each restart to reconnect. */
+
+};
+
 /**
  * \brief Represents a peer connection.
  */
@@ -52,8 +75,14 @@ public:
      * \param peer_id String identifying the remote peer.
      * \param sdp_constraints Media constraints to apply for this peer connection.
      * \param default_queue_size Default size of publisher and subscriber queues.
+     * \param dc_limits Limits applied to data channels.
      * \param connect_timeout Bond connect timeout in seconds or 0 for no bonding.
      * \param heartbeat_timeout Bond heartbeat timeout in seconds or 0 for no bonding.
+     * \param data_queue Callback queue serving data channel send topics, or NULL for the global one.
+     * \param scheduler Schedules sends across data channels, or NULL for each to send on its own.
+     * \param dispatcher Delivers callbacks to the application, or NULL to call them inline.
+     * \param ice_restart How to recover when the ICE connection drops.
+     * \param session_queue Callback queue running requests for this peer connection, which ICE restarts are run on too, or NULL for the global one.
      */
     PeerConnection(
         const std::string& node_name,
@@ -61,8 +90,16 @@ public:
         const std::string& peer_id,
         const MediaConstraints& sdp_constraints,
         const QueueSizes& queue_sizes,
+        const DataChannelLimits& dc_limits,
         double connect_timeout=10.0,
-        double heartbeat_timeout=4.0);
+        double heartbeat_timeout=4.0,
+        ros::CallbackQueueInterface* data_queue=NULL,
+        const SendSchedulerPtr& scheduler=SendSchedulerPtr(),
+        const CallbackDispatcherPtr& dispatcher=CallbackDispatcherPtr(),
+        const IceRestartPolicy& ice_restart=IceRestartPolicy(),
+        ros::CallbackQueueInterface* session_queue=NULL);
+
+    ~PeerConnection();
 
     /**
      * \brief String identifying the session.
@@ -154,48 +191,87 @@ public:
 
         virtual void on_bond_broken() = 0;
 
+        /**
+         * \brief ICE disconnected and could not be restarted within the policy's budget.
+         */
+        virtual void on_ice_failed() = 0;
+
     };
 
     typedef boost::shared_ptr<Observer> ObserverPtr;
 
+    typedef boost::shared_ptr<webrtc::IceCandidateInterface> IceCandidatePtr;
+
     /**
      * \brief Initiate connection to remote peer for this session.
      * \param pc_factory Factory used to create a peer connection.
      * \param pc_constraints Constraints to apply to the connection.
-     * \param ice_servers Collection of servers to use for ICE (connection negotiation).
+     * \param rtc_conf Configuration, e.g. servers to use for ICE (connection negotiation) and DTLS certificates.
      * \param audio_srcs Local audio sources to share with peer as a stream tracks.
      * \param video_srcs Local video sources to share with peer as a stream tracks.
      * \param observer Optional observer to call on various PeerConnection life-cycle events (e.g. disconnect).
+     * \param warm Optional pre-created connection to use rather than creating one.
      * \return Whether initiation of peer connection succeeded.
      */
     bool begin(
         webrtc::PeerConnectionFactoryInterface* pc_factory,
         const webrtc::MediaConstraintsInterface* pc_constraints,
-        const webrtc::PeerConnectionInterface::IceServers& ice_servers,
+        const webrtc::PeerConnectionInterface::RTCConfiguration& rtc_conf,
         const std::vector<AudioSource> &audio_srcs,
         const std::vector<VideoSource> &video_srcs,
-        ObserverPtr observer = ObserverPtr());
+        ObserverPtr observer = ObserverPtr(),
+        const WarmPeerConnectionPtr& warm = WarmPeerConnectionPtr());
 
     /**
      * \brief Teardown connection to remote peer, ending this session.
      */
     void end();
 
-    webrtc::PeerConnectionInterface* peer_connection();
+    /**
+     * \brief The WebRTC peer connection, or NULL once closed.
+     */
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> peer_connection() const;
 
+    /**
+     * \brief Creates a data channel to the remote peer.
+     * \param label Label identifying the channel.
+     * \param protocol Sub-protocol, typically a media type.
+     * \param reliable Whether delivery is reliable (deprecated).
+     * \param ordered Whether delivery is ordered.
+     * \param id Stream id, used if negotiated.
+     * \param max_retransmits Maximum number of retransmissions or -1 for unlimited.
+     * \param max_packet_life_time Maximum milliseconds to retransmit for or -1 for unlimited.
+     * \param negotiated Whether the channel was negotiated out-of-band.
+     * \param priority Priority of sends on the channel.
+     * \return Whether the channel was created.
+     */
     bool create_data_channel(
         std::string label,
         std::string protocol=std::string(),
         bool reliable=false,
         bool ordered=false,
-        int id=-1);
+        int id=-1,
+        int max_retransmits=-1,
+        int max_packet_life_time=-1,
+        bool negotiated=false,
+        DataChannel::Priority priority=DataChannel::Low);
 
     DataChannelPtr data_channel(const std::string& label);
 
     DataChannelConstPtr data_channel(const std::string& label) const;
 
+    /**
+     * \brief Snapshot of the data channels, safe to iterate while they change.
+     */
+    std::vector<DataChannelPtr> data_channels() const;
+
     void add_ice_candidate(webrtc::IceCandidateInterface* candidate);
 
+    /**
+     * \brief Adds remote candidates in one pass, call on the signaling thread so none are marshalled.
+     */
+    void add_ice_candidates(const std::vector<IceCandidatePtr>& candidates);
+
     void set_remote_session_description(webrtc::SessionDescriptionInterface* sdp);
 
     bool create_offer();
@@ -204,11 +280,33 @@ public:
 
     void create_answer();
 
+    /**
+     * \brief Offers new ICE credentials to the remote peer, keeping the session (i.e. media and data channels).
+     */
+    void restart_ice();
+
+    /**
+     * \brief Sends a different track in place of a local video track, w/o renegotiating.
+     * \param label Label of the local video track, i.e. its sender.
+     * \param track Track to send instead, e.g. on another layer of the same source.
+     * \return False if there is no such sender.
+     */
+    bool replace_video_track(const std::string& label, webrtc::VideoTrackInterface* track);
+
+    /**
+     * \brief Blocks until the local description has been set.
+     * \param gathered Also wait for ICE gathering to complete, so the description carries every local candidate.
+     * \param timeout Seconds to wait.
+     * \param desc Set to the local description.
+     * \return False if it timed out or the peer connection has closed.
+     */
+    bool wait_for_local_description(bool gathered, double timeout, ros_webrtc::SessionDescription& desc);
+
     operator ros_webrtc::PeerConnection () const;
 
     struct FlushStats {
 
-        size_t reaped_data_messages;
+        size_t reaped_data_messages = 0;
 
     };
 
@@ -291,8 +389,6 @@ private:
 
     };
 
-    typedef boost::shared_ptr<webrtc::IceCandidateInterface> IceCandidatePtr;
-
     class Events {
 
     public:
@@ -304,6 +400,7 @@ private:
         ros::Publisher on_data_channel;
         ros::Publisher on_negotiation_needed;
         ros::Publisher on_ice_candidate;
+        ros::Publisher on_ice_candidates;
         ros::Publisher on_ice_connection_state_change;
         ros::Publisher on_signaling_state_change;
         ros::Publisher on_add_stream;
@@ -312,6 +409,31 @@ private:
         ros::Publisher on_set_session_description;
         ros::Publisher on_close;
 
+        ros::Publisher on_data_channel_stats;
+
+    };
+
+    /**
+     * \brief Arms the ICE restart timer on the session queue, where it fires.
+     */
+    class IceRestartCallback : public ros::CallbackInterface {
+
+    public:
+
+        IceRestartCallback(PeerConnection& instance, uint64_t generation);
+
+    private:
+
+        PeerConnection& _instance;
+
+        uint64_t _generation;
+
+    // ros::CallbackInterface
+
+    public:
+
+        virtual ros::CallbackInterface::CallResult call();
+
     };
 
     class Callbacks {
@@ -325,6 +447,7 @@ private:
         ros::ServiceClient on_data_channel;
         ros::ServiceClient on_negotiation_needed;
         ros::ServiceClient on_ice_candidate;
+        ros::ServiceClient on_ice_candidates;
         ros::ServiceClient on_ice_connection_state_change;
         ros::ServiceClient on_signaling_state_change;
         ros::ServiceClient on_add_stream;
@@ -337,10 +460,16 @@ private:
     bool _open_peer_connection(
         webrtc::PeerConnectionFactoryInterface* pc_factory,
         const webrtc::MediaConstraintsInterface* pc_constraints,
-        const webrtc::PeerConnectionInterface::IceServers& ice_servers);
+        const webrtc::PeerConnectionInterface::RTCConfiguration& rtc_conf,
+        const WarmPeerConnectionPtr& warm);
 
     void _close_peer_connection();
 
+    /**
+     * \brief Adds a data channel and schedules its sends, in place of any w/ the same label.
+     */
+    void _add_data_channel(const std::string& label, const DataChannelPtr& dc);
+
     bool _open_local_stream(
         webrtc::PeerConnectionFactoryInterface* pc_factory,
         const std::vector<AudioSource> &audio_srcs,
@@ -354,8 +483,26 @@ private:
 
     void _on_local_description(webrtc::SessionDescriptionInterface* desc);
 
+    /**
+     * \brief Calls an application callback, via the dispatcher if there is one.
+     */
+    template<class Service>
+    void _callback(const std::string& name, const ros::ServiceClient& client, const Service& srv);
+
     void _drain_remote_ice_candidates();
 
+    void _batch_local_ice_candidate(const ros_webrtc::IceCandidate& candidate);
+
+    void _on_local_ice_candidates_timer(const ros::WallTimerEvent& event);
+
+    void _flush_local_ice_candidates();
+
+    void _on_ice_connection_change(webrtc::PeerConnectionInterface::IceConnectionState state);
+
+    void _arm_ice_restart_timer(uint64_t generation, double period);
+
+    void _on_ice_restart_timer(const ros::WallTimerEvent& event);
+
     void _begin_event();
 
     void _renegotiation_needed_event();
@@ -380,6 +527,10 @@ private:
 
     ros::NodeHandle _nh;
 
+    ros::NodeHandle _data_nh;
+
+    ros::NodeHandle _session_nh; /*! Callbacks on the session queue. */
+
     ros::Subscriber _s;
 
     std::string _nn;
@@ -390,8 +541,30 @@ private:
 
     double _ice_connection_changed_at;
 
+    IceRestartPolicy _ice_restart;
+
+    ros::WallTimer _ice_restart_timer; /*! Fires at the end of the grace period, then of each restart, and is only ever touched on the session queue. */
+
+    rtc::CriticalSection _ice_restart_cs; /*! Guards _recovering, _ice_restarts and _ice_restart_generation. */
+
+    bool _recovering; /*! Disconnected and waiting for ICE to reconnect. */
+
+    uint32_t _ice_restarts; /*! Restarts made while recovering. */
+
+    uint64_t _ice_restart_generation; /*! Bumped on each disconnect, so the timer ignores ones it was armed for before. */
+
+    uint64_t _ice_restart_armed; /*! Generation the timer was last armed for, only used on the session queue. */
+
     QueueSizes _queue_sizes;
 
+    DataChannelLimits _dc_limits;
+
+    SendSchedulerPtr _scheduler;
+
+    size_t _send_link; /*! Scheduler link shared by this peer connection's data channels. */
+
+    CallbackDispatcherPtr _dispatcher;
+
     bond::Bond _bond;
 
     MediaConstraints _sdp_constraints;
@@ -402,7 +575,11 @@ private:
 
     rtc::scoped_refptr<webrtc::MediaStreamInterface> _local_stream;
 
-    rtc::scoped_refptr<webrtc::PeerConnectionInterface> _pc;
+    mutable std::mutex _pc_mutex; /*! Guards _pc and _dcs, used from service, timer and WebRTC threads. */
+
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> _pc; /*! Only ever called through a copy, w/o _pc_mutex held. */
+
+    WarmPeerConnectionPtr _warm; /*! Pooled connection _pc was claimed from, if any. */
 
     PeerConnectionObserver _pco;
 
@@ -412,15 +589,31 @@ private:
 
     rtc::scoped_refptr<SetSessionDescriptionObserver> _ssdo;
 
-    bool _is_offerer;
+    std::atomic<bool> _is_offerer;
+
+    std::shared_ptr<webrtc::SessionDescriptionInterface> _local_desc; /*! Guarded by _local_desc_mutex. */
 
-    std::unique_ptr<webrtc::SessionDescriptionInterface> _local_desc;
+    std::mutex _remote_ice_candidates_mutex; /*! Guards _queue_remote_ice_candidates and _remote_ice_cadidates. */
 
     bool _queue_remote_ice_candidates;
 
     std::list<IceCandidatePtr> _remote_ice_cadidates;
 
-    std::map<std::string, DataChannelPtr> _dcs;
+    rtc::CriticalSection _local_ice_candidates_cs;
+
+    std::vector<ros_webrtc::IceCandidate> _local_ice_candidates; /*! Gathered but not yet delivered as a batch. */
+
+    ros::WallTimer _local_ice_candidates_timer;
+
+    std::mutex _local_desc_mutex;
+
+    std::condition_variable _local_desc_cond;
+
+    bool _local_desc_set; /*! Local description applied, guarded by _local_desc_mutex. */
+
+    bool _ice_gathered; /*! Gathering complete, guarded by _local_desc_mutex. */
+
+    std::map<std::string, DataChannelPtr> _dcs; /*! Guarded by _pc_mutex. */
 
     typedef std::list<AudioSinkPtr> AudioSinks;
 
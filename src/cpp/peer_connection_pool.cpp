@@ -0,0 +1,237 @@
+#include "peer_connection_pool.h"
+
+#include <ros/ros.h>
+
+// PeerConnectionPoolSizes
+
+PeerConnectionPoolSizes::PeerConnectionPoolSizes() :
+    connections(0),
+    ice_candidates(0) {
+}
+
+// ForwardingPeerConnectionObserver
+
+ForwardingPeerConnectionObserver::ForwardingPeerConnectionObserver() : _target(NULL) {
+}
+
+void ForwardingPeerConnectionObserver::bind(webrtc::PeerConnectionObserver* target) {
+    rtc::CritScope cs(&_cs);
+    _target = target;
+}
+
+void ForwardingPeerConnectionObserver::OnSignalingChange(webrtc::PeerConnectionInterface::SignalingState new_state) {
+    rtc::CritScope cs(&_cs);
+    if (_target != NULL)
+        _target->OnSignalingChange(new_state);
+}
+
+void ForwardingPeerConnectionObserver::OnAddStream(rtc::scoped_refptr<webrtc::MediaStreamInterface> stream) {
+    rtc::CritScope cs(&_cs);
+    if (_target != NULL)
+        _target->OnAddStream(stream);
+}
+
+void ForwardingPeerConnectionObserver::OnRemoveStream(rtc::scoped_refptr<webrtc::MediaStreamInterface> stream) {
+    rtc::CritScope cs(&_cs);
+    if (_target != NULL)
+        _target->OnRemoveStream(stream);
+}
+
+void ForwardingPeerConnectionObserver::OnDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel) {
+    rtc::CritScope cs(&_cs);
+    if (_target != NULL)
+        _target->OnDataChannel(data_channel);
+}
+
+void ForwardingPeerConnectionObserver::OnRenegotiationNeeded() {
+    rtc::CritScope cs(&_cs);
+    if (_target != NULL)
+        _target->OnRenegotiationNeeded();
+}
+
+void ForwardingPeerConnectionObserver::OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConnectionState new_state) {
+    rtc::CritScope cs(&_cs);
+    if (_target != NULL)
+        _target->OnIceConnectionChange(new_state);
+}
+
+void ForwardingPeerConnectionObserver::OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState new_state) {
+    rtc::CritScope cs(&_cs);
+    if (_target != NULL)
+        _target->OnIceGatheringChange(new_state);
+}
+
+void ForwardingPeerConnectionObserver::OnIceCandidate(const webrtc::IceCandidateInterface* candidate) {
+    rtc::CritScope cs(&_cs);
+    if (_target != NULL)
+        _target->OnIceCandidate(candidate);
+}
+
+void ForwardingPeerConnectionObserver::OnIceCandidatesRemoved(const std::vector<cricket::Candidate>& candidates) {
+    rtc::CritScope cs(&_cs);
+    if (_target != NULL)
+        _target->OnIceCandidatesRemoved(candidates);
+}
+
+void ForwardingPeerConnectionObserver::OnIceConnectionReceivingChange(bool receiving) {
+    rtc::CritScope cs(&_cs);
+    if (_target != NULL)
+        _target->OnIceConnectionReceivingChange(receiving);
+}
+
+// WarmPeerConnection
+
+WarmPeerConnection::~WarmPeerConnection() {
+    if (pc != NULL) {
+        pc->Close();
+        pc = NULL;
+    }
+}
+
+// PeerConnectionPool
+
+PeerConnectionPool::PeerConnectionPool(
+    webrtc::PeerConnectionFactoryInterface* pc_factory,
+    const MediaConstraints& pc_constraints,
+    const PeerConnectionPoolSizes& sizes,
+    const CertificateStorePtr& certificates) :
+    _pc_factory(pc_factory),
+    _pc_constraints(pc_constraints),
+    _sizes(sizes),
+    _certificates(certificates),
+    _stopping(false) {
+}
+
+PeerConnectionPool::~PeerConnectionPool() {
+    stop();
+}
+
+void PeerConnectionPool::start(const webrtc::PeerConnectionInterface::IceServers& ice_servers) {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _ice_servers = ice_servers;
+        _stopping = false;
+    }
+    if (!_thread.joinable())
+        _thread = std::thread(&PeerConnectionPool::_run, this);
+}
+
+void PeerConnectionPool::stop() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _cond.notify_all();
+    if (_thread.joinable())
+        _thread.join();
+
+    // closed outside the lock, each is a blocking hop to the signaling thread
+    std::deque<WarmPeerConnectionPtr> closing;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        closing.swap(_ready);
+    }
+}
+
+void PeerConnectionPool::set_ice_servers(const webrtc::PeerConnectionInterface::IceServers& ice_servers) {
+    std::deque<WarmPeerConnectionPtr> closing;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _ice_servers = ice_servers;
+        std::deque<WarmPeerConnectionPtr> keep;
+        for (auto i = _ready.begin(); i != _ready.end(); i++) {
+            if (_same((*i)->ice_servers, _ice_servers))
+                keep.push_back(*i);
+            else
+                closing.push_back(*i);
+        }
+        _ready.swap(keep);
+    }
+    _cond.notify_all();
+}
+
+WarmPeerConnectionPtr PeerConnectionPool::claim(const webrtc::PeerConnectionInterface::IceServers& ice_servers) {
+    WarmPeerConnectionPtr warm;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto i = _ready.begin(); i != _ready.end(); i++) {
+            if (_same((*i)->ice_servers, ice_servers)) {
+                warm = *i;
+                _ready.erase(i);
+                break;
+            }
+        }
+    }
+    if (warm != NULL)
+        _cond.notify_all();
+    return warm;
+}
+
+size_t PeerConnectionPool::size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _ready.size();
+}
+
+bool PeerConnectionPool::_same(
+        const webrtc::PeerConnectionInterface::IceServers& a,
+        const webrtc::PeerConnectionInterface::IceServers& b) {
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i != a.size(); i++) {
+        if (a[i].uri != b[i].uri ||
+            a[i].urls != b[i].urls ||
+            a[i].username != b[i].username ||
+            a[i].password != b[i].password)
+            return false;
+    }
+    return true;
+}
+
+void PeerConnectionPool::_run() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (true) {
+        _cond.wait(lock, [this]() {
+            return _stopping || _ready.size() < _sizes.connections;
+        });
+        if (_stopping)
+            break;
+        webrtc::PeerConnectionInterface::IceServers ice_servers = _ice_servers;
+
+        lock.unlock();
+        WarmPeerConnectionPtr warm = _create(ice_servers);
+        lock.lock();
+
+        if (warm == NULL) {
+            // back off rather than spin on a factory that keeps failing
+            _cond.wait_for(lock, std::chrono::seconds(1), [this]() { return _stopping; });
+            continue;
+        }
+        if (!_same(warm->ice_servers, _ice_servers)) {
+            // servers changed while creating it
+            lock.unlock();
+            warm.reset();
+            lock.lock();
+            continue;
+        }
+        _ready.push_back(warm);
+    }
+}
+
+WarmPeerConnectionPtr PeerConnectionPool::_create(const webrtc::PeerConnectionInterface::IceServers& ice_servers) {
+    WarmPeerConnectionPtr warm(new WarmPeerConnection());
+    warm->observer.reset(new ForwardingPeerConnectionObserver());
+    warm->ice_servers = ice_servers;
+    webrtc::PeerConnectionInterface::RTCConfiguration rtc_conf;
+    rtc_conf.servers = ice_servers;
+    rtc_conf.ice_candidate_pool_size = _sizes.ice_candidates;
+    if (_certificates)
+        rtc_conf.certificates = _certificates->next();
+    warm->pc = _pc_factory->CreatePeerConnection(
+        rtc_conf, &_pc_constraints, NULL, NULL, warm->observer.get()
+    );
+    if (warm->pc == NULL) {
+        ROS_WARN_STREAM("pooled peer connection create failed");
+        return WarmPeerConnectionPtr();
+    }
+    return warm;
+}
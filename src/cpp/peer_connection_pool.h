@@ -0,0 +1,174 @@
+#ifndef ROS_WEBRTC_PEER_CONNECTION_POOL_H_
+#define ROS_WEBRTC_PEER_CONNECTION_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include <boost/shared_ptr.hpp>
+#include <webrtc/api/peerconnectioninterface.h>
+#include <webrtc/base/criticalsection.h>
+
+#include "certificate_store.h"
+#include "media_constraints.h"
+
+/**
+ * \brief Sizes of the pool of pre-created peer connections.
+ */
+struct PeerConnectionPoolSizes {
+
+    PeerConnectionPoolSizes();
+
+    size_t connections; /*! Peer connections kept ready to claim, or 0 for no pool. */
+
+    int ice_candidates; /*! ICE candidates each gathers before it is claimed (RTCConfiguration::ice_candidate_pool_size). */
+
+};
+
+/**
+ * \brief Forwards peer connection events to whichever observer has claimed it.
+ *
+ * Events raised while unbound (i.e. still pooled) are dropped.
+ */
+class ForwardingPeerConnectionObserver : public webrtc::PeerConnectionObserver {
+
+public:
+
+    ForwardingPeerConnectionObserver();
+
+    void bind(webrtc::PeerConnectionObserver* target);
+
+// webrtc::PeerConnectionObserver
+
+public:
+
+    virtual void OnSignalingChange(webrtc::PeerConnectionInterface::SignalingState new_state);
+
+    virtual void OnAddStream(rtc::scoped_refptr<webrtc::MediaStreamInterface> stream);
+
+    virtual void OnRemoveStream(rtc::scoped_refptr<webrtc::MediaStreamInterface> stream);
+
+    virtual void OnDataChannel(rtc::scoped_refptr<webrtc::DataChannelInterface> data_channel);
+
+    virtual void OnRenegotiationNeeded();
+
+    virtual void OnIceConnectionChange(webrtc::PeerConnectionInterface::IceConnectionState new_state);
+
+    virtual void OnIceGatheringChange(webrtc::PeerConnectionInterface::IceGatheringState new_state);
+
+    virtual void OnIceCandidate(const webrtc::IceCandidateInterface* candidate);
+
+    virtual void OnIceCandidatesRemoved(const std::vector<cricket::Candidate>& candidates);
+
+    virtual void OnIceConnectionReceivingChange(bool receiving);
+
+private:
+
+    rtc::CriticalSection _cs;
+
+    webrtc::PeerConnectionObserver* _target;
+
+};
+
+/**
+ * \brief A WebRTC peer connection created ahead of the session that will claim it.
+ */
+struct WarmPeerConnection {
+
+    ~WarmPeerConnection();
+
+    std::unique_ptr<ForwardingPeerConnectionObserver> observer; /*! Declared first so it outlives pc. */
+
+    rtc::scoped_refptr<webrtc::PeerConnectionInterface> pc;
+
+    webrtc::PeerConnectionInterface::IceServers ice_servers; /*! Servers it was created w/. */
+
+};
+
+typedef boost::shared_ptr<WarmPeerConnection> WarmPeerConnectionPtr;
+
+/**
+ * \brief Keeps peer connections created, w/ ICE candidates gathered, ready to claim.
+ *
+ * Creating a WebRTC peer connection and gathering its candidates is on the
+ * critical path of every session, so this does it ahead of time on its own
+ * thread and refills as connections are claimed.
+ */
+class PeerConnectionPool {
+
+public:
+
+    /**
+     * \param pc_factory Factory used to create peer connections, must outlive this.
+     * \param pc_constraints Constraints applied to every peer connection.
+     * \param sizes Number of connections to keep ready, and candidates each gathers.
+     * \param certificates Optional DTLS certificates to create connections w/.
+     */
+    PeerConnectionPool(
+        webrtc::PeerConnectionFactoryInterface* pc_factory,
+        const MediaConstraints& pc_constraints,
+        const PeerConnectionPoolSizes& sizes,
+        const CertificateStorePtr& certificates = CertificateStorePtr()
+    );
+
+    ~PeerConnectionPool();
+
+    /**
+     * \brief Starts filling the pool w/ connections using these servers.
+     */
+    void start(const webrtc::PeerConnectionInterface::IceServers& ice_servers);
+
+    /**
+     * \brief Stops filling and closes all unclaimed connections.
+     */
+    void stop();
+
+    /**
+     * \brief Replaces connections created w/ other servers.
+     */
+    void set_ice_servers(const webrtc::PeerConnectionInterface::IceServers& ice_servers);
+
+    /**
+     * \brief Takes a ready connection created w/ these servers.
+     * \return The connection, or NULL if none is ready.
+     */
+    WarmPeerConnectionPtr claim(const webrtc::PeerConnectionInterface::IceServers& ice_servers);
+
+    size_t size() const;
+
+private:
+
+    static bool _same(
+        const webrtc::PeerConnectionInterface::IceServers& a,
+        const webrtc::PeerConnectionInterface::IceServers& b
+    );
+
+    void _run();
+
+    WarmPeerConnectionPtr _create(const webrtc::PeerConnectionInterface::IceServers& ice_servers);
+
+    webrtc::PeerConnectionFactoryInterface* _pc_factory;
+
+    MediaConstraints _pc_constraints;
+
+    PeerConnectionPoolSizes _sizes;
+
+    CertificateStorePtr _certificates;
+
+    mutable std::mutex _mutex;
+
+    std::condition_variable _cond;
+
+    bool _stopping;
+
+    webrtc::PeerConnectionInterface::IceServers _ice_servers; /*! Servers new connections are created w/. */
+
+    std::deque<WarmPeerConnectionPtr> _ready;
+
+    std::thread _thread;
+
+};
+
+#endif /* ROS_WEBRTC_PEER_CONNECTION_POOL_H_ */
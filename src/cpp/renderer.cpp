@@ -1,10 +1,19 @@
 #include "renderer.h"
 
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <limits>
+
 #include <json/json.h>
 #include <sensor_msgs/image_encodings.h>
 #include <webrtc/media/base/videocommon.h>
 #include <webrtc/media/base/videoframe.h>
 
+#include "file_transfer.h"
+#include "util.h"
+
 // AudioSink
 
 AudioSink::AudioSink(
@@ -121,11 +130,46 @@ DataObserver::~DataObserver() {
     _dc->UnregisterObserver();
 }
 
+void DataObserver::stats(ros_webrtc::DataChannel& dst) const {
+}
+
+void DataObserver::on_drain(const boost::function<void ()>& callback) {
+    _on_drain = callback;
+}
+
+void DataObserver::on_message(const boost::function<bool (ros_webrtc::Data&)>& callback) {
+    _on_message = callback;
+}
+
+void DataObserver::on_resume(const OnResume& callback) {
+    _on_resume = callback;
+}
+
+void DataObserver::resume(const ResumeStorePtr& store, const std::string& key) {
+}
+
+void DataObserver::publish(const ros_webrtc::Data& msg) {
+    _rpub.publish(msg);
+}
+
+void DataObserver::_publish(ros_webrtc::Data& msg) {
+    if (_on_message && !_on_message(msg))
+        return;
+    _rpub.publish(msg);
+}
+
 void DataObserver::OnStateChange() {
     ROS_INFO(
         "data state change for '%s' to '%d'",
         _dc->label().c_str(), _dc->state()
     );
+    if (_on_drain)
+        _on_drain();
+}
+
+void DataObserver::OnBufferedAmountChange(uint64_t previous_amount) {
+    if (_on_drain)
+        _on_drain();
 }
 
 // UnchunkedDataObserver
@@ -151,13 +195,13 @@ void UnchunkedDataObserver::OnMessage(const webrtc::DataBuffer& buffer) {
     );
     ros_webrtc::Data msg;
     msg.label = _dc->label();
-    msg.encoding = buffer.binary ? "utf-8" : "binary";
+    msg.encoding = buffer.binary ? "binary" : "utf-8";
     msg.buffer.insert(
         msg.buffer.end(),
         buffer.data.cdata(),
         buffer.data.cdata() + buffer.data.size()
     );
-    _rpub.publish(msg);
+    _publish(msg);
 }
 
 // ChunkedDataObserver
@@ -166,27 +210,139 @@ ChunkedDataObserver::ChunkedDataObserver(
     ros::NodeHandle& nh,
     const std::string& topic,
     uint32_t queue_size,
-    webrtc::DataChannelInterface* data_channel
-    ) : DataObserver(nh, topic, queue_size, data_channel) {
+    webrtc::DataChannelInterface* data_channel,
+    size_t chunk_size,
+    const ros::Duration& expiry,
+    size_t limit,
+    ChunkedMessageBudgetPtr budget,
+    size_t spill_threshold,
+    const std::string& spill_dir,
+    ChunkedMessageBudgetPtr spill_budget
+    ) : DataObserver(nh, topic, queue_size, data_channel),
+        _chunk_size(chunk_size),
+        _expiry(expiry),
+        _limit(limit),
+        _budget(budget),
+        _spill_threshold(spill_threshold),
+        _spill_dir(spill_dir),
+        _spill_budget(spill_budget),
+        _bytes(0),
+        _spill_bytes(0),
+        _expired(0),
+        _evicted(0),
+        _rejected(0),
+        _spilled(0) {
+    if (_spill_threshold != 0) {
+        _fpub = nh.advertise<ros_webrtc::DataFile>(topic + "/file", queue_size);
+    }
 }
 
-size_t ChunkedDataObserver::reap() {
-    size_t count = 0;
-    Messages::iterator i = _messages.begin();
-    while (i != _messages.end()) {
-        if ((*i).second->is_expired()) {
+ChunkedDataObserver::~ChunkedDataObserver() {
+    // stop OnMessage before releasing what's reserved
+    _dc->UnregisterObserver();
+    rtc::CritScope cs(&_cs);
+    if (_resume_store) {
+        // only files are resumed, and those in memory would no longer be budgeted
+        double now = ros::Time::now().toSec();
+        size_t suspended = 0;
+        for (auto i = _messages.begin(); i != _messages.end(); i++) {
+            if ((*i).second->chunks->is_spilled() &&
+                _resume_store->suspend(_resume_key, (*i).second->chunks, now))
+                suspended++;
+        }
+        if (suspended != 0) {
+            ROS_INFO_STREAM(
+                "data channel '" << _dc->label() << "' suspended " <<
+                suspended << " partially received message(s)"
+            );
+        }
+    }
+    if (_budget) {
+        _budget->release(_bytes);
+    }
+    if (_spill_budget) {
+        _spill_budget->release(_spill_bytes);
+    }
+}
+
+void ChunkedDataObserver::resume(const ResumeStorePtr& store, const std::string& key) {
+    std::vector<ChunkedMessagePtr> suspended;
+    store->take(key, suspended);
+    rtc::CritScope cs(&_cs);
+    _resume_store = store;
+    _resume_key = key;
+    for (auto i = suspended.begin(); i != suspended.end(); i++) {
+        const ChunkedMessagePtr& chunks = *i;
+        // must have been chunked the same way
+        if (chunks->capacity() != chunks->total() * _chunk_size ||
+            _messages.find(chunks->id()) != _messages.end())
+            continue;
+        size_t size = chunks->memory();
+        size_t spill_size = chunks->is_spilled() ? chunks->capacity() : 0;
+        if ((_limit != 0 && _bytes + size > _limit) || (_budget && !_budget->reserve(size))) {
+            ROS_WARN_STREAM(
+                "data message for '" << _dc->label() << "' w/ id " << chunks->id() << " "
+                << "exceeds budget, not resuming"
+            );
+            continue;
+        }
+        if (_spill_budget && !_spill_budget->reserve(spill_size)) {
             ROS_WARN_STREAM(
-                "data message for '" << _dc->label()
-                << "' w/" << " id "  << (*i).second->id << " expired @" << (*i).second->expires_at
-                << ", discarding ... "
+                "data message for '" << _dc->label() << "' w/ id " << chunks->id() << " "
+                << "exceeds spill budget, not resuming"
             );
-            count++;
-            _messages.erase(i++);  // http://stackoverflow.com/a/596180
-        } else {
-            i++;
+            if (_budget)
+                _budget->release(size);
+            continue;
         }
+        MessagePtr message(new Message(chunks));
+        message->expiry = _wheel.add(chunks->id(), (ros::Time::now() + _expiry).toSec());
+        message->age = chunks->is_spilled() ? _ages.end() : _ages.insert(_ages.end(), chunks->id());
+        _messages.insert(Messages::value_type(chunks->id(), message));
+        _bytes += size;
+        _spill_bytes += spill_size;
+        ROS_INFO_STREAM(
+            "data message for '" << _dc->label() << "' w/ id " << chunks->id() << " "
+            << "resumed w/ " << chunks->count() << "/" << chunks->total() << " chunk(s)"
+        );
+    }
+}
+
+void ChunkedDataObserver::_on_offer(const std::string& id, size_t total) {
+    // tell the sender which chunks we already have, if any
+    ChunkedMessage::Ranges ranges;
+    {
+        rtc::CritScope cs(&_cs);
+        auto i = _messages.find(id);
+        if (i != _messages.end() && (*i).second->chunks->total() == total)
+            (*i).second->chunks->received(ranges);
+    }
+    Json::Value reply;
+    reply["resume"] = id;
+    reply["total"] = static_cast<Json::UInt>(total);
+    reply["have"] = Json::Value(Json::arrayValue);
+    for (auto i = ranges.begin(); i != ranges.end(); i++) {
+        Json::Value range(Json::arrayValue);
+        range.append(static_cast<Json::UInt>((*i).first));
+        range.append(static_cast<Json::UInt>((*i).second));
+        reply["have"].append(range);
     }
-    return count;
+    _dc->Send(webrtc::DataBuffer(reply.toStyledString()));
+}
+
+size_t ChunkedDataObserver::reap() {
+    rtc::CritScope cs(&_cs);
+    return _expire(ros::Time::now().toSec());
+}
+
+void ChunkedDataObserver::stats(ros_webrtc::DataChannel& dst) const {
+    rtc::CritScope cs(&_cs);
+    dst.reassembly_messages = _messages.size();
+    dst.reassembly_bytes = _bytes;
+    dst.reassembly_expired = _expired;
+    dst.reassembly_evicted = _evicted;
+    dst.reassembly_rejected = _rejected;
+    dst.reassembly_spilled = _spilled;
 }
 
 void ChunkedDataObserver::OnMessage(const webrtc::DataBuffer& buffer) {
@@ -212,102 +368,311 @@ void ChunkedDataObserver::OnMessage(const webrtc::DataBuffer& buffer) {
         return;
     }
 
+    // resume handshake
+    if (chunk.isMember("offer")) {
+        if (!chunk["offer"].isString() || !chunk.isMember("total") || !chunk["total"].isUInt()) {
+            ROS_WARN_STREAM(
+                "data message for '" << _dc->label() << "' invalid offer"
+            );
+            return;
+        }
+        _on_offer(chunk["offer"].asString(), chunk["total"].asUInt());
+        return;
+    }
+    if (chunk.isMember("resume")) {
+        ChunkedMessage::Ranges ranges;
+        const Json::Value& have = chunk["have"];
+        bool valid = chunk["resume"].isString() && chunk["total"].isUInt() && have.isArray();
+        for (Json::ArrayIndex i = 0; valid && i != have.size(); i++) {
+            valid = have[i].isArray() && have[i].size() == 2 &&
+                have[i][0].isUInt() && have[i][1].isUInt();
+            if (valid)
+                ranges.push_back(std::make_pair(have[i][0].asUInt(), have[i][1].asUInt()));
+        }
+        if (!valid) {
+            ROS_WARN_STREAM(
+                "data message for '" << _dc->label() << "' invalid resume"
+            );
+            return;
+        }
+        if (_on_resume)
+            _on_resume(chunk["resume"].asString(), chunk["total"].asUInt(), ranges);
+        return;
+    }
+
     // validate chunk
     // TODO: use json schema
     if (!chunk.isMember("id") || !chunk["id"].isString() ||
         !chunk.isMember("total") || !chunk["total"].isUInt() ||
         !chunk.isMember("index") || !chunk["index"].isUInt() ||
-        !chunk.isMember("data") || !chunk["data"].isString()) {
+        !chunk.isMember("data") || !chunk["data"].isString() ||
+        chunk["total"].asUInt() == 0) {
         ROS_WARN_STREAM(
             "data message for '" << _dc->label() << "' invalid"
         );
         return;
     }
+    std::string id = chunk["id"].asString();
+    size_t total = chunk["total"].asUInt();
+    const char *begin = NULL, *end = NULL;
+    chunk["data"].getString(&begin, &end);
+
+    // chunks of files carry a checksum
+    if (chunk.isMember("crc32") &&
+        (!chunk["crc32"].isUInt() ||
+         chunk["crc32"].asUInt() != crc32(reinterpret_cast<const uint8_t *>(begin), end - begin))) {
+        ROS_WARN_STREAM(
+            "data message for '" << _dc->label() << "' w/ id " << id << " "
+            << "chunk " << chunk["index"].asUInt() << " failed checksum"
+        );
+        return;
+    }
+
+    rtc::CritScope cs(&_cs);
+
+    _expire(ros::Time::now().toSec());
 
     // message for chunk
-    bool created = false;
     MessagePtr message;
-    Messages::iterator i = _messages.find(chunk["id"].asString());
+    Messages::iterator i = _messages.find(id);
     if (i == _messages.end()) {
-        message.reset(new Message(
-            chunk["id"].asString(),
-            chunk["total"].asUInt(),
-            ros::Duration(10 * 60 /* 10 mins*/ )
-        ));
-        _messages.insert(Messages::value_type(chunk["id"].asString(), message));
-        created = true;
+        message = _admit(id, total);
+        if (!message)
+            return;
     } else {
         message = (*i).second;
+        if (message->chunks->total() != total) {
+            ROS_WARN_STREAM(
+                "data message for '" << _dc->label() << "' w/ id " << id << " "
+                << "total " << total << " != " << message->chunks->total()
+            );
+            return;
+        }
     }
 
     // add chunk to message and finalize if complete
-    message->add_chunk(chunk["index"].asUInt(), chunk["data"].asString());
-    if (message->is_complete()) {
-        _messages.erase(chunk["id"].asString());
-        ros_webrtc::Data msg;
-        msg.label = _dc->label();
-        message->merge(msg);
-        ROS_DEBUG_STREAM(
-            "merged data message for '" << _dc->label() << "' - "
-            << "encoding=" << msg.encoding << ", "
-            << "size=" << msg.buffer.size()
-        );
-        _rpub.publish(msg);
+    auto result = message->chunks->add_chunk(
+        chunk["index"].asUInt(),
+        reinterpret_cast<const uint8_t *>(begin),
+        end - begin
+    );
+    switch (result) {
+        case ChunkedMessage::Added:
+            break;
+        case ChunkedMessage::Completed: {
+            if (message->chunks->is_spilled()) {
+                ros_webrtc::DataFile msg;
+                msg.label = _dc->label();
+                msg.id = id;
+                msg.size = message->chunks->size();
+                message->chunks->release(msg.path);
+                _discard(_messages.find(id));
+                ROS_INFO_STREAM(
+                    "spilled data message for '" << _dc->label() << "' - "
+                    << "path=" << msg.path << ", "
+                    << "size=" << msg.size
+                );
+                _fpub.publish(msg);
+                break;
+            }
+            ros_webrtc::Data msg;
+            msg.label = _dc->label();
+            msg.encoding = "utf-8";
+            message->chunks->release(msg.buffer);
+            _discard(_messages.find(id));
+            ROS_DEBUG_STREAM(
+                "merged data message for '" << _dc->label() << "' - "
+                << "encoding=" << msg.encoding << ", "
+                << "size=" << msg.buffer.size()
+            );
+            _publish(msg);
+            break;
+        }
+        case ChunkedMessage::WriteFailed:
+            ROS_WARN_STREAM(
+                "data message for '" << _dc->label() << "' w/ id " << id << " "
+                << "failed writing to '" << message->chunks->path() << "', discarding ..."
+            );
+            _discard(_messages.find(id));
+            break;
+        case ChunkedMessage::Duplicate:
+            ROS_DEBUG_STREAM(
+                "data message for '" << _dc->label() << "' w/ id " << id << " "
+                << "duplicate chunk " << chunk["index"].asUInt()
+            );
+            break;
+        default:
+            ROS_WARN_STREAM(
+                "data message for '" << _dc->label() << "' w/ id " << id << " "
+                << "invalid chunk " << chunk["index"].asUInt() << "/" << total << " "
+                << "w/ size " << end - begin
+            );
+            break;
     }
-
 }
 
-// ChunkedDataObserver::Message
+ChunkedDataObserver::MessagePtr ChunkedDataObserver::_admit(const std::string& id, size_t total) {
+    // room for the record of received chunks too
+    bool overflows = total > std::numeric_limits<size_t>::max() / (_chunk_size + 1);
+    size_t size = overflows ? std::numeric_limits<size_t>::max() : ChunkedMessage::memory(total, _chunk_size, false);
 
-ChunkedDataObserver::Message::Message(
-    const std::string& id,
-    size_t count,
-    const ros::Duration& duration
-    ) : id(id), count(count), expires_at(ros::Time::now() + duration) {
-}
+    // large messages go to disk, unless they need to be decoded once complete
+    if (!overflows && _spill_threshold != 0 && total * _chunk_size > _spill_threshold && !_on_message)
+        return _spill(id, total);
 
-void ChunkedDataObserver::Message::add_chunk(size_t index, const std::string& data) {
-    for (std::list<Chunk>::iterator i = chunks.begin(); i != chunks.end(); i++) {
-        if (index < (*i).index) {
-            chunks.insert(i, Chunk(index, data));
-            return;
-        }
-        if (index == (*i).index) {
-            return;
+    if (overflows ||
+        (_limit != 0 && size > _limit) ||
+        (_budget && _budget->limit() != 0 && size > _budget->limit())) {
+        ROS_WARN_STREAM(
+            "data message for '" << _dc->label() << "' w/ id " << id << " "
+            << "too large (" << total << " x " << _chunk_size << "), rejecting ..."
+        );
+        _rejected++;
+        return MessagePtr();
+    }
+
+    // evict oldest until it fits this channel's and then the shared budget
+    while (_limit != 0 && _bytes + size > _limit && !_ages.empty()) {
+        ROS_WARN_STREAM(
+            "data message for '" << _dc->label() << "' w/ id " << _ages.front() << " "
+            << "evicted from channel budget"
+        );
+        _evicted++;
+        _discard(_messages.find(_ages.front()));
+    }
+    if (_limit != 0 && _bytes + size > _limit) {
+        // rest is held by spilled messages, which can't be evicted
+        ROS_WARN_STREAM(
+            "data message for '" << _dc->label() << "' w/ id " << id << " "
+            << "exceeds channel budget, rejecting ..."
+        );
+        _rejected++;
+        return MessagePtr();
+    }
+    while (_budget && !_budget->reserve(size)) {
+        if (_ages.empty()) {
+            ROS_WARN_STREAM(
+                "data message for '" << _dc->label() << "' w/ id " << id << " "
+                << "exceeds shared budget (" << _budget->used() << "/" << _budget->limit() << "), "
+                << "rejecting ..."
+            );
+            _rejected++;
+            return MessagePtr();
         }
+        ROS_WARN_STREAM(
+            "data message for '" << _dc->label() << "' w/ id " << _ages.front() << " "
+            << "evicted from shared budget"
+        );
+        _evicted++;
+        _discard(_messages.find(_ages.front()));
     }
-    chunks.push_back(Chunk(index, data));
+
+    MessagePtr message(new Message(
+        ChunkedMessagePtr(new ChunkedMessage(id, total, _chunk_size))
+    ));
+    message->expiry = _wheel.add(id, (ros::Time::now() + _expiry).toSec());
+    message->age = _ages.insert(_ages.end(), id);
+    _messages.insert(Messages::value_type(id, message));
+    _bytes += size;
+    return message;
 }
 
-void ChunkedDataObserver::Message::merge(ros_webrtc::Data &msg) {
-    size_t length = 0;
-    for (std::list<Chunk>::const_iterator i = chunks.begin(); i != chunks.end(); i++) {
-        length += (*i).buffer.size();
+ChunkedDataObserver::MessagePtr ChunkedDataObserver::_spill(const std::string& id, size_t total) {
+    size_t size = ChunkedMessage::memory(total, _chunk_size, true);
+    size_t spill_size = total * _chunk_size;
+
+    // too small to be worth evicting messages in memory for
+    if ((_limit != 0 && _bytes + size > _limit) || (_budget && !_budget->reserve(size))) {
+        ROS_WARN_STREAM(
+            "data message for '" << _dc->label() << "' w/ id " << id << " "
+            << "exceeds budget, rejecting ..."
+        );
+        _rejected++;
+        return MessagePtr();
+    }
+    if (_spill_budget && !_spill_budget->reserve(spill_size)) {
+        ROS_WARN_STREAM(
+            "data message for '" << _dc->label() << "' w/ id " << id << " "
+            << "exceeds spill budget (" << _spill_budget->used() << "/" << _spill_budget->limit() << "), "
+            << "rejecting ..."
+        );
+        if (_budget)
+            _budget->release(size);
+        _rejected++;
+        return MessagePtr();
     }
-    msg.encoding = "utf-8";
-    msg.buffer.reserve(length);
-    for (std::list<Chunk>::const_iterator i = chunks.begin(); i != chunks.end(); i++) {
-        msg.buffer.insert(
-            msg.buffer.end(),
-            &(*i).buffer[0],
-            &(*i).buffer[0] + (*i).buffer.size()
+
+    std::string path = _spill_dir + "/ros_webrtc-" + generate_id();
+    MessagePtr message(new Message(
+        ChunkedMessagePtr(new ChunkedMessage(id, total, _chunk_size, path))
+    ));
+    if (!message->chunks->is_open()) {
+        ROS_WARN_STREAM(
+            "data message for '" << _dc->label() << "' w/ id " << id << " "
+            << "cannot be spilled to '" << path << "' - " << strerror(errno)
+            << ", rejecting ..."
         );
+        if (_budget)
+            _budget->release(size);
+        if (_spill_budget)
+            _spill_budget->release(spill_size);
+        _rejected++;
+        return MessagePtr();
     }
+    // never evicted to make room in memory
+    message->expiry = _wheel.add(id, (ros::Time::now() + _expiry).toSec());
+    message->age = _ages.end();
+    _messages.insert(Messages::value_type(id, message));
+    _bytes += size;
+    _spill_bytes += spill_size;
+    _spilled++;
+    return message;
 }
 
-bool ChunkedDataObserver::Message::is_complete() const {
-    return chunks.size() == count;
+void ChunkedDataObserver::_discard(Messages::iterator i) {
+    if (i == _messages.end())
+        return;
+    MessagePtr message = (*i).second;
+    _wheel.remove(message->expiry);
+    if (message->age != _ages.end())
+        _ages.erase(message->age);
+    _messages.erase(i);
+    size_t size = message->chunks->memory();
+    _bytes -= size;
+    if (_budget) {
+        _budget->release(size);
+    }
+    // spill files are removed w/ the message, if not yet released
+    if (message->chunks->is_spilled()) {
+        size_t spill_size = message->chunks->capacity();
+        _spill_bytes -= spill_size;
+        if (_spill_budget)
+            _spill_budget->release(spill_size);
+    }
 }
 
-bool ChunkedDataObserver::Message::is_expired() const {
-    return expires_at < ros::Time::now();
+size_t ChunkedDataObserver::_expire(double now) {
+    std::vector<std::string> expired;
+    _wheel.advance(now, expired);
+    for (auto i = expired.begin(); i != expired.end(); i++) {
+        ROS_WARN_STREAM(
+            "data message for '" << _dc->label()
+            << "' w/" << " id "  << *i << " expired, discarding ... "
+        );
+        Messages::iterator j = _messages.find(*i);
+        if (j != _messages.end()) {
+            // already off the wheel
+            (*j).second->expiry = ExpiryWheel::Handle();
+            _discard(j);
+        }
+    }
+    _expired += expired.size();
+    return expired.size();
 }
 
-// ChunkedDataObserver::Message::Chunk
+// ChunkedDataObserver::Message
 
-ChunkedDataObserver::Message::Chunk::Chunk(
-    size_t index_,
-    const std::string& buffer_
-    ) : index(index_) {
-    buffer.insert(buffer.end(), &buffer_[0], &buffer_[0] + buffer_.size());
+ChunkedDataObserver::Message::Message(
+    const ChunkedMessagePtr& chunks
+    ) : chunks(chunks) {
 }
@@ -1,18 +1,28 @@
 #ifndef ROS_WEBRTC_RENDERER_H_
 #define ROS_WEBRTC_RENDERER_H_
 
+#include <list>
 #include <string>
+#include <unordered_map>
 
+#include <boost/function.hpp>
 #include <boost/shared_ptr.hpp>
 #include <ros/ros.h>
 #include <ros_webrtc/Audio.h>
 #include <ros_webrtc/Data.h>
+#include <ros_webrtc/DataChannel.h>
+#include <ros_webrtc/DataFile.h>
 #include <sensor_msgs/Image.h>
 #include <webrtc/api/mediastreaminterface.h>
 #include <webrtc/api/datachannelinterface.h>
+#include <webrtc/base/criticalsection.h>
 #include <webrtc/base/scoped_ref_ptr.h>
 #include <webrtc/media/base/videosinkinterface.h>
 
+#include "chunked_message.h"
+#include "expiry_wheel.h"
+#include "resume_store.h"
+
 class AudioSink : public webrtc::AudioTrackSinkInterface {
 
 public:
@@ -100,18 +110,64 @@ public:
 
     virtual size_t reap() = 0;
 
+    /**
+     * \brief Adds receive statistics to a data channel description.
+     */
+    virtual void stats(ros_webrtc::DataChannel& dst) const;
+
+    /**
+     * \brief Registers a callback for when the data channel can accept more data.
+     * \param callback Called on state and buffered amount changes.
+     */
+    void on_drain(const boost::function<void ()>& callback);
+
+    /**
+     * \brief Registers a callback for received messages.
+     * \param callback Called with each received message before it is published, returning whether to still publish it.
+     */
+    void on_message(const boost::function<bool (ros_webrtc::Data&)>& callback);
+
+    /**
+     * \brief Called when the remote peer reports which chunks of a transfer it already has.
+     */
+    typedef boost::function<void (const std::string& id, size_t total, const ChunkedMessage::Ranges& have)> OnResume;
+
+    void on_resume(const OnResume& callback);
+
+    /**
+     * \brief Takes over messages suspended by a previous channel, and suspends its own when destroyed.
+     * \param store Holds suspended messages.
+     * \param key Identifies the peer and label, see ResumeStore::key.
+     */
+    virtual void resume(const ResumeStorePtr& store, const std::string& key);
+
+    /**
+     * \brief Publishes a received message, bypassing the on_message callback.
+     */
+    void publish(const ros_webrtc::Data& msg);
+
 protected:
 
+    void _publish(ros_webrtc::Data& msg);
+
     rtc::scoped_refptr<webrtc::DataChannelInterface> _dc;
 
     ros::Publisher _rpub;
 
+    boost::function<void ()> _on_drain;
+
+    boost::function<bool (ros_webrtc::Data&)> _on_message;
+
+    OnResume _on_resume;
+
 // webrtc::DataChannelObserver
 
 public:
 
     virtual void OnStateChange();
 
+    virtual void OnBufferedAmountChange(uint64_t previous_amount);
+
 };
 
 typedef boost::shared_ptr<DataObserver> DataObserverPtr;
@@ -148,57 +204,104 @@ class ChunkedDataObserver : public DataObserver {
 
 public:
 
+    /**
+     * \brief Reassembles and publishes messages sent as chunks.
+     * \param chunk_size Size of all but the last chunk of a message.
+     * \param expiry Partially received messages are discarded after this.
+     * \param limit Maximum bytes of partially received messages for this channel, or 0 for no limit.
+     * \param budget Optional byte budget shared with other channels.
+     * \param spill_threshold Messages larger than this are reassembled in a file, or 0 to never spill.
+     * \param spill_dir Directory spill files are created in.
+     * \param spill_budget Optional byte budget of spilled messages shared with other channels.
+     *
+     * Spilled messages are published as ros_webrtc::DataFile messages on
+     * topic/file rather than as ros_webrtc::Data. Only the record of which of
+     * their chunks were received counts against limit and budget, their size
+     * counts against spill_budget.
+     */
     ChunkedDataObserver(
         ros::NodeHandle& nh,
         const std::string& topic,
         uint32_t queue_size,
-        webrtc::DataChannelInterface* data_channel
+        webrtc::DataChannelInterface* data_channel,
+        size_t chunk_size,
+        const ros::Duration& expiry,
+        size_t limit,
+        ChunkedMessageBudgetPtr budget,
+        size_t spill_threshold=0,
+        const std::string& spill_dir="/tmp",
+        ChunkedMessageBudgetPtr spill_budget=ChunkedMessageBudgetPtr()
     );
 
+    virtual ~ChunkedDataObserver();
+
 private:
 
     struct Message {
 
-        Message(
-            const std::string& id,
-            size_t count,
-            const ros::Duration& duration
-        );
+        Message(const ChunkedMessagePtr& chunks);
 
-        void add_chunk(size_t index, const std::string& data);
+        ChunkedMessagePtr chunks;
 
-        bool is_complete() const;
+        ExpiryWheel::Handle expiry;
 
-        bool is_expired() const;
+        std::list<std::string>::iterator age;
 
-        void merge(ros_webrtc::Data& msg);
+    };
 
-        std::string id;
+    typedef boost::shared_ptr<Message> MessagePtr;
 
-        size_t count;
+    typedef std::unordered_map<std::string, MessagePtr> Messages;
 
-        ros::Time expires_at;
+    MessagePtr _admit(const std::string& id, size_t total);
 
-        struct Chunk {
+    MessagePtr _spill(const std::string& id, size_t total);
 
-            Chunk(size_t index, const std::string &buffer);
+    void _discard(Messages::iterator i);
 
-            size_t index;
+    size_t _expire(double now);
 
-            std::vector<uint8_t> buffer;
+    void _on_offer(const std::string& id, size_t total);
 
-        };
+    size_t _chunk_size;
 
-        std::list<Chunk> chunks;
+    ros::Duration _expiry;
 
-    };
+    size_t _limit;
 
-    typedef boost::shared_ptr<Message> MessagePtr;
+    ChunkedMessageBudgetPtr _budget;
+
+    size_t _spill_threshold;
 
-    typedef std::map<std::string, MessagePtr> Messages;
+    std::string _spill_dir;
+
+    ChunkedMessageBudgetPtr _spill_budget;
+
+    ros::Publisher _fpub;
+
+    ResumeStorePtr _resume_store;
+
+    std::string _resume_key;
+
+    rtc::CriticalSection _cs;
 
     Messages _messages;
 
+    std::list<std::string> _ages; /*! Ids of messages in memory, oldest first. */
+
+    ExpiryWheel _wheel;
+
+    size_t _bytes; /*! Of memory, reserved from the budget. */
+
+    size_t _spill_bytes; /*! Of spill files, reserved from the spill budget. */
+
+    uint64_t _expired;
+
+    uint64_t _evicted;
+
+    uint64_t _rejected;
+
+    uint64_t _spilled;
 
 // DataObserver
 
@@ -206,6 +309,10 @@ public:
 
     virtual size_t reap();
 
+    virtual void stats(ros_webrtc::DataChannel& dst) const;
+
+    virtual void resume(const ResumeStorePtr& store, const std::string& key);
+
 // webrtc::DataChannelObserver
 
 public:
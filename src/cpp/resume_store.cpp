@@ -0,0 +1,101 @@
+#include "resume_store.h"
+
+#include <iterator>
+
+// ResumeStore
+
+ResumeStore::ResumeStore(double expiry, size_t limit) :
+    _expiry(expiry),
+    _limit(limit),
+    _bytes(0) {
+}
+
+std::string ResumeStore::key(const std::string& peer_id, const std::string& label) {
+    return peer_id + '\n' + label;
+}
+
+void ResumeStore::suspend(const std::string& key, const SuspendedFile& file, double now) {
+    Entry entry;
+    entry.key = key;
+    entry.expires_at = now + _expiry;
+    entry.file = file;
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.push_back(entry);
+}
+
+bool ResumeStore::suspend(const std::string& key, const ChunkedMessagePtr& message, double now) {
+    size_t size = message->capacity();
+    if (_limit != 0 && size > _limit)
+        return false;
+    Entry entry;
+    entry.key = key;
+    entry.expires_at = now + _expiry;
+    entry.message = message;
+    // messages, and their spill files, are released outside the lock
+    std::list<Entry> evicted;
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto i = _entries.begin(); _limit != 0 && _bytes + size > _limit && i != _entries.end();) {
+        if (!(*i).message) {
+            i++;
+            continue;
+        }
+        _bytes -= (*i).message->capacity();
+        auto next = std::next(i);
+        evicted.splice(evicted.end(), _entries, i);
+        i = next;
+    }
+    _entries.push_back(entry);
+    _bytes += size;
+    return true;
+}
+
+void ResumeStore::take(const std::string& key, std::vector<SuspendedFile>& files) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto i = _entries.begin(); i != _entries.end();) {
+        if ((*i).key != key || (*i).message) {
+            i++;
+            continue;
+        }
+        files.push_back((*i).file);
+        i = _entries.erase(i);
+    }
+}
+
+void ResumeStore::take(const std::string& key, std::vector<ChunkedMessagePtr>& messages) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto i = _entries.begin(); i != _entries.end();) {
+        if ((*i).key != key || !(*i).message) {
+            i++;
+            continue;
+        }
+        messages.push_back((*i).message);
+        _bytes -= (*i).message->capacity();
+        i = _entries.erase(i);
+    }
+}
+
+size_t ResumeStore::reap(double now) {
+    // messages, and their spill files, are released outside the lock
+    std::list<Entry> expired;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto i = _entries.begin();
+        while (i != _entries.end() && (*i).expires_at <= now) {
+            if ((*i).message)
+                _bytes -= (*i).message->capacity();
+            i++;
+        }
+        expired.splice(expired.end(), _entries, _entries.begin(), i);
+    }
+    return expired.size();
+}
+
+size_t ResumeStore::size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _entries.size();
+}
+
+size_t ResumeStore::bytes() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _bytes;
+}
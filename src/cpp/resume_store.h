@@ -0,0 +1,108 @@
+#ifndef ROS_WEBRTC_RESUME_STORE_H_
+#define ROS_WEBRTC_RESUME_STORE_H_
+
+#include <stddef.h>
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "chunked_message.h"
+
+/**
+ * \brief A file whose transfer stopped when its data channel closed.
+ */
+struct SuspendedFile {
+
+    std::string id;
+
+    std::string path;
+
+};
+
+/**
+ * \brief Keeps incomplete transfers of closed data channels for a while.
+ *
+ * A peer connection is deleted when ICE disconnects, taking its data
+ * channels with it. Transfers they had in progress are suspended here, by
+ * peer and label, so the next channel w/ the same label to the same peer
+ * can take them over and resume rather than start again.
+ */
+class ResumeStore {
+
+public:
+
+    /**
+     * \param expiry Seconds after which suspended transfers are discarded.
+     * \param limit Bytes of suspended inbound messages, oldest discarded first, or 0 for no limit.
+     */
+    ResumeStore(double expiry, size_t limit=0);
+
+    static std::string key(const std::string& peer_id, const std::string& label);
+
+    /**
+     * \brief Suspends an outbound file transfer.
+     */
+    void suspend(const std::string& key, const SuspendedFile& file, double now);
+
+    /**
+     * \brief Suspends an inbound, partially received message.
+     * \return False if it alone exceeds the limit.
+     */
+    bool suspend(const std::string& key, const ChunkedMessagePtr& message, double now);
+
+    /**
+     * \brief Removes and returns outbound file transfers suspended for key.
+     */
+    void take(const std::string& key, std::vector<SuspendedFile>& files);
+
+    /**
+     * \brief Removes and returns inbound messages suspended for key.
+     */
+    void take(const std::string& key, std::vector<ChunkedMessagePtr>& messages);
+
+    /**
+     * \brief Discards expired transfers.
+     * \return Number discarded.
+     */
+    size_t reap(double now);
+
+    size_t size() const;
+
+    /**
+     * \brief Bytes of suspended inbound messages, as counted against the limit.
+     */
+    size_t bytes() const;
+
+private:
+
+    struct Entry {
+
+        std::string key;
+
+        double expires_at;
+
+        SuspendedFile file;
+
+        ChunkedMessagePtr message; /*! Set if inbound. */
+
+    };
+
+    double _expiry;
+
+    size_t _limit;
+
+    mutable std::mutex _mutex;
+
+    std::list<Entry> _entries; /*! Oldest first. */
+
+    size_t _bytes;
+
+};
+
+typedef boost::shared_ptr<ResumeStore> ResumeStorePtr;
+
+#endif /* ROS_WEBRTC_RESUME_STORE_H_ */
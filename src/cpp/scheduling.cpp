@@ -0,0 +1,135 @@
+#include "scheduling.h"
+
+#include <algorithm>
+
+// DeficitRoundRobin
+
+DeficitRoundRobin::DeficitRoundRobin(size_t quantum) : _quantum(quantum) {
+}
+
+void DeficitRoundRobin::add(size_t id, int priority, size_t weight) {
+    remove(id);
+    Flow flow;
+    flow.priority = priority;
+    flow.weight = std::max<size_t>(weight, 1);
+    flow.deficit = 0;
+    flow.visited = false;
+    _flows[id] = flow;
+    Class& cls = _classes[priority];
+    bool was_empty = cls.flows.empty();
+    cls.flows.push_back(id);
+    if (was_empty)
+        cls.current = cls.flows.begin();
+}
+
+void DeficitRoundRobin::remove(size_t id) {
+    auto i = _flows.find(id);
+    if (i == _flows.end())
+        return;
+    auto c = _classes.find((*i).second.priority);
+    Class& cls = (*c).second;
+    auto j = std::find(cls.flows.begin(), cls.flows.end(), id);
+    if (j == cls.current)
+        _advance(cls);
+    cls.flows.erase(j);
+    if (cls.flows.empty())
+        _classes.erase(c);
+    _flows.erase(i);
+}
+
+bool DeficitRoundRobin::has(size_t id) const {
+    return _flows.find(id) != _flows.end();
+}
+
+size_t DeficitRoundRobin::size() const {
+    return _flows.size();
+}
+
+bool DeficitRoundRobin::select(const Head& head, size_t& id, size_t& size) {
+    // highest priority class first
+    for (auto i = _classes.rbegin(); i != _classes.rend(); i++) {
+        if (_select((*i).second, head, id, size))
+            return true;
+    }
+    return false;
+}
+
+bool DeficitRoundRobin::_select(Class& cls, const Head& head, size_t& id, size_t& size) {
+    size_t idle = 0;
+    while (idle < cls.flows.size()) {
+        size_t candidate = *cls.current;
+        Flow& flow = _flows[candidate];
+        size_t candidate_size;
+        if (!head(candidate, candidate_size)) {
+            // idle flows do not bank credit
+            flow.deficit = 0;
+            flow.visited = false;
+            idle += 1;
+            _advance(cls);
+            continue;
+        }
+        idle = 0;
+        if (!flow.visited) {
+            flow.deficit += _quantum * flow.weight;
+            flow.visited = true;
+        }
+        if (flow.deficit >= candidate_size) {
+            id = candidate;
+            size = candidate_size;
+            return true;
+        }
+        flow.visited = false;
+        _advance(cls);
+    }
+    return false;
+}
+
+void DeficitRoundRobin::charge(size_t id, size_t size) {
+    auto i = _flows.find(id);
+    if (i == _flows.end())
+        return;
+    Flow& flow = (*i).second;
+    flow.deficit -= std::min<uint64_t>(flow.deficit, size);
+}
+
+void DeficitRoundRobin::_advance(Class& cls) {
+    cls.current++;
+    if (cls.current == cls.flows.end())
+        cls.current = cls.flows.begin();
+}
+
+// TokenBucket
+
+TokenBucket::TokenBucket(double rate, double burst) :
+    _rate(rate),
+    _burst(burst),
+    _tokens(burst),
+    _updated_at(-1) {
+}
+
+bool TokenBucket::is_limited() const {
+    return _rate > 0;
+}
+
+bool TokenBucket::consume(size_t bytes, double now) {
+    if (!is_limited())
+        return true;
+    _refill(now);
+    if (_tokens <= 0)
+        return false;
+    _tokens -= bytes;
+    return true;
+}
+
+double TokenBucket::wait(double now) {
+    if (!is_limited())
+        return 0;
+    _refill(now);
+    return _tokens > 0 ? 0 : (-_tokens + 1) / _rate;
+}
+
+void TokenBucket::_refill(double now) {
+    if (_updated_at >= 0 && now > _updated_at)
+        _tokens = std::min(_burst, _tokens + (now - _updated_at) * _rate);
+    _updated_at = now;
+}
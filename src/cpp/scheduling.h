@@ -0,0 +1,146 @@
+#ifndef ROS_WEBRTC_SCHEDULING_H_
+#define ROS_WEBRTC_SCHEDULING_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <list>
+#include <map>
+
+#include <boost/function.hpp>
+
+/**
+ * \brief Picks which of several flows sends next.
+ *
+ * Flows in a higher priority class always go first. Flows in the same class
+ * share by deficit round-robin, each getting weight * quantum bytes per
+ * round, so small messages are not stuck behind large ones and weights are
+ * honored whatever the message sizes.
+ */
+class DeficitRoundRobin {
+
+public:
+
+    /**
+     * \brief Gets the size of a flow's next message.
+     * \return Whether the flow has a message to send.
+     */
+    typedef boost::function<bool (size_t id, size_t& size)> Head;
+
+    /**
+     * \param quantum Bytes credited to a flow of weight 1 per round.
+     */
+    DeficitRoundRobin(size_t quantum=16 * 1024);
+
+    /**
+     * \brief Adds a flow, or updates it if already added.
+     * \param id Identifies the flow.
+     * \param priority Priority class, higher goes first.
+     * \param weight Relative share of its class.
+     */
+    void add(size_t id, int priority, size_t weight=1);
+
+    void remove(size_t id);
+
+    bool has(size_t id) const;
+
+    size_t size() const;
+
+    /**
+     * \brief Picks the flow whose next message should be sent.
+     * \param head Gets the size of a flow's next message.
+     * \param id Set to the picked flow.
+     * \param size Set to the size of its next message.
+     * \return Whether any flow has a message to send.
+     */
+    bool select(const Head& head, size_t& id, size_t& size);
+
+    /**
+     * \brief Charges a flow for a message picked by select.
+     */
+    void charge(size_t id, size_t size);
+
+private:
+
+    struct Flow {
+
+        int priority;
+
+        size_t weight;
+
+        uint64_t deficit;
+
+        bool visited; /*! Credited for its current turn. */
+
+    };
+
+    typedef std::list<size_t> Round;
+
+    struct Class {
+
+        Round flows;
+
+        Round::iterator current;
+
+    };
+
+    bool _select(Class& cls, const Head& head, size_t& id, size_t& size);
+
+    void _advance(Class& cls);
+
+    size_t _quantum;
+
+    std::map<size_t, Flow> _flows;
+
+    std::map<int, Class> _classes;
+
+};
+
+/**
+ * \brief Limits throughput to a rate w/ bursts.
+ */
+class TokenBucket {
+
+public:
+
+    /**
+     * \param rate Bytes per second, or 0 for no limit.
+     * \param burst Bytes that can be sent at once after being idle.
+     */
+    TokenBucket(double rate=0, double burst=0);
+
+    bool is_limited() const;
+
+    /**
+     * \brief Takes tokens for bytes if any are available.
+     *
+     * The bucket can go into debt, so a message larger than the burst still
+     * goes out once the bucket is positive, and later ones wait for it to be
+     * paid off.
+     *
+     * \param bytes Number of bytes to send.
+     * \param now Current time in seconds.
+     * \return Whether bytes can be sent now.
+     */
+    bool consume(size_t bytes, double now);
+
+    /**
+     * \brief Seconds until consume can succeed.
+     */
+    double wait(double now);
+
+private:
+
+    void _refill(double now);
+
+    double _rate;
+
+    double _burst;
+
+    double _tokens;
+
+    double _updated_at;
+
+};
+
+#endif /* ROS_WEBRTC_SCHEDULING_H_ */
@@ -0,0 +1,196 @@
+#include "send_scheduler.h"
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+// SendScheduler
+
+SendScheduler::SendScheduler(ros::NodeHandle& nh, size_t quantum) :
+    _drr(quantum),
+    _next_link(0),
+    _next_id(0),
+    _now(0),
+    _wait(-1),
+    _pumping(false),
+    _pump_requested(false),
+    _timer_armed(false) {
+    _timer = nh.createWallTimer(
+        ros::WallDuration(0.001),
+        &SendScheduler::_on_timer,
+        this,
+        true,  // oneshot
+        false  // autostart
+    );
+}
+
+SendScheduler::~SendScheduler() {
+    // waits for any in-flight timer callback
+    _timer.stop();
+}
+
+size_t SendScheduler::add_link(
+        uint64_t high_watermark,
+        uint64_t low_watermark,
+        double bandwidth_limit) {
+    rtc::CritScope cs(&_cs);
+    Link link;
+    link.high_watermark = high_watermark;
+    link.low_watermark = low_watermark;
+    // allow ~100ms worth of bytes to go out at once
+    link.bucket = TokenBucket(bandwidth_limit, bandwidth_limit / 10);
+    link.buffered_amount = 0;
+    link.stalled = false;
+    size_t id = _next_link++;
+    _links[id] = link;
+    return id;
+}
+
+void SendScheduler::remove_link(size_t link) {
+    rtc::CritScope cs(&_cs);
+    for (auto i = _queues.begin(); i != _queues.end();) {
+        if ((*i).second.link != link) {
+            i++;
+            continue;
+        }
+        _drr.remove((*i).first);
+        _ids.erase((*i).second.queue.get());
+        i = _queues.erase(i);
+    }
+    _links.erase(link);
+}
+
+void SendScheduler::add(const QueuePtr& queue, size_t link, int priority, size_t weight) {
+    rtc::CritScope cs(&_cs);
+    if (_links.find(link) == _links.end()) {
+        ROS_WARN_STREAM("send scheduler has no link " << link << ", not scheduling");
+        return;
+    }
+    if (_ids.find(queue.get()) != _ids.end())
+        return;
+    Entry entry;
+    entry.queue = queue;
+    entry.link = link;
+    entry.buffered_amount = 0;
+    size_t id = _next_id++;
+    _queues[id] = entry;
+    _ids[queue.get()] = id;
+    _drr.add(id, priority, weight);
+}
+
+void SendScheduler::update(Queue* queue, int priority, size_t weight) {
+    rtc::CritScope cs(&_cs);
+    auto i = _ids.find(queue);
+    if (i == _ids.end())
+        return;
+    _drr.add((*i).second, priority, weight);
+}
+
+void SendScheduler::remove(Queue* queue) {
+    rtc::CritScope cs(&_cs);
+    auto i = _ids.find(queue);
+    if (i == _ids.end())
+        return;
+    size_t id = (*i).second;
+    _buffered(id, 0);
+    _drr.remove(id);
+    _queues.erase(id);
+    _ids.erase(i);
+}
+
+void SendScheduler::buffered(Queue* queue, uint64_t amount) {
+    rtc::CritScope cs(&_cs);
+    auto i = _ids.find(queue);
+    if (i == _ids.end())
+        return;
+    _buffered((*i).second, amount);
+}
+
+void SendScheduler::_buffered(size_t id, uint64_t amount) {
+    Entry& entry = _queues[id];
+    Link& link = _links[entry.link];
+    link.buffered_amount -= std::min(link.buffered_amount, entry.buffered_amount);
+    link.buffered_amount += amount;
+    entry.buffered_amount = amount;
+}
+
+void SendScheduler::pump() {
+    // Same as DataChannel::_pump, only one thread drains at a time and never
+    // while holding the lock, which the signaling thread takes to report
+    // buffered amounts.
+    _pump_requested = true;
+    while (_pump_requested) {
+        bool expected = false;
+        if (!_pumping.compare_exchange_strong(expected, true))
+            return;  // whoever is pumping will see the request
+        _pump_requested = false;
+        _drain();
+        _pumping = false;
+    }
+}
+
+void SendScheduler::_drain() {
+    double wait = -1;
+    while (true) {
+        QueuePtr queue;
+        {
+            rtc::CritScope cs(&_cs);
+            _now = ros::WallTime::now().toSec();
+            _wait = -1;
+            size_t id, size;
+            if (!_drr.select(boost::bind(&SendScheduler::_head, this, _1, _2), id, size)) {
+                wait = _wait;
+                break;
+            }
+            Entry& entry = _queues[id];
+            _links[entry.link].bucket.consume(size, _now);
+            _drr.charge(id, size);
+            queue = entry.queue;
+        }
+        uint64_t buffered_amount = 0;
+        if (queue->send_head(buffered_amount))
+            buffered(queue.get(), buffered_amount);
+    }
+
+    // rate limited links resume on a timer, stalled ones when they drain
+    if (wait > 0 && !_timer_armed.exchange(true)) {
+        _timer.stop();
+        _timer.setPeriod(ros::WallDuration(wait));
+        _timer.start();
+    }
+}
+
+bool SendScheduler::_head(size_t id, size_t& size) {
+    Entry& entry = _queues[id];
+    Link& link = _links[entry.link];
+    if (link.stalled) {
+        if (link.buffered_amount > link.low_watermark)
+            return false;
+        _set_stalled(entry.link, link, false);
+    }
+    if (!entry.queue->head(size))
+        return false;
+    if (link.buffered_amount >= link.high_watermark) {
+        _set_stalled(entry.link, link, true);
+        return false;
+    }
+    double wait = link.bucket.wait(_now);
+    if (wait > 0) {
+        _wait = _wait < 0 ? wait : std::min(_wait, wait);
+        return false;
+    }
+    return true;
+}
+
+void SendScheduler::_set_stalled(size_t link, Link& value, bool stalled) {
+    value.stalled = stalled;
+    for (auto i = _queues.begin(); i != _queues.end(); i++) {
+        if ((*i).second.link == link)
+            (*i).second.queue->stalled(stalled);
+    }
+}
+
+void SendScheduler::_on_timer(const ros::WallTimerEvent& event) {
+    _timer_armed = false;
+    pump();
+}
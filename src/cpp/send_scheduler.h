@@ -0,0 +1,173 @@
+#ifndef ROS_WEBRTC_SEND_SCHEDULER_H_
+#define ROS_WEBRTC_SEND_SCHEDULER_H_
+
+#include <atomic>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+#include <ros/ros.h>
+#include <webrtc/base/criticalsection.h>
+
+#include "scheduling.h"
+
+/**
+ * \brief Decides which data channel hands its next message to WebRTC.
+ *
+ * Data channels of a peer connection share one SCTP association, which sends
+ * whatever it was handed first. So rather than each channel filling the
+ * association on its own, queued messages are handed over here one at a time:
+ *
+ *  - higher priority channels always go first,
+ *  - channels of equal priority share by deficit round-robin on their weights,
+ *  - a peer connection (link) is only handed data while the amount buffered
+ *    across its channels is under a high watermark, and until it drains to a
+ *    low watermark once it reaches it,
+ *  - and a link can be limited to a number of bytes per second.
+ *
+ * Keeping little buffered below the scheduler means e.g. a teleop command
+ * waits behind at most a high watermark of a bulk transfer, not all of it.
+ */
+class SendScheduler {
+
+public:
+
+    /**
+     * \brief Messages waiting to be sent on a data channel.
+     */
+    class Queue {
+
+    public:
+
+        virtual ~Queue() {}
+
+        /**
+         * \brief Gets the size of the next message to send.
+         * \return Whether there is a message that can be sent.
+         */
+        virtual bool head(size_t& size) = 0;
+
+        /**
+         * \brief Hands the next message to the provider.
+         * \param buffered_amount Set to the provider's buffered amount after sending.
+         * \return Whether the message was sent.
+         */
+        virtual bool send_head(uint64_t& buffered_amount) = 0;
+
+        /**
+         * \brief Called when the queue's link stalls or resumes.
+         */
+        virtual void stalled(bool stalled) = 0;
+
+    };
+
+    typedef boost::shared_ptr<Queue> QueuePtr;
+
+    /**
+     * \param nh Node handle used to create the timer resuming rate limited sends.
+     * \param quantum Bytes per round given to queues of weight 1.
+     */
+    SendScheduler(ros::NodeHandle& nh, size_t quantum=16 * 1024);
+
+    ~SendScheduler();
+
+    /**
+     * \brief Adds a link over which queues send, i.e. a peer connection.
+     * \param high_watermark Stop sending once this many bytes are buffered across the link's queues.
+     * \param low_watermark Resume sending once buffered bytes drain to this.
+     * \param bandwidth_limit Bytes per second, or 0 for no limit.
+     * \return Id of the link.
+     */
+    size_t add_link(uint64_t high_watermark, uint64_t low_watermark, double bandwidth_limit);
+
+    void remove_link(size_t link);
+
+    /**
+     * \brief Schedules sends from a queue.
+     * \param queue The queue, held until removed.
+     * \param link Link the queue sends over.
+     * \param priority Priority class, higher goes first.
+     * \param weight Share of its priority class.
+     */
+    void add(const QueuePtr& queue, size_t link, int priority, size_t weight);
+
+    void update(Queue* queue, int priority, size_t weight);
+
+    void remove(Queue* queue);
+
+    /**
+     * \brief Records a queue's buffered amount, as reported by its provider.
+     */
+    void buffered(Queue* queue, uint64_t amount);
+
+    /**
+     * \brief Sends queued messages as scheduling allows.
+     */
+    void pump();
+
+private:
+
+    struct Link {
+
+        uint64_t high_watermark;
+
+        uint64_t low_watermark;
+
+        TokenBucket bucket;
+
+        uint64_t buffered_amount; /*! Across the link's queues. */
+
+        bool stalled;
+
+    };
+
+    struct Entry {
+
+        QueuePtr queue;
+
+        size_t link;
+
+        uint64_t buffered_amount;
+
+    };
+
+    bool _head(size_t id, size_t& size);
+
+    void _set_stalled(size_t link, Link& value, bool stalled);
+
+    void _buffered(size_t id, uint64_t amount);
+
+    void _drain();
+
+    void _on_timer(const ros::WallTimerEvent& event);
+
+    rtc::CriticalSection _cs;
+
+    DeficitRoundRobin _drr;
+
+    std::map<size_t, Link> _links;
+
+    size_t _next_link;
+
+    std::map<size_t, Entry> _queues;
+
+    std::map<Queue*, size_t> _ids;
+
+    size_t _next_id;
+
+    double _now; /*! When the current selection started. */
+
+    double _wait; /*! Seconds until a rate limited link can send, or < 0 if none. */
+
+    std::atomic<bool> _pumping;
+
+    std::atomic<bool> _pump_requested;
+
+    ros::WallTimer _timer;
+
+    std::atomic<bool> _timer_armed;
+
+};
+
+typedef boost::shared_ptr<SendScheduler> SendSchedulerPtr;
+
+#endif /* ROS_WEBRTC_SEND_SCHEDULER_H_ */
@@ -0,0 +1,112 @@
+#include "session_queues.h"
+
+#include <algorithm>
+#include <functional>
+#include <future>
+
+namespace {
+
+thread_local ros::CallbackQueue* current_queue = NULL;
+
+}
+
+// SessionQueues::FunctionCallback
+
+class SessionQueues::FunctionCallback : public ros::CallbackInterface {
+
+public:
+
+    FunctionCallback(ros::CallbackQueue* queue, const boost::function<bool ()>& function) :
+        _queue(queue),
+        _function(function) {
+    }
+
+    std::future<bool> result() {
+        return _result.get_future();
+    }
+
+// ros::CallbackInterface
+
+public:
+
+    virtual ros::CallbackInterface::CallResult call() {
+        current_queue = _queue;
+        try {
+            _result.set_value(_function());
+        } catch (...) {
+            _result.set_exception(std::current_exception());
+        }
+        current_queue = NULL;
+        return Success;
+    }
+
+private:
+
+    ros::CallbackQueue* _queue;
+
+    boost::function<bool ()> _function;
+
+    std::promise<bool> _result;
+
+};
+
+// SessionQueues
+
+SessionQueues::SessionQueues(size_t count) {
+    for (size_t i = 0; i != std::max<size_t>(1, count); i++)
+        _shards.push_back(std::unique_ptr<Shard>(new Shard()));
+}
+
+SessionQueues::~SessionQueues() {
+    stop();
+}
+
+void SessionQueues::start() {
+    for (auto i = _shards.begin(); i != _shards.end(); i++) {
+        (*i)->queue.enable();
+        (*i)->spinner.reset(new ros::AsyncSpinner(1, &(*i)->queue));
+        (*i)->spinner->start();
+    }
+}
+
+void SessionQueues::stop() {
+    for (auto i = _shards.begin(); i != _shards.end(); i++) {
+        if ((*i)->spinner) {
+            (*i)->spinner->stop();
+            (*i)->spinner.reset();
+        }
+        // waiting callers see a broken promise
+        (*i)->queue.disable();
+        (*i)->queue.clear();
+    }
+}
+
+size_t SessionQueues::size() const {
+    return _shards.size();
+}
+
+ros::CallbackQueue& SessionQueues::queue(const std::string& session_id, const std::string& peer_id) {
+    size_t hash = std::hash<std::string>()(session_id + '\n' + peer_id);
+    return _shards[hash % _shards.size()]->queue;
+}
+
+bool SessionQueues::call(
+    const std::string& session_id,
+    const std::string& peer_id,
+    const boost::function<bool ()>& function) {
+    ros::CallbackQueue& dst = queue(session_id, peer_id);
+    if (current_queue == &dst)
+        return function();
+    std::future<bool> result;
+    {
+        // only the queue holds the callback, so dropping it breaks the promise
+        boost::shared_ptr<FunctionCallback> callback(new FunctionCallback(&dst, function));
+        result = callback->result();
+        dst.addCallback(callback);
+    }
+    try {
+        return result.get();
+    } catch (const std::future_error&) {
+        return false;
+    }
+}
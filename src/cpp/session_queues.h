@@ -0,0 +1,74 @@
+#ifndef ROS_WEBRTC_SESSION_QUEUES_H_
+#define ROS_WEBRTC_SESSION_QUEUES_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+#include <ros/callback_queue.h>
+#include <ros/spinner.h>
+
+/**
+ * \brief Callback queues, each w/ its own thread, that peer connections are sharded across.
+ *
+ * Callbacks for a peer connection always go to the same queue so they run
+ * in order, while those for peer connections on other queues run in
+ * parallel.
+ */
+class SessionQueues {
+
+public:
+
+    /**
+     * \param count Number of queues, and so threads.
+     */
+    SessionQueues(size_t count);
+
+    ~SessionQueues();
+
+    void start();
+
+    /**
+     * \brief Stops the threads and drops pending callbacks.
+     */
+    void stop();
+
+    size_t size() const;
+
+    /**
+     * \brief Queue callbacks for a peer connection are added to.
+     */
+    ros::CallbackQueue& queue(const std::string& session_id, const std::string& peer_id);
+
+    /**
+     * \brief Runs a function on the queue of a peer connection and waits for it to finish.
+     * \return What the function returned, or false if stopped before it ran.
+     *
+     * Runs it directly if already on that queue's thread.
+     */
+    bool call(
+        const std::string& session_id,
+        const std::string& peer_id,
+        const boost::function<bool ()>& function
+    );
+
+private:
+
+    class FunctionCallback;
+
+    struct Shard {
+
+        ros::CallbackQueue queue;
+
+        std::unique_ptr<ros::AsyncSpinner> spinner;
+
+    };
+
+    std::vector<std::unique_ptr<Shard> > _shards;
+
+};
+
+typedef std::unique_ptr<SessionQueues> SessionQueuesPtr;
+
+#endif /* ROS_WEBRTC_SESSION_QUEUES_H_ */
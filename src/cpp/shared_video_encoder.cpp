@@ -0,0 +1,376 @@
+#include "shared_video_encoder.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+#include <ros/ros.h>
+#include <webrtc/modules/video_coding/codecs/vp8/include/vp8.h>
+#include <webrtc/modules/video_coding/include/video_error_codes.h>
+
+namespace {
+
+// frames a new member may still move to another group that encoded the same one
+const uint32_t JOIN_FRAMES = 30;
+
+// identifies a frame, the same for every tagged copy of it
+const webrtc::VideoFrameBuffer* frame_id(const webrtc::VideoFrame& frame, VideoFrameTag& tag) {
+    const webrtc::VideoFrameBuffer* buffer = frame.video_frame_buffer().get();
+    if (find_video_frame_tag(buffer, tag))
+        return tag.frame;
+    tag = VideoFrameTag();
+    return buffer;
+}
+
+}
+
+// SharedEncoderGroup
+
+SharedEncoderGroup::SharedEncoderGroup(
+    const webrtc::VideoCodec& settings,
+    int temporal_layers,
+    int32_t number_of_cores,
+    size_t max_payload_size) :
+    _settings(settings),
+    _encoder(webrtc::VP8Encoder::Create()),
+    _open(false),
+    _temporal_layers(std::min(std::max(1, temporal_layers), MAX_TEMPORAL_LAYERS)),
+    _last_frame(NULL),
+    _key_pending(true),
+    _bitrate(0),
+    _framerate(0) {
+    webrtc::VideoCodec codec = _settings;
+    if (_temporal_layers > 1)
+        codec.codecSpecific.VP8.numberOfTemporalLayers = _temporal_layers;
+    _encoder->RegisterEncodeCompleteCallback(this);
+    _open = _encoder->InitEncode(&codec, number_of_cores, max_payload_size) == WEBRTC_VIDEO_CODEC_OK;
+    if (!_open) {
+        ROS_WARN_STREAM(
+            "shared encoder " << _settings.width << "x" << _settings.height << " init failed"
+        );
+    }
+}
+
+SharedEncoderGroup::~SharedEncoderGroup() {
+    _encoder->Release();
+}
+
+bool SharedEncoderGroup::is_open() const {
+    return _open;
+}
+
+bool SharedEncoderGroup::matches(const webrtc::VideoCodec& settings) const {
+    if (settings.codecType != _settings.codecType ||
+        settings.width != _settings.width ||
+        settings.height != _settings.height ||
+        settings.maxFramerate != _settings.maxFramerate ||
+        settings.mode != _settings.mode ||
+        settings.numberOfSimulcastStreams != _settings.numberOfSimulcastStreams)
+        return false;
+    if (settings.codecType == webrtc::kVideoCodecVP8 &&
+        settings.codecSpecific.VP8.numberOfTemporalLayers != _settings.codecSpecific.VP8.numberOfTemporalLayers)
+        return false;
+    return true;
+}
+
+bool SharedEncoderGroup::encoded(const webrtc::VideoFrame& frame) const {
+    VideoFrameTag tag;
+    const webrtc::VideoFrameBuffer* id = frame_id(frame, tag);
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _last_frame != NULL && _last_frame == id;
+}
+
+void SharedEncoderGroup::add(void* member, webrtc::EncodedImageCallback* callback) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    Member m;
+    m.id = member;
+    m.callback = callback;
+    m.bitrate = 0;
+    m.framerate = 0;
+    // random start like the encoder's own, it's new to the receiver
+    m.picture_id = std::rand() & 0x7FFF;
+    _members.push_back(m);
+    // it can't decode anything until the next keyframe
+    _key_pending = true;
+}
+
+size_t SharedEncoderGroup::remove(void* member) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _members.remove_if([member](const Member& m) { return m.id == member; });
+    return _members.size();
+}
+
+size_t SharedEncoderGroup::size() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _members.size();
+}
+
+void SharedEncoderGroup::set_callback(void* member, webrtc::EncodedImageCallback* callback) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto i = _members.begin(); i != _members.end(); i++) {
+        if ((*i).id == member)
+            (*i).callback = callback;
+    }
+}
+
+int32_t SharedEncoderGroup::encode(
+        void* member,
+        const webrtc::VideoFrame& frame,
+        const std::vector<webrtc::FrameType>* frame_types) {
+    VideoFrameTag tag;
+    const webrtc::VideoFrameBuffer* id = frame_id(frame, tag);
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // its track can be moved to a source forwarding other temporal layers
+    for (auto i = _members.begin(); i != _members.end(); i++) {
+        if ((*i).id == member && (*i).filter.forward() != tag.forward)
+            (*i).filter.set_forward(tag.forward);
+    }
+
+    bool key = _key_pending;
+    if (frame_types != NULL) {
+        key = key || std::find(
+            frame_types->begin(), frame_types->end(), webrtc::kVideoFrameKey
+        ) != frame_types->end();
+    }
+
+    // another member already had it encoded, and got the output
+    if (_last_frame != NULL && _last_frame == id) {
+        _key_pending = key;
+        return WEBRTC_VIDEO_CODEC_OK;
+    }
+    _last_buffer = frame.video_frame_buffer();
+    _last_frame = id;
+
+    // requests from every member since the last frame become one keyframe
+    _key_pending = false;
+    std::vector<webrtc::FrameType> types(1, key ? webrtc::kVideoFrameKey : webrtc::kVideoFrameDelta);
+    return _encoder->Encode(frame, NULL, &types);
+}
+
+int32_t SharedEncoderGroup::set_rates(void* member, uint32_t bitrate, uint32_t framerate) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint32_t min_bitrate = 0;
+    uint32_t max_framerate = 0;
+    for (auto i = _members.begin(); i != _members.end(); i++) {
+        if ((*i).id == member) {
+            (*i).bitrate = bitrate;
+            (*i).framerate = framerate;
+        }
+        if ((*i).bitrate != 0 && (min_bitrate == 0 || (*i).bitrate < min_bitrate))
+            min_bitrate = (*i).bitrate;
+        max_framerate = std::max(max_framerate, (*i).framerate);
+    }
+    if (min_bitrate == 0 || (min_bitrate == _bitrate && max_framerate == _framerate))
+        return WEBRTC_VIDEO_CODEC_OK;
+    _bitrate = min_bitrate;
+    _framerate = max_framerate;
+    return _encoder->SetRates(_bitrate, _framerate);
+}
+
+int32_t SharedEncoderGroup::set_channel_parameters(uint32_t packet_loss, int64_t rtt) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _encoder->SetChannelParameters(packet_loss, rtt);
+}
+
+int32_t SharedEncoderGroup::Encoded(
+        const webrtc::EncodedImage& encoded_image,
+        const webrtc::CodecSpecificInfo* codec_specific_info,
+        const webrtc::RTPFragmentationHeader* fragmentation) {
+    // called from _encoder->Encode() so _mutex is already held
+    int temporal_idx = 0;
+    bool layer_sync = false;
+    if (codec_specific_info != NULL && codec_specific_info->codecType == webrtc::kVideoCodecVP8) {
+        const auto& vp8 = codec_specific_info->codecSpecific.VP8;
+        if (vp8.temporalIdx != webrtc::kNoTemporalIdx)
+            temporal_idx = vp8.temporalIdx;
+        layer_sync = vp8.layerSync;
+    }
+    bool key_frame = encoded_image._frameType == webrtc::kVideoFrameKey;
+    for (auto i = _members.begin(); i != _members.end(); i++) {
+        Member& member = *i;
+        if (member.callback == NULL || !member.filter.pass(temporal_idx, layer_sync, key_frame))
+            continue;
+        if (codec_specific_info == NULL || codec_specific_info->codecType != webrtc::kVideoCodecVP8) {
+            member.callback->Encoded(encoded_image, codec_specific_info, fragmentation);
+            continue;
+        }
+        webrtc::CodecSpecificInfo info = *codec_specific_info;
+        info.codecSpecific.VP8.pictureId = member.picture_id;
+        member.picture_id = (member.picture_id + 1) & 0x7FFF;
+        member.callback->Encoded(encoded_image, &info, fragmentation);
+    }
+    return 0;
+}
+
+// SharedVideoEncoder
+
+SharedVideoEncoder::SharedVideoEncoder(SharedVideoEncoderFactory& factory) :
+    _factory(factory),
+    _number_of_cores(1),
+    _max_payload_size(0),
+    _callback(NULL),
+    _frames(0),
+    _bitrate(0),
+    _framerate(0) {
+    memset(&_settings, 0, sizeof(_settings));
+}
+
+SharedVideoEncoder::~SharedVideoEncoder() {
+    Release();
+}
+
+int32_t SharedVideoEncoder::InitEncode(
+        const webrtc::VideoCodec* codec_settings,
+        int32_t number_of_cores,
+        size_t max_payload_size) {
+    if (codec_settings == NULL || codec_settings->codecType != webrtc::kVideoCodecVP8)
+        return WEBRTC_VIDEO_CODEC_ERR_PARAMETER;
+    // joins a group on its first frame, see Encode
+    Release();
+    _settings = *codec_settings;
+    _number_of_cores = number_of_cores;
+    _max_payload_size = max_payload_size;
+    _bitrate = _settings.startBitrate;
+    _framerate = _settings.maxFramerate;
+    return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t SharedVideoEncoder::RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback) {
+    _callback = callback;
+    if (_group)
+        _group->set_callback(this, callback);
+    return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t SharedVideoEncoder::Release() {
+    if (_group) {
+        _factory.leave(_group, this);
+        _group.reset();
+    }
+    _frames = 0;
+    return WEBRTC_VIDEO_CODEC_OK;
+}
+
+int32_t SharedVideoEncoder::Encode(
+        const webrtc::VideoFrame& frame,
+        const webrtc::CodecSpecificInfo* codec_specific_info,
+        const std::vector<webrtc::FrameType>* frame_types) {
+    if (_group == NULL || _frames < JOIN_FRAMES) {
+        SharedEncoderGroupPtr group = _factory.join(
+            _group, this, _callback, _settings, _number_of_cores, _max_payload_size, frame
+        );
+        if (group == NULL)
+            return WEBRTC_VIDEO_CODEC_ERROR;
+        if (group != _group) {
+            _group = group;
+            if (_bitrate != 0)
+                _group->set_rates(this, _bitrate, _framerate);
+        }
+    }
+    _frames++;
+    return _group->encode(this, frame, frame_types);
+}
+
+int32_t SharedVideoEncoder::SetChannelParameters(uint32_t packet_loss, int64_t rtt) {
+    if (_group == NULL)
+        return WEBRTC_VIDEO_CODEC_OK;
+    return _group->set_channel_parameters(packet_loss, rtt);
+}
+
+int32_t SharedVideoEncoder::SetRates(uint32_t bitrate, uint32_t framerate) {
+    _bitrate = bitrate;
+    _framerate = framerate;
+    if (_group == NULL)
+        return WEBRTC_VIDEO_CODEC_OK;
+    return _group->set_rates(this, bitrate, framerate);
+}
+
+const char* SharedVideoEncoder::ImplementationName() const {
+    return "SharedVideoEncoder";
+}
+
+// SharedVideoEncoderFactory
+
+SharedVideoEncoderFactory::SharedVideoEncoderFactory() {
+    _codecs.push_back(VideoCodec(webrtc::kVideoCodecVP8, "VP8", 1920, 1080, 30));
+}
+
+SharedEncoderGroupPtr SharedVideoEncoderFactory::join(
+        const SharedEncoderGroupPtr& current,
+        void* member,
+        webrtc::EncodedImageCallback* callback,
+        const webrtc::VideoCodec& settings,
+        int32_t number_of_cores,
+        size_t max_payload_size,
+        const webrtc::VideoFrame& frame) {
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // only a member on its own moves, others are already sharing
+    if (current != NULL && current->size() > 1)
+        return current;
+
+    for (auto i = _groups.begin(); i != _groups.end(); i++) {
+        const SharedEncoderGroupPtr& group = *i;
+        if (group == current || !group->matches(settings) || !group->encoded(frame))
+            continue;
+        if (current != NULL && current->remove(member) == 0)
+            _groups.remove(current);
+        group->add(member, callback);
+        ROS_DEBUG_STREAM(
+            "shared encoder " << settings.width << "x" << settings.height << " - " <<
+            group->size() << " member(s)"
+        );
+        return group;
+    }
+    if (current != NULL)
+        return current;
+
+    VideoFrameTag tag;
+    frame_id(frame, tag);
+    SharedEncoderGroupPtr group(new SharedEncoderGroup(
+        settings, tag.temporal_layers, number_of_cores, max_payload_size
+    ));
+    if (!group->is_open())
+        return SharedEncoderGroupPtr();
+    group->add(member, callback);
+    _groups.push_back(group);
+    ROS_INFO_STREAM(
+        "shared encoder " << settings.width << "x" << settings.height << " " <<
+        "w/ " << tag.temporal_layers << " temporal layer(s) created, " <<
+        _groups.size() << " total"
+    );
+    return group;
+}
+
+void SharedVideoEncoderFactory::leave(const SharedEncoderGroupPtr& group, void* member) {
+    SharedEncoderGroupPtr last;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (group->remove(member) != 0)
+            return;
+        _groups.remove(group);
+        last = group;
+    }
+    // released outside the lock
+    last.reset();
+}
+
+size_t SharedVideoEncoderFactory::groups() const {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _groups.size();
+}
+
+webrtc::VideoEncoder* SharedVideoEncoderFactory::CreateVideoEncoder(webrtc::VideoCodecType type) {
+    if (type != webrtc::kVideoCodecVP8)
+        return NULL;
+    return new SharedVideoEncoder(*this);
+}
+
+const std::vector<cricket::WebRtcVideoEncoderFactory::VideoCodec>& SharedVideoEncoderFactory::codecs() const {
+    return _codecs;
+}
+
+void SharedVideoEncoderFactory::DestroyVideoEncoder(webrtc::VideoEncoder* encoder) {
+    delete encoder;
+}
@@ -0,0 +1,247 @@
+#ifndef ROS_WEBRTC_SHARED_VIDEO_ENCODER_H_
+#define ROS_WEBRTC_SHARED_VIDEO_ENCODER_H_
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <webrtc/media/engine/webrtcvideoencoderfactory.h>
+#include <webrtc/video_encoder.h>
+
+#include "video_layers.h"
+
+class SharedVideoEncoderFactory;
+
+/**
+ * \brief One real encoder whose output is fanned out to every peer connection sending the same frames.
+ *
+ * Members are the per-stream encoders WebRTC creates for each peer
+ * connection's video track. Each frame is encoded once, by whichever
+ * member asks first, and the rest of the members' requests for it are
+ * dropped. Keyframe requests are merged into the next frame encoded, and
+ * the bitrate is the lowest any member asks for so no receiver is
+ * overrun. Frames tagged w/ temporal layers (see VideoLayerChain) are
+ * encoded w/ them, and each member is only sent the layers its frames'
+ * tag forwards.
+ */
+class SharedEncoderGroup : public webrtc::EncodedImageCallback {
+
+public:
+
+    /**
+     * \param settings Settings of the member it's created for.
+     * \param temporal_layers Temporal layers to encode w/, regardless of settings.
+     */
+    SharedEncoderGroup(
+        const webrtc::VideoCodec& settings,
+        int temporal_layers,
+        int32_t number_of_cores,
+        size_t max_payload_size
+    );
+
+    ~SharedEncoderGroup();
+
+    /**
+     * \brief Whether the real encoder initialized.
+     */
+    bool is_open() const;
+
+    /**
+     * \brief Whether members w/ these settings can share it.
+     */
+    bool matches(const webrtc::VideoCodec& settings) const;
+
+    /**
+     * \brief Whether it last encoded this frame.
+     */
+    bool encoded(const webrtc::VideoFrame& frame) const;
+
+    void add(void* member, webrtc::EncodedImageCallback* callback);
+
+    /**
+     * \brief Removes a member.
+     * \return Members left.
+     */
+    size_t remove(void* member);
+
+    size_t size() const;
+
+    void set_callback(void* member, webrtc::EncodedImageCallback* callback);
+
+    int32_t encode(
+        void* member,
+        const webrtc::VideoFrame& frame,
+        const std::vector<webrtc::FrameType>* frame_types
+    );
+
+    int32_t set_rates(void* member, uint32_t bitrate, uint32_t framerate);
+
+    int32_t set_channel_parameters(uint32_t packet_loss, int64_t rtt);
+
+// webrtc::EncodedImageCallback
+
+public:
+
+    virtual int32_t Encoded(
+        const webrtc::EncodedImage& encoded_image,
+        const webrtc::CodecSpecificInfo* codec_specific_info,
+        const webrtc::RTPFragmentationHeader* fragmentation);
+
+private:
+
+    struct Member {
+
+        void* id;
+
+        webrtc::EncodedImageCallback* callback;
+
+        uint32_t bitrate; /*! kbps it last asked for, or 0 if it hasn't. */
+
+        uint32_t framerate;
+
+        TemporalLayerFilter filter;
+
+        uint16_t picture_id; /*! Its own, so frames the filter drops don't leave gaps. */
+
+    };
+
+    webrtc::VideoCodec _settings;
+
+    std::unique_ptr<webrtc::VideoEncoder> _encoder;
+
+    bool _open;
+
+    mutable std::mutex _mutex;
+
+    std::list<Member> _members;
+
+    int _temporal_layers;
+
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> _last_buffer; /*! Held so _last_frame isn't reused by a later frame. */
+
+    const webrtc::VideoFrameBuffer* _last_frame;
+
+    bool _key_pending; /*! A member asked for a keyframe, or joined, since the last one. */
+
+    uint32_t _bitrate;
+
+    uint32_t _framerate;
+
+};
+
+typedef boost::shared_ptr<SharedEncoderGroup> SharedEncoderGroupPtr;
+
+/**
+ * \brief Per-stream encoder that WebRTC drives, backed by a SharedEncoderGroup.
+ */
+class SharedVideoEncoder : public webrtc::VideoEncoder {
+
+public:
+
+    SharedVideoEncoder(SharedVideoEncoderFactory& factory);
+
+    ~SharedVideoEncoder();
+
+// webrtc::VideoEncoder
+
+public:
+
+    virtual int32_t InitEncode(
+        const webrtc::VideoCodec* codec_settings,
+        int32_t number_of_cores,
+        size_t max_payload_size);
+
+    virtual int32_t RegisterEncodeCompleteCallback(webrtc::EncodedImageCallback* callback);
+
+    virtual int32_t Release();
+
+    virtual int32_t Encode(
+        const webrtc::VideoFrame& frame,
+        const webrtc::CodecSpecificInfo* codec_specific_info,
+        const std::vector<webrtc::FrameType>* frame_types);
+
+    virtual int32_t SetChannelParameters(uint32_t packet_loss, int64_t rtt);
+
+    virtual int32_t SetRates(uint32_t bitrate, uint32_t framerate);
+
+    virtual const char* ImplementationName() const;
+
+private:
+
+    SharedVideoEncoderFactory& _factory;
+
+    webrtc::VideoCodec _settings;
+
+    int32_t _number_of_cores;
+
+    size_t _max_payload_size;
+
+    webrtc::EncodedImageCallback* _callback;
+
+    SharedEncoderGroupPtr _group;
+
+    uint32_t _frames; /*! Encoded since InitEncode, while few it may still move to another group. */
+
+    uint32_t _bitrate;
+
+    uint32_t _framerate;
+
+};
+
+/**
+ * \brief Encoder factory whose VP8 encoders share one real encoder per source and resolution.
+ *
+ * Passed to webrtc::CreatePeerConnectionFactory, so host CPU grows w/ the
+ * number of sources rather than the number of viewers. Groups are found by
+ * frame: every peer connection's track on a source is handed the same frame
+ * buffer, so a new member joins the group that already encoded the frame
+ * it's given.
+ */
+class SharedVideoEncoderFactory : public cricket::WebRtcVideoEncoderFactory {
+
+public:
+
+    SharedVideoEncoderFactory();
+
+    /**
+     * \brief Finds the group for a member's frame.
+     * \param current Group the member is in, or NULL.
+     * \return Group that already encoded this frame w/ the same settings, else current, else a new one.
+     */
+    SharedEncoderGroupPtr join(
+        const SharedEncoderGroupPtr& current,
+        void* member,
+        webrtc::EncodedImageCallback* callback,
+        const webrtc::VideoCodec& settings,
+        int32_t number_of_cores,
+        size_t max_payload_size,
+        const webrtc::VideoFrame& frame
+    );
+
+    void leave(const SharedEncoderGroupPtr& group, void* member);
+
+    size_t groups() const;
+
+// cricket::WebRtcVideoEncoderFactory
+
+public:
+
+    virtual webrtc::VideoEncoder* CreateVideoEncoder(webrtc::VideoCodecType type);
+
+    virtual const std::vector<VideoCodec>& codecs() const;
+
+    virtual void DestroyVideoEncoder(webrtc::VideoEncoder* encoder);
+
+private:
+
+    std::vector<VideoCodec> _codecs;
+
+    mutable std::mutex _mutex;
+
+    std::list<SharedEncoderGroupPtr> _groups;
+
+};
+
+#endif /* ROS_WEBRTC_SHARED_VIDEO_ENCODER_H_ */
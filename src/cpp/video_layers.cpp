@@ -0,0 +1,299 @@
+#include "video_layers.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <map>
+#include <mutex>
+
+#include <libyuv/scale.h>
+#include <ros/ros.h>
+#include <webrtc/base/keep_ref_until_done.h>
+#include <webrtc/media/engine/webrtcvideoframe.h>
+
+namespace {
+
+/**
+ * \brief Frame wrapped so find_video_frame_tag can tell what its source wants.
+ */
+class TaggedVideoFrameBuffer : public webrtc::WrappedI420Buffer {
+
+public:
+
+    TaggedVideoFrameBuffer(const rtc::scoped_refptr<webrtc::VideoFrameBuffer>& buffer, const VideoFrameTag& tag);
+
+    ~TaggedVideoFrameBuffer();
+
+};
+
+std::mutex tags_mutex;
+
+std::map<const webrtc::VideoFrameBuffer*, VideoFrameTag> tags; /*! Of every live TaggedVideoFrameBuffer, so addresses aren't stale. */
+
+/**
+ * \brief Lowers a limit on the capture's pixel count to what a layer's allows.
+ * \param limit Of the capture, or unset if there is none yet.
+ * \param pixels Of a layer, or unset if it doesn't care.
+ * \param scale Of that layer.
+ */
+void limit_pixel_count(rtc::Optional<int>& limit, const rtc::Optional<int>& pixels, int scale) {
+    if (!pixels)
+        return;
+    int64_t capture = static_cast<int64_t>(*pixels) * scale * scale;
+    int value = static_cast<int>(std::min<int64_t>(capture, INT_MAX));
+    if (!limit || value < *limit)
+        limit = rtc::Optional<int>(value);
+}
+
+bool same_wants(const rtc::VideoSinkWants& a, const rtc::VideoSinkWants& b) {
+    return (
+        a.rotation_applied == b.rotation_applied &&
+        a.black_frames == b.black_frames &&
+        a.max_pixel_count == b.max_pixel_count &&
+        a.max_pixel_count_step_up == b.max_pixel_count_step_up
+    );
+}
+
+TaggedVideoFrameBuffer::TaggedVideoFrameBuffer(
+    const rtc::scoped_refptr<webrtc::VideoFrameBuffer>& buffer,
+    const VideoFrameTag& tag) :
+    webrtc::WrappedI420Buffer(
+        buffer->width(), buffer->height(),
+        buffer->DataY(), buffer->StrideY(),
+        buffer->DataU(), buffer->StrideU(),
+        buffer->DataV(), buffer->StrideV(),
+        rtc::KeepRefUntilDone(buffer)) {
+    std::lock_guard<std::mutex> lock(tags_mutex);
+    tags[this] = tag;
+}
+
+TaggedVideoFrameBuffer::~TaggedVideoFrameBuffer() {
+    std::lock_guard<std::mutex> lock(tags_mutex);
+    tags.erase(this);
+}
+
+}
+
+bool is_video_layer_ladder(const std::vector<int>& scales) {
+    if (scales.empty() || scales.size() > MAX_VIDEO_LAYERS || scales[0] != 1)
+        return false;
+    for (size_t i = 1; i < scales.size(); i++) {
+        if (scales[i] <= scales[i - 1] || scales[i] % scales[i - 1] != 0)
+            return false;
+    }
+    return true;
+}
+
+int video_layer_size(int size, int scale) {
+    int scaled = (size / scale) & ~1;
+    return scaled < 2 ? 2 : scaled;
+}
+
+// VideoFrameTag
+
+VideoFrameTag::VideoFrameTag() :
+    frame(NULL),
+    temporal_layers(1),
+    forward(0) {
+}
+
+bool find_video_frame_tag(const webrtc::VideoFrameBuffer* buffer, VideoFrameTag& tag) {
+    std::lock_guard<std::mutex> lock(tags_mutex);
+    auto i = tags.find(buffer);
+    if (i == tags.end())
+        return false;
+    tag = (*i).second;
+    return true;
+}
+
+// TemporalLayerFilter
+
+TemporalLayerFilter::TemporalLayerFilter(int forward) :
+    _forward(std::max(0, forward)),
+    _synced(-1) {
+}
+
+void TemporalLayerFilter::set_forward(int forward) {
+    _forward = std::max(0, forward);
+    int highest = _forward == 0 ? INT_MAX : _forward - 1;
+    _synced = std::min(_synced, highest);
+}
+
+int TemporalLayerFilter::forward() const {
+    return _forward;
+}
+
+bool TemporalLayerFilter::pass(int temporal_idx, bool layer_sync, bool key_frame) {
+    int highest = _forward == 0 ? INT_MAX : _forward - 1;
+    if (key_frame) {
+        // references nothing, and is always base layer
+        _synced = highest;
+        return true;
+    }
+    if (temporal_idx > highest)
+        return false;
+    if (temporal_idx <= _synced)
+        return true;
+    // one layer up, from a frame that only references the base layer
+    if (layer_sync && _synced >= 0 && temporal_idx == _synced + 1) {
+        _synced = temporal_idx;
+        return true;
+    }
+    return false;
+}
+
+// VideoLayerChain::Layer
+
+bool VideoLayerChain::Layer::wanted() const {
+    for (auto i = views.begin(); i != views.end(); i++) {
+        if ((*i)->broadcaster.frame_wanted())
+            return true;
+    }
+    return false;
+}
+
+// VideoLayerChain
+
+VideoLayerChain::VideoLayerChain(const std::vector<int>& scales, int temporal_layers) :
+    _scales(scales),
+    _temporal_layers(std::max(1, temporal_layers)) {
+    for (size_t i = 0; i < _scales.size(); i++) {
+        std::unique_ptr<Layer> layer(new Layer());
+        layer->scale = _scales[i];
+        for (int j = 1; j <= _temporal_layers; j++) {
+            std::unique_ptr<View> view(new View());
+            view->forward = j == _temporal_layers ? 0 : j;
+            view->interface = new rtc::RefCountedObject<webrtc::VideoTrackSource>(
+                &view->broadcaster, false
+            );
+            view->interface->SetState(webrtc::MediaSourceInterface::kLive);
+            layer->views.push_back(std::move(view));
+        }
+        _layers.push_back(std::move(layer));
+    }
+}
+
+VideoLayerChain::~VideoLayerChain() {
+    detach();
+    // tracks on them can outlive this
+    for (auto i = _layers.begin(); i != _layers.end(); i++) {
+        for (auto j = (*i)->views.begin(); j != (*i)->views.end(); j++) {
+            (*j)->interface->SetState(webrtc::MediaSourceInterface::kEnded);
+            (*j)->interface->OnSourceDestroyed();
+        }
+    }
+}
+
+void VideoLayerChain::attach(webrtc::VideoTrackSourceInterface* source) {
+    detach();
+    _source = source;
+    if (_source != NULL) {
+        _wants = _wanted();
+        _source->AddOrUpdateSink(this, _wants);
+    }
+}
+
+void VideoLayerChain::detach() {
+    if (_source == NULL)
+        return;
+    _source->RemoveSink(this);
+    _source = NULL;
+}
+
+size_t VideoLayerChain::size() const {
+    return _layers.size();
+}
+
+int VideoLayerChain::scale(size_t index) const {
+    return index < _scales.size() ? _scales[index] : 0;
+}
+
+int VideoLayerChain::temporal_layers() const {
+    return _temporal_layers;
+}
+
+rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> VideoLayerChain::layer(size_t index, int forward) const {
+    if (index >= _layers.size())
+        return NULL;
+    const auto& views = _layers[index]->views;
+    if (forward <= 0 || forward >= _temporal_layers)
+        return views.back()->interface;
+    return views[forward - 1]->interface;
+}
+
+rtc::VideoSinkWants VideoLayerChain::_wanted() const {
+    rtc::VideoSinkWants wants;
+    for (auto i = _layers.begin(); i != _layers.end(); i++) {
+        for (auto j = (*i)->views.begin(); j != (*i)->views.end(); j++) {
+            rtc::VideoSinkWants view = (*j)->broadcaster.wants();
+            wants.rotation_applied = wants.rotation_applied || view.rotation_applied;
+            limit_pixel_count(wants.max_pixel_count, view.max_pixel_count, (*i)->scale);
+            limit_pixel_count(wants.max_pixel_count_step_up, view.max_pixel_count_step_up, (*i)->scale);
+        }
+    }
+    return wants;
+}
+
+void VideoLayerChain::OnFrame(const cricket::VideoFrame& frame) {
+    // views' sinks come and go, and their encoders adapt, w/o telling us
+    rtc::VideoSinkWants wants = _wanted();
+    if (!same_wants(wants, _wants) && _source != NULL) {
+        _wants = wants;
+        _source->AddOrUpdateSink(this, _wants);
+    }
+
+    // only as far down as the lowest layer anyone is sending
+    size_t wanted = 0;
+    for (size_t i = 0; i != _layers.size(); i++) {
+        if (_layers[i]->wanted())
+            wanted = i + 1;
+    }
+    if (wanted == 0)
+        return;
+
+    rtc::scoped_refptr<webrtc::VideoFrameBuffer> src = frame.video_frame_buffer();
+    if (src == NULL || src->native_handle() != NULL)
+        return;
+    int width = src->width();
+    int height = src->height();
+    for (size_t i = 0; i != wanted; i++) {
+        Layer& layer = *_layers[i];
+
+        // scaled from the one before it
+        if (layer.scale != 1) {
+            rtc::scoped_refptr<webrtc::I420Buffer> dst = webrtc::I420Buffer::Create(
+                video_layer_size(width, layer.scale),
+                video_layer_size(height, layer.scale)
+            );
+            libyuv::I420Scale(
+                src->DataY(), src->StrideY(),
+                src->DataU(), src->StrideU(),
+                src->DataV(), src->StrideV(),
+                src->width(), src->height(),
+                dst->MutableDataY(), dst->StrideY(),
+                dst->MutableDataU(), dst->StrideU(),
+                dst->MutableDataV(), dst->StrideV(),
+                dst->width(), dst->height(),
+                libyuv::kFilterBox
+            );
+            src = dst;
+        }
+
+        for (auto j = layer.views.begin(); j != layer.views.end(); j++) {
+            View& view = *(*j);
+            if (!view.broadcaster.frame_wanted())
+                continue;
+            rtc::scoped_refptr<webrtc::VideoFrameBuffer> buffer = src;
+            if (_temporal_layers > 1) {
+                VideoFrameTag tag;
+                tag.frame = src.get();
+                tag.temporal_layers = _temporal_layers;
+                tag.forward = view.forward;
+                buffer = new rtc::RefCountedObject<TaggedVideoFrameBuffer>(src, tag);
+            }
+            view.broadcaster.OnFrame(
+                cricket::WebRtcVideoFrame(buffer, frame.rotation(), frame.timestamp_us())
+            );
+        }
+    }
+}
@@ -0,0 +1,183 @@
+#ifndef ROS_WEBRTC_VIDEO_LAYERS_H_
+#define ROS_WEBRTC_VIDEO_LAYERS_H_
+
+#include <memory>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <webrtc/api/mediastreaminterface.h>
+#include <webrtc/api/videotracksource.h>
+#include <webrtc/base/scoped_ref_ptr.h>
+#include <webrtc/common_video/include/video_frame_buffer.h>
+#include <webrtc/media/base/videobroadcaster.h>
+#include <webrtc/media/base/videoframe.h>
+#include <webrtc/media/base/videosinkinterface.h>
+
+const size_t MAX_VIDEO_LAYERS = 3;
+
+const int MAX_TEMPORAL_LAYERS = 3;
+
+/**
+ * \brief Whether downscale factors make a ladder a chain can produce.
+ *
+ * The first must be 1 (i.e. the capture itself), there may be at most
+ * MAX_VIDEO_LAYERS and each must be a multiple of the one before it.
+ */
+bool is_video_layer_ladder(const std::vector<int>& scales);
+
+/**
+ * \brief Width or height of a layer, rounded down to even as I420 needs.
+ */
+int video_layer_size(int size, int scale);
+
+/**
+ * \brief What the source of a frame wants done w/ it when encoded.
+ */
+struct VideoFrameTag {
+
+    VideoFrameTag();
+
+    const webrtc::VideoFrameBuffer* frame; /*! Buffer the tagged one wraps, which identifies the frame. */
+
+    int temporal_layers; /*! Temporal layers to encode it w/. */
+
+    int forward; /*! Temporal layers to send to whoever is sent this, or 0 for all. */
+
+};
+
+/**
+ * \brief Looks up the tag of a frame produced by a VideoLayerChain.
+ * \return False if it isn't tagged.
+ */
+bool find_video_frame_tag(const webrtc::VideoFrameBuffer* buffer, VideoFrameTag& tag);
+
+/**
+ * \brief Decides which frames of a temporally layered VP8 stream a receiver is sent.
+ *
+ * Frames of a layer only ever reference ones of the same or lower layers, so
+ * higher layers can be dropped w/o a new keyframe. Layers added back are only
+ * sent from their next sync frame on, before which the receiver would be
+ * missing references.
+ */
+class TemporalLayerFilter {
+
+public:
+
+    /**
+     * \param forward Temporal layers to send, or 0 for all.
+     */
+    TemporalLayerFilter(int forward=0);
+
+    void set_forward(int forward);
+
+    int forward() const;
+
+    /**
+     * \param temporal_idx Layer of the frame, 0 is the base.
+     * \param layer_sync Whether it only references base layer frames.
+     * \param key_frame Whether it's a keyframe.
+     * \return Whether to send it.
+     */
+    bool pass(int temporal_idx, bool layer_sync, bool key_frame);
+
+private:
+
+    int _forward;
+
+    int _synced; /*! Highest layer the receiver has every reference for, or -1 for none. */
+
+};
+
+/**
+ * \brief Spatial and temporal layers of a video source produced by one downsample chain.
+ *
+ * Layer 0 is the capture itself. Each frame is scaled down to layer 1, which
+ * is scaled down to layer 2 and so on, so every layer is scaled once per
+ * frame however many peer connections send it. Each layer has a source per
+ * number of temporal layers forwarded, whose frames are tagged (see
+ * find_video_frame_tag) so a shared encoder encodes them once w/ every
+ * temporal layer and sends each peer connection only those it forwards.
+ * Peer connections pick a layer by sending a track on its source. What their
+ * encoders want of each layer (e.g. fewer pixels) is asked of the capture.
+ */
+class VideoLayerChain : public rtc::VideoSinkInterface<cricket::VideoFrame> {
+
+public:
+
+    /**
+     * \param scales Downscale factors of each layer, see is_video_layer_ladder.
+     * \param temporal_layers Temporal layers to encode each w/.
+     */
+    VideoLayerChain(const std::vector<int>& scales, int temporal_layers=1);
+
+    ~VideoLayerChain();
+
+    /**
+     * \brief Starts producing layers from this source's frames.
+     */
+    void attach(webrtc::VideoTrackSourceInterface* source);
+
+    void detach();
+
+    size_t size() const;
+
+    int scale(size_t index) const;
+
+    int temporal_layers() const;
+
+    /**
+     * \brief Source of a layer.
+     * \param index Spatial layer.
+     * \param forward Temporal layers to send from it, or 0 for all.
+     * \return The source, or NULL if there is no such layer.
+     */
+    rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> layer(size_t index, int forward=0) const;
+
+// rtc::VideoSinkInterface<cricket::VideoFrame>
+
+public:
+
+    virtual void OnFrame(const cricket::VideoFrame& frame);
+
+private:
+
+    struct View {
+
+        int forward;
+
+        rtc::VideoBroadcaster broadcaster;
+
+        rtc::scoped_refptr<webrtc::VideoTrackSource> interface;
+
+    };
+
+    struct Layer {
+
+        int scale;
+
+        std::vector<std::unique_ptr<View>> views; /*! Forwarding 1, 2 ... and then all temporal layers. */
+
+        bool wanted() const;
+
+    };
+
+    /**
+     * \brief What every view's sinks want combined, in terms of the capture.
+     */
+    rtc::VideoSinkWants _wanted() const;
+
+    std::vector<int> _scales;
+
+    int _temporal_layers;
+
+    rtc::scoped_refptr<webrtc::VideoTrackSourceInterface> _source;
+
+    rtc::VideoSinkWants _wants; /*! Last asked of _source. */
+
+    std::vector<std::unique_ptr<Layer>> _layers;
+
+};
+
+typedef boost::shared_ptr<VideoLayerChain> VideoLayerChainPtr;
+
+#endif /* ROS_WEBRTC_VIDEO_LAYERS_H_ */
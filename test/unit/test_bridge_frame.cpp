@@ -0,0 +1,103 @@
+#include <gtest/gtest.h>
+
+#include "cpp/bridge_frame.h"
+
+
+TEST(TestSuite, testBridgeFrame) {
+    const uint8_t payload[] = {0x01, 0x00, 0x00, 0x00, 'x'};
+
+    BridgeFrame src;
+    src.flags = BridgeFrame::HasDefinition;
+    src.topic = "/chatter";
+    src.datatype = "std_msgs/String";
+    src.md5sum = "992ce8a1687cec8c8bd883ec73ca41d1";
+    src.definition = "string data\n";
+
+    std::vector<uint8_t> buffer(src.header_size() + sizeof(payload));
+    ASSERT_EQ(src.header_size(), src.encode_header(&buffer[0]));
+    std::copy(payload, payload + sizeof(payload), buffer.begin() + src.header_size());
+
+    BridgeFrame dst;
+    ASSERT_TRUE(dst.decode(&buffer[0], buffer.size()));
+    ASSERT_TRUE(dst.has_definition());
+    ASSERT_EQ(src.topic, dst.topic);
+    ASSERT_EQ(src.datatype, dst.datatype);
+    ASSERT_EQ(src.md5sum, dst.md5sum);
+    ASSERT_EQ(src.definition, dst.definition);
+    ASSERT_EQ(sizeof(payload), dst.payload_size);
+    ASSERT_EQ(&buffer[src.header_size()], dst.payload);
+
+    // w/o definition
+    src.flags = 0;
+    buffer.resize(src.header_size());
+    src.encode_header(&buffer[0]);
+    ASSERT_TRUE(dst.decode(&buffer[0], buffer.size()));
+    ASSERT_FALSE(dst.has_definition());
+    ASSERT_EQ("", dst.definition);
+    ASSERT_EQ(0, dst.payload_size);
+}
+
+TEST(TestSuite, testBridgeFrameMux) {
+    const uint8_t payload[] = {0x01, 0x00, 0x00, 0x00, 'x'};
+
+    BridgeFrame announce;
+    announce.version = BridgeFrame::MUX_VERSION;
+    announce.kind = BridgeFrame::Announce;
+    announce.id = 513;
+    announce.topic = "/chatter";
+    announce.datatype = "std_msgs/String";
+    announce.md5sum = "992ce8a1687cec8c8bd883ec73ca41d1";
+    announce.definition = "string data\n";
+    std::vector<uint8_t> buffer(announce.header_size());
+    ASSERT_EQ(buffer.size(), announce.encode_header(&buffer[0]));
+
+    BridgeFrame dst;
+    ASSERT_TRUE(dst.decode(&buffer[0], buffer.size()));
+    ASSERT_TRUE(dst.is_mux());
+    ASSERT_EQ(BridgeFrame::Announce, dst.kind);
+    ASSERT_TRUE(dst.has_definition());
+    ASSERT_EQ(513, dst.id);
+    ASSERT_EQ(announce.topic, dst.topic);
+    ASSERT_EQ(announce.datatype, dst.datatype);
+    ASSERT_EQ(announce.md5sum, dst.md5sum);
+    ASSERT_EQ(announce.definition, dst.definition);
+    ASSERT_EQ(0, dst.payload_size);
+
+    BridgeFrame message;
+    message.version = BridgeFrame::MUX_VERSION;
+    message.kind = BridgeFrame::Message;
+    message.id = 513;
+    ASSERT_EQ(4, message.header_size());
+    buffer.resize(message.header_size() + sizeof(payload));
+    ASSERT_EQ(4, message.encode_header(&buffer[0]));
+    std::copy(payload, payload + sizeof(payload), buffer.begin() + 4);
+
+    ASSERT_TRUE(dst.decode(&buffer[0], buffer.size()));
+    ASSERT_EQ(BridgeFrame::Message, dst.kind);
+    ASSERT_FALSE(dst.has_definition());
+    ASSERT_EQ(513, dst.id);
+    ASSERT_EQ(sizeof(payload), dst.payload_size);
+    ASSERT_EQ(&buffer[4], dst.payload);
+
+    // truncated id
+    ASSERT_FALSE(dst.decode(&buffer[0], 3));
+}
+
+TEST(TestSuite, testBridgeFrameMalformed) {
+    BridgeFrame src;
+    src.topic = "/chatter";
+    src.datatype = "std_msgs/String";
+    src.md5sum = "992ce8a1687cec8c8bd883ec73ca41d1";
+    std::vector<uint8_t> buffer(src.header_size());
+    src.encode_header(&buffer[0]);
+
+    BridgeFrame dst;
+    ASSERT_FALSE(dst.decode(&buffer[0], 1));
+    for (size_t size = 2; size != buffer.size(); size++) {
+        ASSERT_FALSE(dst.decode(&buffer[0], size));
+    }
+
+    // unknown version
+    buffer[0] = BridgeFrame::MUX_VERSION + 1;
+    ASSERT_FALSE(dst.decode(&buffer[0], buffer.size()));
+}
@@ -0,0 +1,141 @@
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+
+#include <gtest/gtest.h>
+
+#include "cpp/chunked_message.h"
+
+
+TEST(TestSuite, testChunkedMessage) {
+    const uint8_t a[] = {'a', 'b', 'c', 'd'};
+    const uint8_t b[] = {'e', 'f', 'g', 'h'};
+    const uint8_t c[] = {'i', 'j'};
+
+    ChunkedMessage msg("id", 3, 4);
+    ASSERT_EQ("id", msg.id());
+    ASSERT_EQ(3, msg.total());
+    ASSERT_EQ(0, msg.count());
+    ASSERT_EQ(12, msg.capacity());
+    ASSERT_EQ(13, msg.memory());
+    ASSERT_FALSE(msg.is_complete());
+
+    // out of order
+    ASSERT_EQ(ChunkedMessage::Added, msg.add_chunk(2, c, sizeof(c)));
+    ASSERT_TRUE(msg.has_chunk(2));
+    ASSERT_FALSE(msg.has_chunk(0));
+    ASSERT_EQ(ChunkedMessage::Added, msg.add_chunk(0, a, sizeof(a)));
+    ASSERT_EQ(2, msg.count());
+
+    // rejected
+    ASSERT_EQ(ChunkedMessage::Duplicate, msg.add_chunk(0, a, sizeof(a)));
+    ASSERT_EQ(ChunkedMessage::OutOfRange, msg.add_chunk(3, a, sizeof(a)));
+    ASSERT_EQ(ChunkedMessage::Malformed, msg.add_chunk(1, c, sizeof(c)));
+    ASSERT_EQ(2, msg.count());
+    ASSERT_FALSE(msg.is_complete());
+
+    // complete
+    ASSERT_EQ(ChunkedMessage::Completed, msg.add_chunk(1, b, sizeof(b)));
+    ASSERT_TRUE(msg.is_complete());
+    std::vector<uint8_t> buffer;
+    msg.release(buffer);
+    ASSERT_EQ(std::string("abcdefghij"), std::string(buffer.begin(), buffer.end()));
+}
+
+TEST(TestSuite, testChunkedMessageSingle) {
+    const uint8_t a[] = {'a'};
+
+    ChunkedMessage msg("id", 1, 4);
+    ASSERT_EQ(ChunkedMessage::Malformed, msg.add_chunk(0, a, 5));
+    ASSERT_EQ(ChunkedMessage::Completed, msg.add_chunk(0, a, sizeof(a)));
+    std::vector<uint8_t> buffer;
+    msg.release(buffer);
+    ASSERT_EQ(1, buffer.size());
+    ASSERT_EQ('a', buffer[0]);
+}
+
+TEST(TestSuite, testChunkedMessageReceived) {
+    const uint8_t a[] = {'a', 'b'};
+
+    ChunkedMessage msg("id", 6, 2);
+    ChunkedMessage::Ranges ranges;
+    msg.received(ranges);
+    ASSERT_TRUE(ranges.empty());
+
+    ASSERT_EQ(ChunkedMessage::Added, msg.add_chunk(0, a, sizeof(a)));
+    ASSERT_EQ(ChunkedMessage::Added, msg.add_chunk(1, a, sizeof(a)));
+    ASSERT_EQ(ChunkedMessage::Added, msg.add_chunk(3, a, sizeof(a)));
+    ASSERT_EQ(ChunkedMessage::Added, msg.add_chunk(5, a, 1));
+    msg.received(ranges);
+    ASSERT_EQ(3, ranges.size());
+    ASSERT_EQ(0, ranges[0].first);
+    ASSERT_EQ(2, ranges[0].second);
+    ASSERT_EQ(3, ranges[1].first);
+    ASSERT_EQ(4, ranges[1].second);
+    ASSERT_EQ(5, ranges[2].first);
+    ASSERT_EQ(6, ranges[2].second);
+}
+
+TEST(TestSuite, testChunkedMessageSpilled) {
+    const uint8_t a[] = {'a', 'b', 'c', 'd'};
+    const uint8_t c[] = {'i', 'j'};
+    std::string path = "/tmp/test_chunked_message." + std::to_string(getpid());
+
+    {
+        ChunkedMessage msg("id", 3, 4, path);
+        ASSERT_TRUE(msg.is_spilled());
+        ASSERT_TRUE(msg.is_open());
+        ASSERT_EQ(12, msg.capacity());
+        ASSERT_EQ(1, msg.memory());
+        ASSERT_EQ(0, access(path.c_str(), F_OK));
+
+        // spill file already exists
+        ChunkedMessage other("other", 1, 4, path);
+        ASSERT_FALSE(other.is_open());
+        ASSERT_EQ(ChunkedMessage::WriteFailed, other.add_chunk(0, a, sizeof(a)));
+
+        ASSERT_EQ(ChunkedMessage::Added, msg.add_chunk(2, c, sizeof(c)));
+        ASSERT_EQ(ChunkedMessage::Duplicate, msg.add_chunk(2, c, sizeof(c)));
+        ASSERT_EQ(ChunkedMessage::Added, msg.add_chunk(0, a, sizeof(a)));
+        std::string released;
+        ASSERT_FALSE(msg.release(released));
+    }
+    // incomplete is removed
+    ASSERT_NE(0, access(path.c_str(), F_OK));
+
+    const uint8_t b[] = {'e', 'f', 'g', 'h'};
+    ChunkedMessage msg("id", 3, 4, path);
+    ASSERT_EQ(ChunkedMessage::Added, msg.add_chunk(1, b, sizeof(b)));
+    ASSERT_EQ(ChunkedMessage::Added, msg.add_chunk(2, c, sizeof(c)));
+    ASSERT_EQ(ChunkedMessage::Completed, msg.add_chunk(0, a, sizeof(a)));
+    ASSERT_EQ(10, msg.size());
+    std::string released;
+    ASSERT_TRUE(msg.release(released));
+    ASSERT_EQ(path, released);
+    std::ifstream file(path.c_str(), std::ios::binary);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    ASSERT_EQ("abcdefghij", contents);
+    unlink(path.c_str());
+}
+
+TEST(TestSuite, testChunkedMessageMemory) {
+    ASSERT_EQ(0, ChunkedMessage::memory(0, 4, false));
+    ASSERT_EQ(1, ChunkedMessage::memory(8, 4, true));
+    ASSERT_EQ(2, ChunkedMessage::memory(9, 4, true));
+    ASSERT_EQ(36 + 2, ChunkedMessage::memory(9, 4, false));
+}
+
+TEST(TestSuite, testChunkedMessageBudget) {
+    ChunkedMessageBudget budget(10);
+    ASSERT_TRUE(budget.reserve(6));
+    ASSERT_FALSE(budget.reserve(5));
+    ASSERT_TRUE(budget.reserve(4));
+    ASSERT_EQ(10, budget.used());
+    budget.release(6);
+    ASSERT_TRUE(budget.reserve(5));
+    ASSERT_FALSE(budget.reserve(20));
+
+    ChunkedMessageBudget unlimited;
+    ASSERT_TRUE(unlimited.reserve(1 << 30));
+}
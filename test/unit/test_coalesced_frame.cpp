@@ -0,0 +1,49 @@
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "cpp/coalesced_frame.h"
+
+
+TEST(TestSuite, testCoalescedFrame) {
+    const uint8_t a[] = {'a', 'b', 'c'};
+    std::vector<uint8_t> b(200, 'b');
+
+    CoalescedFrame frame;
+    ASSERT_TRUE(frame.empty());
+    frame.append(a, sizeof(a), false);
+    frame.append(&b[0], b.size(), true);
+    frame.append(a, 0, false);
+    ASSERT_FALSE(frame.empty());
+    ASSERT_EQ(3, frame.count());
+    ASSERT_EQ(
+        CoalescedFrame::record_size(sizeof(a)) +
+        CoalescedFrame::record_size(b.size()) +
+        CoalescedFrame::record_size(0),
+        frame.size()
+    );
+    ASSERT_EQ(1 + sizeof(a), CoalescedFrame::record_size(sizeof(a)));
+    ASSERT_EQ(2 + b.size(), CoalescedFrame::record_size(b.size()));
+
+    std::vector<uint8_t> buffer;
+    frame.release(buffer);
+    ASSERT_TRUE(frame.empty());
+    ASSERT_EQ(0, frame.size());
+
+    std::vector<CoalescedFrame::Record> records;
+    ASSERT_TRUE(CoalescedFrame::parse(&buffer[0], buffer.size(), records));
+    ASSERT_EQ(3, records.size());
+    ASSERT_EQ(sizeof(a), records[0].size);
+    ASSERT_FALSE(records[0].binary);
+    ASSERT_EQ(0, memcmp(a, records[0].data, sizeof(a)));
+    ASSERT_EQ(b.size(), records[1].size);
+    ASSERT_TRUE(records[1].binary);
+    ASSERT_EQ(b, std::vector<uint8_t>(records[1].data, records[1].data + records[1].size));
+    ASSERT_EQ(0, records[2].size);
+
+    // truncated
+    records.clear();
+    ASSERT_FALSE(CoalescedFrame::parse(&buffer[0], buffer.size() - 2, records));
+    records.clear();
+    ASSERT_FALSE(CoalescedFrame::parse(&buffer[0], sizeof(a) + 2, records));
+}
@@ -0,0 +1,77 @@
+#include <gtest/gtest.h>
+
+#include "cpp/compression.h"
+
+
+static void round_trip(Compression& compression) {
+    std::vector<uint8_t> src(4096);
+    for (size_t i = 0; i != src.size(); i++) {
+        src[i] = "ros-webrtc"[i % 10];
+    }
+
+    std::vector<uint8_t> framed, dst;
+    bool binary = false;
+    ASSERT_TRUE(compression.compress(&src[0], src.size(), true, framed));
+    ASSERT_LT(framed.size(), src.size());
+    ASSERT_TRUE(compression.decompress(&framed[0], framed.size(), binary, dst));
+    ASSERT_TRUE(binary);
+    ASSERT_EQ(src, dst);
+
+    // context is reused
+    ASSERT_TRUE(compression.compress(&src[0], src.size(), false, framed));
+    ASSERT_TRUE(compression.decompress(&framed[0], framed.size(), binary, dst));
+    ASSERT_FALSE(binary);
+    ASSERT_EQ(src, dst);
+
+    // corrupt
+    framed.resize(framed.size() - 1);
+    ASSERT_FALSE(compression.decompress(&framed[0], framed.size(), binary, dst));
+}
+
+TEST(TestSuite, testCompression) {
+    Compression lz4(MediaType("application/json; compress=lz4"));
+    ASSERT_EQ(Compression::LZ4, lz4.algorithm());
+    round_trip(lz4);
+
+    Compression zstd(MediaType("application/json; compress=zstd; level=3"));
+    ASSERT_EQ(Compression::Zstd, zstd.algorithm());
+    round_trip(zstd);
+
+    Compression unknown(MediaType("application/json; compress=gzip"));
+    ASSERT_TRUE(Compression::matches(MediaType("application/json; compress=gzip")));
+    ASSERT_EQ(Compression::None, unknown.algorithm());
+    ASSERT_FALSE(Compression::matches(MediaType("application/json")));
+}
+
+TEST(TestSuite, testCompressionThreshold) {
+    Compression compression(Compression::Zstd, 1, 16, 32);
+    const uint8_t small[] = {'a', 'a', 'a', 'a'};
+    std::vector<uint8_t> framed, dst;
+    bool binary = true;
+
+    // below threshold
+    ASSERT_FALSE(compression.compress(small, sizeof(small), false, framed));
+    ASSERT_EQ(Compression::HEADER_SIZE + sizeof(small), framed.size());
+    ASSERT_TRUE(compression.decompress(&framed[0], framed.size(), binary, dst));
+    ASSERT_FALSE(binary);
+    ASSERT_EQ(std::vector<uint8_t>(small, small + sizeof(small)), dst);
+
+    // above max size
+    std::vector<uint8_t> large(64, 'a');
+    ASSERT_TRUE(compression.compress(&large[0], large.size(), false, framed));
+    ASSERT_FALSE(compression.decompress(&framed[0], framed.size(), binary, dst));
+
+    // truncated header
+    ASSERT_FALSE(compression.decompress(&framed[0], Compression::HEADER_SIZE - 1, binary, dst));
+}
+
+TEST(TestSuite, testCompressionMaxSize) {
+    Compression compression(Compression::Zstd, 1, 16);
+    std::vector<uint8_t> dst;
+    bool binary = true;
+
+    // unbounded still has a limit
+    const uint8_t huge[] = {Compression::Zstd, 0xff, 0xff, 0xff, 0x7f, 0};
+    ASSERT_FALSE(compression.decompress(huge, sizeof(huge), binary, dst));
+    ASSERT_TRUE(dst.empty());
+}
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include "cpp/expiry_wheel.h"
+
+
+TEST(TestSuite, testExpiryWheel) {
+    ExpiryWheel wheel(1.0, 4);
+    std::vector<std::string> expired;
+
+    wheel.add("a", 100.5);
+    wheel.add("b", 101.5);
+    wheel.add("c", 109.5);  // wraps around
+    auto d = wheel.add("d", 102.5);
+    ASSERT_EQ(4, wheel.size());
+
+    // nothing due
+    wheel.advance(100.9, expired);
+    ASSERT_EQ(0, expired.size());
+
+    // a due
+    wheel.advance(101.0, expired);
+    ASSERT_EQ(1, expired.size());
+    ASSERT_EQ("a", expired[0]);
+    ASSERT_EQ(3, wheel.size());
+
+    // removed ids never expire
+    wheel.remove(d);
+    ASSERT_FALSE(d.is_valid());
+    ASSERT_EQ(2, wheel.size());
+
+    // b due, c is a lap away despite sharing a slot
+    expired.clear();
+    wheel.advance(105.0, expired);
+    ASSERT_EQ(1, expired.size());
+    ASSERT_EQ("b", expired[0]);
+
+    // c due, even after skipping more than a lap
+    expired.clear();
+    wheel.advance(200.0, expired);
+    ASSERT_EQ(1, expired.size());
+    ASSERT_EQ("c", expired[0]);
+    ASSERT_EQ(0, wheel.size());
+
+    // already past deadlines expire on next tick
+    wheel.add("e", 50.0);
+    expired.clear();
+    wheel.advance(201.0, expired);
+    ASSERT_EQ(1, expired.size());
+    ASSERT_EQ("e", expired[0]);
+}
@@ -0,0 +1,63 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include "cpp/file_transfer.h"
+
+
+TEST(TestSuite, testCrc32) {
+    const char* check = "123456789";
+    ASSERT_EQ(0xcbf43926, crc32((const uint8_t *)check, strlen(check)));
+    ASSERT_EQ(0, crc32(NULL, 0));
+
+    // continues across pieces
+    uint32_t crc = crc32((const uint8_t *)check, 4);
+    ASSERT_EQ(0xcbf43926, crc32((const uint8_t *)check + 4, 5, crc));
+}
+
+TEST(TestSuite, testFileReader) {
+    char path[] = "/tmp/test_file_transferXXXXXX";
+    int fd = mkstemp(path);
+    ASSERT_GE(fd, 0);
+    std::vector<uint8_t> contents(1000);
+    for (size_t i = 0; i != contents.size(); i++)
+        contents[i] = i % 251;
+    ASSERT_EQ(contents.size(), write(fd, contents.data(), contents.size()));
+    close(fd);
+
+    FileReader reader;
+    ASSERT_FALSE(reader.is_open());
+    ASSERT_FALSE(reader.open("/tmp"));
+    ASSERT_FALSE(reader.open(std::string(path) + ".missing"));
+    ASSERT_TRUE(reader.open(path));
+    ASSERT_TRUE(reader.is_open());
+    ASSERT_EQ(path, reader.path());
+    ASSERT_EQ(contents.size(), reader.size());
+
+    std::vector<uint8_t> buffer;
+    ASSERT_TRUE(reader.read(0, 300, buffer));
+    ASSERT_EQ(300, buffer.size());
+    ASSERT_EQ(0, memcmp(contents.data(), buffer.data(), 300));
+    ASSERT_TRUE(reader.read(900, 100, buffer));
+    ASSERT_EQ(100, buffer.size());
+    ASSERT_EQ(0, memcmp(contents.data() + 900, buffer.data(), 100));
+    ASSERT_TRUE(reader.read(1000, 0, buffer));
+    ASSERT_EQ(0, buffer.size());
+
+    // out of range
+    ASSERT_FALSE(reader.read(900, 101, buffer));
+    ASSERT_FALSE(reader.read(1001, 0, buffer));
+
+    // truncated since opened
+    ASSERT_EQ(0, truncate(path, 500));
+    ASSERT_FALSE(reader.read(400, 200, buffer));
+
+    reader.close();
+    ASSERT_FALSE(reader.is_open());
+    ASSERT_FALSE(reader.read(0, 1, buffer));
+    unlink(path);
+}
@@ -0,0 +1,41 @@
+#include <algorithm>
+
+#include <gtest/gtest.h>
+
+#include "cpp/histogram.h"
+
+
+TEST(TestSuite, testHistogram) {
+    Histogram histogram({1, 2, 5});
+    ASSERT_EQ(0, histogram.count());
+    ASSERT_EQ(0, histogram.quantile(0.5));
+    ASSERT_EQ(4, histogram.counts().size());
+
+    // bounds are inclusive
+    histogram.add(0.5);
+    histogram.add(1);
+    histogram.add(1.5);
+    histogram.add(5);
+    histogram.add(7);
+    ASSERT_EQ(5, histogram.count());
+    ASSERT_EQ(2, histogram.counts()[0]);
+    ASSERT_EQ(1, histogram.counts()[1]);
+    ASSERT_EQ(1, histogram.counts()[2]);
+    ASSERT_EQ(1, histogram.counts()[3]);
+    ASSERT_EQ(7, histogram.max());
+
+    ASSERT_EQ(1, histogram.quantile(0));
+    ASSERT_EQ(1, histogram.quantile(0.4));
+    ASSERT_EQ(2, histogram.quantile(0.5));
+    ASSERT_EQ(5, histogram.quantile(0.8));
+    ASSERT_EQ(7, histogram.quantile(1));
+}
+
+TEST(TestSuite, testHistogramLatencyBounds) {
+    std::vector<double> bounds = Histogram::latency_bounds();
+    ASSERT_EQ(13, bounds.size());
+    ASSERT_DOUBLE_EQ(0.001, bounds.front());
+    ASSERT_DOUBLE_EQ(0.005, bounds[2]);
+    ASSERT_DOUBLE_EQ(10, bounds.back());
+    ASSERT_TRUE(std::is_sorted(bounds.begin(), bounds.end()));
+}
@@ -47,4 +47,12 @@ TEST(TestSuite, testMediaType) {
     ASSERT_EQ("json", mt.suffix);
     ASSERT_EQ(1, mt.params.size());
     ASSERT_EQ("32", mt.params["chunksize"]);
+
+    mt = MediaType("application/vnd.mayfield.msg.v1+json; chunksize=32; compress=zstd;level=3");
+    ASSERT_EQ("mayfield.msg.v1", mt.sub_type);
+    ASSERT_EQ("json", mt.suffix);
+    ASSERT_EQ(3, mt.params.size());
+    ASSERT_EQ("32", mt.params["chunksize"]);
+    ASSERT_EQ("zstd", mt.params["compress"]);
+    ASSERT_EQ("3", mt.params["level"]);
 }
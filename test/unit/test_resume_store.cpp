@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+
+#include "cpp/resume_store.h"
+
+
+TEST(TestSuite, testResumeStore) {
+    ResumeStore store(10);
+    std::string a = ResumeStore::key("peer", "a");
+    std::string b = ResumeStore::key("peer", "b");
+    ASSERT_NE(a, b);
+    ASSERT_NE(ResumeStore::key("pe", "era"), ResumeStore::key("peer", "a"));
+
+    SuspendedFile file = {"1", "/tmp/file"};
+    store.suspend(a, file, 0);
+    store.suspend(a, ChunkedMessagePtr(new ChunkedMessage("2", 2, 4)), 1);
+    store.suspend(b, ChunkedMessagePtr(new ChunkedMessage("3", 2, 4)), 2);
+    ASSERT_EQ(3, store.size());
+
+    // by key and direction
+    std::vector<SuspendedFile> files;
+    store.take(b, files);
+    ASSERT_TRUE(files.empty());
+    store.take(a, files);
+    ASSERT_EQ(1, files.size());
+    ASSERT_EQ("1", files[0].id);
+    ASSERT_EQ("/tmp/file", files[0].path);
+    std::vector<ChunkedMessagePtr> messages;
+    store.take(a, messages);
+    ASSERT_EQ(1, messages.size());
+    ASSERT_EQ("2", messages[0]->id());
+    ASSERT_EQ(1, store.size());
+
+    // taken once
+    messages.clear();
+    store.take(a, messages);
+    ASSERT_TRUE(messages.empty());
+
+    // expired
+    ASSERT_EQ(0, store.reap(11));
+    ASSERT_EQ(1, store.reap(12));
+    ASSERT_EQ(0, store.size());
+    store.take(b, messages);
+    ASSERT_TRUE(messages.empty());
+}
+
+TEST(TestSuite, testResumeStoreLimit) {
+    ResumeStore store(10, 20);
+    std::string a = ResumeStore::key("peer", "a");
+
+    // too large on its own
+    ASSERT_FALSE(store.suspend(a, ChunkedMessagePtr(new ChunkedMessage("1", 6, 4)), 0));
+    ASSERT_EQ(0, store.size());
+
+    // oldest messages make room, files don't count
+    SuspendedFile file = {"2", "/tmp/file"};
+    store.suspend(a, file, 0);
+    ASSERT_TRUE(store.suspend(a, ChunkedMessagePtr(new ChunkedMessage("3", 2, 4)), 0));
+    ASSERT_TRUE(store.suspend(a, ChunkedMessagePtr(new ChunkedMessage("4", 2, 4)), 1));
+    ASSERT_EQ(16, store.bytes());
+    ASSERT_TRUE(store.suspend(a, ChunkedMessagePtr(new ChunkedMessage("5", 2, 4)), 2));
+    ASSERT_EQ(16, store.bytes());
+    ASSERT_EQ(3, store.size());
+    std::vector<ChunkedMessagePtr> messages;
+    store.take(a, messages);
+    ASSERT_EQ(2, messages.size());
+    ASSERT_EQ("4", messages[0]->id());
+    ASSERT_EQ("5", messages[1]->id());
+    ASSERT_EQ(0, store.bytes());
+}
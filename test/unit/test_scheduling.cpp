@@ -0,0 +1,133 @@
+#include <deque>
+#include <map>
+
+#include <boost/bind.hpp>
+#include <gtest/gtest.h>
+
+#include "cpp/scheduling.h"
+
+
+namespace {
+
+typedef std::map<size_t, std::deque<size_t> > Queues;
+
+bool head(Queues& queues, size_t id, size_t& size) {
+    auto& queue = queues[id];
+    if (queue.empty())
+        return false;
+    size = queue.front();
+    return true;
+}
+
+size_t next(DeficitRoundRobin& drr, Queues& queues) {
+    size_t id, size;
+    if (!drr.select(boost::bind(&head, boost::ref(queues), _1, _2), id, size))
+        return -1;
+    drr.charge(id, size);
+    queues[id].pop_front();
+    return id;
+}
+
+}
+
+TEST(TestSuite, testDeficitRoundRobinPriority) {
+    DeficitRoundRobin drr(100);
+    drr.add(0, 0);
+    drr.add(1, 3);
+    Queues queues;
+    queues[0].assign(3, 10);
+    queues[1].assign(2, 1000);
+
+    // higher class drains first, however large its messages
+    ASSERT_EQ(1, next(drr, queues));
+    ASSERT_EQ(1, next(drr, queues));
+    ASSERT_EQ(0, next(drr, queues));
+    ASSERT_EQ(0, next(drr, queues));
+    queues[1].push_back(10);
+    ASSERT_EQ(1, next(drr, queues));
+    ASSERT_EQ(0, next(drr, queues));
+    ASSERT_EQ(-1, next(drr, queues));
+}
+
+TEST(TestSuite, testDeficitRoundRobinWeights) {
+    DeficitRoundRobin drr(100);
+    drr.add(0, 0, 1);
+    drr.add(1, 0, 3);
+    Queues queues;
+    queues[0].assign(100, 50);
+    queues[1].assign(100, 50);
+
+    std::map<size_t, size_t> sent;
+    for (size_t i = 0; i != 80; i++)
+        sent[next(drr, queues)] += 50;
+    ASSERT_EQ(1000, sent[0]);
+    ASSERT_EQ(3000, sent[1]);
+
+    // sizes do not matter, only bytes
+    DeficitRoundRobin sized(100);
+    sized.add(0, 0);
+    sized.add(1, 0);
+    queues.clear();
+    queues[0].assign(100, 10);
+    queues[1].assign(10, 100);
+    sent.clear();
+    for (size_t i = 0; i != 22; i++) {
+        size_t id = next(sized, queues);
+        sent[id] += id == 0 ? 10 : 100;
+    }
+    ASSERT_EQ(sent[0], sent[1]);
+}
+
+TEST(TestSuite, testDeficitRoundRobinIdle) {
+    DeficitRoundRobin drr(100);
+    drr.add(0, 0);
+    drr.add(1, 0);
+    Queues queues;
+    queues[1].assign(3, 100);
+
+    // idle flows do not bank credit
+    ASSERT_EQ(1, next(drr, queues));
+    ASSERT_EQ(1, next(drr, queues));
+    queues[0].assign(3, 100);
+    ASSERT_EQ(0, next(drr, queues));
+    ASSERT_EQ(1, next(drr, queues));
+    ASSERT_EQ(0, next(drr, queues));
+    ASSERT_EQ(0, next(drr, queues));
+    ASSERT_EQ(-1, next(drr, queues));
+
+    // large messages take several rounds
+    queues[0].assign(1, 250);
+    queues[1].assign(3, 100);
+    ASSERT_EQ(1, next(drr, queues));
+    ASSERT_EQ(1, next(drr, queues));
+    ASSERT_EQ(0, next(drr, queues));
+    ASSERT_EQ(1, next(drr, queues));
+
+    drr.remove(0);
+    ASSERT_FALSE(drr.has(0));
+    ASSERT_EQ(1, drr.size());
+    queues[0].assign(1, 1);
+    ASSERT_EQ(-1, next(drr, queues));
+}
+
+TEST(TestSuite, testTokenBucket) {
+    TokenBucket unlimited;
+    ASSERT_FALSE(unlimited.is_limited());
+    ASSERT_TRUE(unlimited.consume(1 << 30, 0));
+    ASSERT_EQ(0, unlimited.wait(0));
+
+    TokenBucket bucket(1000, 100);
+    ASSERT_TRUE(bucket.is_limited());
+    ASSERT_TRUE(bucket.consume(60, 0));
+    ASSERT_TRUE(bucket.consume(60, 0));
+    // in debt
+    ASSERT_FALSE(bucket.consume(1, 0));
+    ASSERT_GT(bucket.wait(0), 0.02);
+    ASSERT_LT(bucket.wait(0), 0.022);
+    ASSERT_TRUE(bucket.consume(500, 0.025));
+    ASSERT_FALSE(bucket.consume(1, 0.4));
+    ASSERT_TRUE(bucket.consume(1, 0.53));
+    // refills no further than burst
+    ASSERT_TRUE(bucket.consume(100, 10));
+    ASSERT_FALSE(bucket.consume(1, 10));
+}
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+
+#include "cpp/video_layers.h"
+
+
+TEST(TestSuite, testVideoLayerLadder) {
+    ASSERT_TRUE(is_video_layer_ladder({1}));
+    ASSERT_TRUE(is_video_layer_ladder({1, 2}));
+    ASSERT_TRUE(is_video_layer_ladder({1, 2, 4}));
+    ASSERT_TRUE(is_video_layer_ladder({1, 3, 6}));
+
+    ASSERT_FALSE(is_video_layer_ladder({}));
+    ASSERT_FALSE(is_video_layer_ladder({2, 4}));
+    ASSERT_FALSE(is_video_layer_ladder({1, 1}));
+    ASSERT_FALSE(is_video_layer_ladder({1, 4, 2}));
+    ASSERT_FALSE(is_video_layer_ladder({1, 2, 3}));
+    ASSERT_FALSE(is_video_layer_ladder({1, 2, 4, 8}));
+}
+
+TEST(TestSuite, testVideoLayerSize) {
+    ASSERT_EQ(640, video_layer_size(640, 1));
+    ASSERT_EQ(320, video_layer_size(640, 2));
+    ASSERT_EQ(160, video_layer_size(640, 4));
+    ASSERT_EQ(180, video_layer_size(360, 2));
+    ASSERT_EQ(90, video_layer_size(360, 4));
+    ASSERT_EQ(60, video_layer_size(360, 6));
+    ASSERT_EQ(118, video_layer_size(474, 4));
+    ASSERT_EQ(2, video_layer_size(4, 8));
+}
+
+TEST(TestSuite, testTemporalLayerFilterAll) {
+    TemporalLayerFilter filter;
+
+    // nothing until a keyframe
+    ASSERT_FALSE(filter.pass(0, false, false));
+    ASSERT_TRUE(filter.pass(0, false, true));
+    ASSERT_TRUE(filter.pass(2, true, false));
+    ASSERT_TRUE(filter.pass(1, true, false));
+    ASSERT_TRUE(filter.pass(2, false, false));
+    ASSERT_TRUE(filter.pass(0, false, false));
+}
+
+TEST(TestSuite, testTemporalLayerFilterBase) {
+    TemporalLayerFilter filter(1);
+
+    ASSERT_TRUE(filter.pass(0, false, true));
+    ASSERT_FALSE(filter.pass(2, true, false));
+    ASSERT_FALSE(filter.pass(1, true, false));
+    ASSERT_FALSE(filter.pass(2, false, false));
+    ASSERT_TRUE(filter.pass(0, false, false));
+}
+
+TEST(TestSuite, testTemporalLayerFilterSwitch) {
+    TemporalLayerFilter filter(1);
+    ASSERT_TRUE(filter.pass(0, false, true));
+
+    // up only from a sync frame, one layer at a time
+    filter.set_forward(0);
+    ASSERT_EQ(0, filter.forward());
+    ASSERT_FALSE(filter.pass(2, true, false));
+    ASSERT_FALSE(filter.pass(1, false, false));
+    ASSERT_TRUE(filter.pass(1, true, false));
+    ASSERT_FALSE(filter.pass(2, false, false));
+    ASSERT_TRUE(filter.pass(2, true, false));
+    ASSERT_TRUE(filter.pass(2, false, false));
+    ASSERT_TRUE(filter.pass(1, false, false));
+
+    // down straight away
+    filter.set_forward(2);
+    ASSERT_EQ(2, filter.forward());
+    ASSERT_FALSE(filter.pass(2, false, false));
+    ASSERT_TRUE(filter.pass(1, false, false));
+    ASSERT_TRUE(filter.pass(0, false, false));
+
+    // a keyframe syncs every forwarded layer
+    filter.set_forward(1);
+    filter.set_forward(3);
+    ASSERT_FALSE(filter.pass(1, false, false));
+    ASSERT_TRUE(filter.pass(0, false, true));
+    ASSERT_TRUE(filter.pass(1, false, false));
+    ASSERT_TRUE(filter.pass(2, false, false));
+}